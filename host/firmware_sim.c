@@ -0,0 +1,288 @@
+/**********
+  * @file    firmware_sim.c
+  * @author  A. Riedinger.
+  * @brief   Corrida del firmware completo (main.c) en la simulacion en PC,
+  *          con el hardware del TP conectado:
+  *          - LM35 en PC0/ADC1: 23,4 grados que pasan a 27,1 a mitad de la corrida.
+  *          - Teclado de 2x2 (filas F1/F2, columnas C1/C2): una pulsacion por
+  *            segundo, S1 a S4 en orden.
+  *          - LCD 16x2 (HD44780 simulado, ver SIM_LCD).
+  *          Al final informa la carga de CPU, los tiempos de las interrupciones
+  *          y las tareas (PROBE_t) y el contenido del LCD, y controla que el
+  *          display muestre la temperatura, los segundos y las pulsaciones sin
+  *          errores de tiempos en el bus.
+  *
+  * USO:
+  	  * firmware_sim [segundos]		(10 por defecto)
+  	  * Sale con 0 si todos los controles dan bien.
+**********/
+
+/*------------------------------------------------------------------------------
+LIBRERIAS:
+------------------------------------------------------------------------------*/
+#include "sim.h"
+#include <stdlib.h>
+
+/*------------------------------------------------------------------------------
+DEFINICIONES:
+------------------------------------------------------------------------------*/
+//Duracion por defecto de la corrida [seg]:
+#define Run_Seconds 10
+
+//LM35 (10 mV/grado): temperatura antes y despues del escalon, en decimas de grado,
+//y fondo de escala del firmware (MAXTempDegrees = 4095 cuentas):
+#define LM35_Before   234
+#define LM35_After    271
+#define LM35_FullDeci 2060
+#define LM35_Noise    2		//Ruido maximo [cuentas]
+
+//Teclado: primera pulsacion, periodo entre pulsaciones y tiempo apretado [mseg]:
+#define Key_First  300
+#define Key_Period 1000
+#define Key_Hold   80
+
+//Tolerancias de los controles:
+#define Check_TempDeci 2
+#define Check_Seg      1
+
+//Ciclos de CPU en un tiempo:
+#define MS(ms) ((uint64_t) (ms) * (SIM_HCLK / 1000))
+
+/*------------------------------------------------------------------------------
+DECLARACION DE FUNCIONES LOCALES:
+------------------------------------------------------------------------------*/
+uint16_t LM35(ADC_TypeDef* ADCx, uint8_t Channel);
+void KEYPAD(void);
+void PRESS(void);
+void RELEASE(void);
+void IDLE_SAMPLE(void);
+void IDLE_ADD(void);
+void REPORT_PROBE(const char* Name, PROBE_t* Probe);
+uint32_t PARSE_INT(const char* Text, uint8_t Len);
+
+/*------------------------------------------------------------------------------
+VARIABLES GLOBALES:
+------------------------------------------------------------------------------*/
+//Variables del firmware (main.c):
+extern int firmware_main(void);
+extern LCD_t LCD;
+extern SCHED_TASK_t Tasks[];
+extern PROBE_t ProbeTIM3;
+extern PROBE_t ProbeEXTI;
+extern PROBE_t ProbeRender;
+extern uint32_t IdleCycles;
+extern uint32_t Seg;
+
+//Escalon del LM35 y generador de ruido (congruencial):
+uint64_t StepAt;
+uint32_t Noise = 1;
+
+//Teclado: tecla apretada (0 = ninguna), pulsaciones hechas, columnas y flancos entregados:
+uint8_t Pressed = 0;
+uint32_t Presses = 0;
+uint8_t ColLevel[2];
+uint32_t Edges[5];
+
+//Valor esperado del indicador, con la misma regla que SWITCHS (a partir de 100 se reinicia):
+uint32_t ExpectedCont = 0;
+
+//Tiempo dormido: la cuenta de 32 bits del firmware se acumula una vez por segundo:
+uint32_t IdleLast = 0;
+uint64_t IdleTotal = 0;
+
+int main(int argc, char** argv)
+{
+/*------------------------------------------------------------------------------
+VARIABLES LOCALES:
+------------------------------------------------------------------------------*/
+	unsigned long TempInt, TempDec;
+	uint32_t Seconds = Run_Seconds, SegShown, IndShown, SegExpected, Row;
+	SIM_LCD_STATS_t Stats;
+	SIM_END_t End;
+	char Text[2][TLCD_MAXX + 1];
+	uint8_t Ok = 1;
+
+	if (argc > 1)
+		Seconds = atoi(argv[1]);
+	if (Seconds == 0)
+		Seconds = Run_Seconds;
+
+/*------------------------------------------------------------------------------
+HARDWARE SIMULADO:
+------------------------------------------------------------------------------*/
+	SIM_INIT();
+	SIM_LCD(&LCD);
+	SIM_ANALOG(LM35);
+	SIM_ON_OUTPUT(KEYPAD);
+	SIM_INPUT(GPIOC, GPIO_Pin_6 | GPIO_Pin_8, 0);
+
+	StepAt = MS(Seconds * 1000 / 2);
+	SIM_AT(MS(Key_First), PRESS);
+	SIM_AT(MS(1000), IDLE_SAMPLE);
+
+	End = SIM_RUN(firmware_main, Seconds * 1000);
+
+/*------------------------------------------------------------------------------
+INFORME:
+------------------------------------------------------------------------------*/
+	printf("Corrida: %lu seg (%s)\n", (unsigned long) Seconds,
+			End == SIM_END_TIME ? "tiempo cumplido" : End == SIM_END_RETURN ? "el main termino" :
+			End == SIM_END_IDLE ? "WFI sin eventos" : "interrupcion sin handler");
+	IDLE_ADD();
+	printf("Carga de CPU: %.2f %%\n", 100.0 * (1.0 - (double) IdleTotal / SIM_CYCLES()));
+
+	printf("\n%-10s %10s %10s %10s %10s %9s\n", "[useg]", "Ejecucion", "Maximo", "Latencia", "Jitter", "Overruns");
+	REPORT_PROBE("TIM3", &ProbeTIM3);
+	REPORT_PROBE("EXTI9_5", &ProbeEXTI);
+	REPORT_PROBE("PendSV", &ProbeRender);
+	REPORT_PROBE("SWITCHS", &Tasks[0].Probe);
+	REPORT_PROBE("TIMERS", &Tasks[1].Probe);
+
+	printf("\n+----------------+\n");
+	for (Row = 0; Row < 2; Row++) {
+		SIM_LCD_ROW(Row, Text[Row]);
+		printf("|%s|\n", Text[Row]);
+	}
+	printf("+----------------+\n");
+
+	SIM_LCD_STATS(&Stats);
+	printf("\nLCD: %lu pulsos de E, %lu comandos, %lu datos\n", (unsigned long) Stats.Pulses,
+			(unsigned long) Stats.Commands, (unsigned long) Stats.Data);
+	printf("LCD: %lu antes de terminar el anterior, %lu pulsos cortos, %lu antes del encendido\n",
+			(unsigned long) Stats.Busy, (unsigned long) Stats.Short, (unsigned long) Stats.Early);
+	printf("Teclado: %lu pulsaciones, flancos S1..S4 = %lu %lu %lu %lu\n", (unsigned long) Presses,
+			(unsigned long) Edges[1], (unsigned long) Edges[2], (unsigned long) Edges[3], (unsigned long) Edges[4]);
+
+/*------------------------------------------------------------------------------
+CONTROLES:
+------------------------------------------------------------------------------*/
+	//Temperatura "TDII T: 27.1 ^C" (decimas en punto fijo desde la columna 8):
+	if (strncmp(Text[0], "TDII T:", 7) != 0 || sscanf(&Text[0][8], "%lu.%lu", &TempInt, &TempDec) != 2 ||
+		TempInt * 10 + TempDec + Check_TempDeci < LM35_After || TempInt * 10 + TempDec > LM35_After + Check_TempDeci) {
+		printf("ERROR: temperatura, se esperaba %u.%u\n", LM35_After / 10, LM35_After % 10);
+		Ok = 0;
+	}
+
+	//Segundos (el cuadro es de hasta 250 mseg antes) e indicador de pulsaciones:
+	SegShown = PARSE_INT(&Text[1][5], 2);
+	SegExpected = Seconds % 100;
+	if (strncmp(Text[1], "Seg:", 4) != 0 || SegShown + Check_Seg < SegExpected || SegShown > SegExpected + Check_Seg) {
+		printf("ERROR: segundos, se esperaba %lu (firmware: %lu)\n", (unsigned long) SegExpected, (unsigned long) Seg);
+		Ok = 0;
+	}
+	IndShown = PARSE_INT(&Text[1][14], 2);
+	if (strncmp(&Text[1][9], "ind:", 4) != 0 || IndShown != ExpectedCont) {
+		printf("ERROR: indicador, se esperaba %lu\n", (unsigned long) ExpectedCont);
+		Ok = 0;
+	}
+
+	if (Stats.Busy || Stats.Short || Stats.Early) {
+		printf("ERROR: tiempos del bus del LCD\n");
+		Ok = 0;
+	}
+
+	//Lazo de latencia (TIM9 -> EXTI9_5): alguna entrada medida desde el flanco:
+	if (ProbeEXTI.LatencyMax == 0) {
+		printf("ERROR: el lazo de latencia del EXTI9_5 no midio nada\n");
+		Ok = 0;
+	}
+	if (End != SIM_END_TIME)
+		Ok = 0;
+
+	printf("\n%s\n", Ok ? "OK" : "FALLO");
+	return Ok ? 0 : 1;
+}
+
+/*------------------------------------------------------------------------------
+MODELOS DEL HARDWARE:
+------------------------------------------------------------------------------*/
+//LM35 en PC0 (ADC123_IN10), el resto de los canales en 0:
+uint16_t LM35(ADC_TypeDef* ADCx, uint8_t Channel)
+{
+	uint32_t Deci = (SIM_CYCLES() < StepAt) ? LM35_Before : LM35_After;
+
+	if (ADCx != ADC1 || Channel != ADC_Channel_10)
+		return 0;
+
+	Noise = Noise * 1103515245 + 12345;
+	return (Deci * 4095 + LM35_FullDeci / 2) / LM35_FullDeci + (int32_t) ((Noise >> 16) % (2 * LM35_Noise + 1)) - LM35_Noise;
+}
+
+//Teclado: C1 = S1.F1 + S2.F2 y C2 = S3.F1 + S4.F2. Cada flanco de subida de una
+//columna es una pulsacion para el EXTI, de la tecla que lee el handler:
+void KEYPAD(void)
+{
+	uint8_t F1 = (GPIOC->ODR & GPIO_Pin_9) != 0, F2 = (GPIOB->ODR & GPIO_Pin_8) != 0;
+	uint8_t C1 = (Pressed == 1 && F1) || (Pressed == 2 && F2);
+	uint8_t C2 = (Pressed == 3 && F1) || (Pressed == 4 && F2);
+	uint8_t Key = 0;
+
+	if (C1 && !ColLevel[0])
+		Key = F1 ? 1 : 2;
+	if (C2 && !ColLevel[1])
+		Key = F1 ? 3 : 4;
+	ColLevel[0] = C1;
+	ColLevel[1] = C2;
+	SIM_INPUT(GPIOC, GPIO_Pin_6 | GPIO_Pin_8, (C1 ? GPIO_Pin_6 : 0) | (C2 ? GPIO_Pin_8 : 0));
+
+	if (Key) {
+		Edges[Key]++;
+		if (ExpectedCont >= 100)
+			ExpectedCont = 0;
+		else
+			ExpectedCont += Key;
+	}
+}
+
+void PRESS(void)
+{
+	Pressed = 1 + Presses % 4;
+	Presses++;
+	KEYPAD();
+	SIM_AT(SIM_CYCLES() + MS(Key_Hold), RELEASE);
+	SIM_AT(SIM_CYCLES() + MS(Key_Period), PRESS);
+}
+
+void RELEASE(void)
+{
+	Pressed = 0;
+	KEYPAD();
+}
+
+//Tiempo dormido acumulado en 64 bits (IdleCycles da la vuelta a los 23 seg):
+void IDLE_SAMPLE(void)
+{
+	IDLE_ADD();
+	SIM_AT(SIM_CYCLES() + MS(1000), IDLE_SAMPLE);
+}
+
+void IDLE_ADD(void)
+{
+	IdleTotal += (uint32_t) (IdleCycles - IdleLast);
+	IdleLast = IdleCycles;
+}
+
+/*------------------------------------------------------------------------------
+FUNCIONES AUXILIARES:
+------------------------------------------------------------------------------*/
+void REPORT_PROBE(const char* Name, PROBE_t* Probe)
+{
+	double Us = SIM_HCLK / 1e6;
+
+	printf("%-10s %10.2f %10.2f %10.2f %10.2f %9lu\n", Name,
+			BENCH_MEAN(&Probe->Exec) / Us, Probe->Exec.Max / Us, Probe->LatencyMax / Us,
+			Probe->Exec.Count > 1 ? (Probe->IntervalMax - Probe->IntervalMin) / Us : 0.0,
+			(unsigned long) Probe->Overruns);
+}
+
+//Numero de Len digitos (los espacios de relleno cuentan como 0):
+uint32_t PARSE_INT(const char* Text, uint8_t Len)
+{
+	uint32_t Value = 0;
+	uint8_t i;
+
+	for (i = 0; i < Len; i++)
+		Value = Value * 10 + ((Text[i] >= '0' && Text[i] <= '9') ? Text[i] - '0' : 0);
+
+	return Value;
+}
@@ -0,0 +1,11 @@
+/**********
+  * @file    core_cm4_simd.h
+  * @author  A. Riedinger.
+  * @brief   Reemplazo vacio del core_cm4_simd.h del CMSIS para la simulacion
+  *          en PC: el firmware no usa las instrucciones SIMD.
+**********/
+
+#ifndef __CORE_CM4_SIMD_H
+#define __CORE_CM4_SIMD_H
+
+#endif /* __CORE_CM4_SIMD_H */
@@ -0,0 +1,132 @@
+/**********
+  * @file    core_cmFunc.h
+  * @author  A. Riedinger.
+  * @brief   Reemplazo del core_cmFunc.h del CMSIS para la simulacion en PC:
+  *          PRIMASK, FAULTMASK y BASEPRI son del simulador (sim.c), que
+  *          atiende lo pendiente al desenmascarar. El resto de los registros
+  *          del nucleo se leen en 0 (pila unica, sin FPU).
+**********/
+
+#ifndef __CORE_CMFUNC_H
+#define __CORE_CMFUNC_H
+
+#include <stdint.h>
+
+//Funciones del simulador (sim.c):
+uint32_t SIM_GET_MASK(uint8_t);
+void SIM_SET_MASK(uint8_t, uint32_t);
+uint32_t SIM_GET_IPSR(void);
+
+//Registro de SIM_GET_MASK/SIM_SET_MASK:
+#define SIM_PRIMASK    0
+#define SIM_FAULTMASK  1
+#define SIM_BASEPRI    2
+
+#define SIM_FUNC static inline __attribute__((always_inline, no_instrument_function))
+
+SIM_FUNC void __enable_irq(void)
+{
+	SIM_SET_MASK(SIM_PRIMASK, 0);
+}
+
+SIM_FUNC void __disable_irq(void)
+{
+	SIM_SET_MASK(SIM_PRIMASK, 1);
+}
+
+SIM_FUNC uint32_t __get_PRIMASK(void)
+{
+	return SIM_GET_MASK(SIM_PRIMASK);
+}
+
+SIM_FUNC void __set_PRIMASK(uint32_t priMask)
+{
+	SIM_SET_MASK(SIM_PRIMASK, priMask & 1);
+}
+
+SIM_FUNC void __enable_fault_irq(void)
+{
+	SIM_SET_MASK(SIM_FAULTMASK, 0);
+}
+
+SIM_FUNC void __disable_fault_irq(void)
+{
+	SIM_SET_MASK(SIM_FAULTMASK, 1);
+}
+
+SIM_FUNC uint32_t __get_FAULTMASK(void)
+{
+	return SIM_GET_MASK(SIM_FAULTMASK);
+}
+
+SIM_FUNC void __set_FAULTMASK(uint32_t faultMask)
+{
+	SIM_SET_MASK(SIM_FAULTMASK, faultMask & 1);
+}
+
+SIM_FUNC uint32_t __get_BASEPRI(void)
+{
+	return SIM_GET_MASK(SIM_BASEPRI);
+}
+
+SIM_FUNC void __set_BASEPRI(uint32_t value)
+{
+	SIM_SET_MASK(SIM_BASEPRI, value & 0xFF);
+}
+
+SIM_FUNC uint32_t __get_IPSR(void)
+{
+	return SIM_GET_IPSR();
+}
+
+SIM_FUNC uint32_t __get_xPSR(void)
+{
+	return SIM_GET_IPSR();
+}
+
+SIM_FUNC uint32_t __get_APSR(void)
+{
+	return 0;
+}
+
+SIM_FUNC uint32_t __get_CONTROL(void)
+{
+	return 0;
+}
+
+SIM_FUNC void __set_CONTROL(uint32_t control)
+{
+	(void) control;
+}
+
+SIM_FUNC uint32_t __get_PSP(void)
+{
+	return 0;
+}
+
+SIM_FUNC void __set_PSP(uint32_t topOfProcStack)
+{
+	(void) topOfProcStack;
+}
+
+SIM_FUNC uint32_t __get_MSP(void)
+{
+	return 0;
+}
+
+SIM_FUNC void __set_MSP(uint32_t topOfMainStack)
+{
+	(void) topOfMainStack;
+}
+
+SIM_FUNC uint32_t __get_FPSCR(void)
+{
+	return 0;
+}
+
+SIM_FUNC void __set_FPSCR(uint32_t fpscr)
+{
+	(void) fpscr;
+}
+
+#endif /* __CORE_CMFUNC_H */
@@ -0,0 +1,153 @@
+/**********
+  * @file    core_cmInstr.h
+  * @author  A. Riedinger.
+  * @brief   Reemplazo del core_cmInstr.h del CMSIS para la simulacion en PC:
+  *          las instrucciones del Cortex-M4 en C. WFI, las barreras y el
+  *          monitor de LDREX/STREX pasan por el simulador (sim.c).
+**********/
+
+#ifndef __CORE_CMINSTR_H
+#define __CORE_CMINSTR_H
+
+#include <stdint.h>
+
+//Funciones del simulador (sim.c):
+void SIM_WFI(void);
+void SIM_BARRIER(void);
+extern volatile uint8_t SIM_Exclusive;
+
+//Sin llamadas a los hooks de -finstrument-functions: una instruccion no cuesta una llamada:
+#define SIM_INSTR static inline __attribute__((always_inline, no_instrument_function))
+
+SIM_INSTR void __NOP(void)
+{
+}
+
+SIM_INSTR void __WFI(void)
+{
+	SIM_WFI();
+}
+
+SIM_INSTR void __WFE(void)
+{
+	SIM_WFI();
+}
+
+SIM_INSTR void __SEV(void)
+{
+}
+
+//Barreras: ordenan al compilador y son un punto donde puede entrar una interrupcion:
+SIM_INSTR void __ISB(void)
+{
+	SIM_BARRIER();
+}
+
+SIM_INSTR void __DSB(void)
+{
+	SIM_BARRIER();
+}
+
+SIM_INSTR void __DMB(void)
+{
+	SIM_BARRIER();
+}
+
+SIM_INSTR uint32_t __REV(uint32_t value)
+{
+	return __builtin_bswap32(value);
+}
+
+SIM_INSTR uint32_t __REV16(uint32_t value)
+{
+	return ((value & 0xFF00FF00) >> 8) | ((value & 0x00FF00FF) << 8);
+}
+
+SIM_INSTR int32_t __REVSH(int32_t value)
+{
+	return (int16_t) __builtin_bswap16((uint16_t) value);
+}
+
+SIM_INSTR uint32_t __ROR(uint32_t op1, uint32_t op2)
+{
+	op2 &= 31;
+	return op2 ? (op1 >> op2) | (op1 << (32 - op2)) : op1;
+}
+
+SIM_INSTR uint32_t __RBIT(uint32_t value)
+{
+	uint32_t Result = 0;
+	uint8_t i;
+
+	for (i = 0; i < 32; i++, value >>= 1)
+		Result = (Result << 1) | (value & 1);
+	return Result;
+}
+
+SIM_INSTR uint8_t __CLZ(uint32_t value)
+{
+	return value ? __builtin_clz(value) : 32;
+}
+
+//Acceso exclusivo: el STREX falla si hubo una interrupcion desde el LDREX:
+SIM_INSTR uint8_t __LDREXB(volatile uint8_t* addr)
+{
+	SIM_Exclusive = 1;
+	return *addr;
+}
+
+SIM_INSTR uint16_t __LDREXH(volatile uint16_t* addr)
+{
+	SIM_Exclusive = 1;
+	return *addr;
+}
+
+SIM_INSTR uint32_t __LDREXW(volatile uint32_t* addr)
+{
+	SIM_Exclusive = 1;
+	return *addr;
+}
+
+SIM_INSTR uint32_t __STREXB(uint8_t value, volatile uint8_t* addr)
+{
+	if (!SIM_Exclusive)
+		return 1;
+	SIM_Exclusive = 0;
+	*addr = value;
+	return 0;
+}
+
+SIM_INSTR uint32_t __STREXH(uint16_t value, volatile uint16_t* addr)
+{
+	if (!SIM_Exclusive)
+		return 1;
+	SIM_Exclusive = 0;
+	*addr = value;
+	return 0;
+}
+
+SIM_INSTR uint32_t __STREXW(uint32_t value, volatile uint32_t* addr)
+{
+	if (!SIM_Exclusive)
+		return 1;
+	SIM_Exclusive = 0;
+	*addr = value;
+	return 0;
+}
+
+SIM_INSTR void __CLREX(void)
+{
+	SIM_Exclusive = 0;
+}
+
+#define __BKPT(value)  __builtin_trap()
+
+#define __SSAT(ARG1, ARG2) \
+	__extension__ ({ int32_t __v = (ARG1), __m = (1 << ((ARG2) - 1)) - 1; \
+	                 __v > __m ? __m : (__v < -__m - 1 ? -__m - 1 : __v); })
+
+#define __USAT(ARG1, ARG2) \
+	__extension__ ({ int32_t __v = (ARG1), __m = (int32_t) ((1UL << (ARG2)) - 1); \
+	                 (uint32_t) (__v > __m ? __m : (__v < 0 ? 0 : __v)); })
+
+#endif /* __CORE_CMINSTR_H */
@@ -0,0 +1,56 @@
+#ifndef sim_H
+#define sim_H
+
+#include "mi_libreria.h"
+
+
+//--------------------------------------------------------------
+// Defines
+//--------------------------------------------------------------
+#define  SIM_HCLK        180000000  // Reloj de la CPU simulada [Hz] (PLL de system_stm32f4xx.c)
+#define  SIM_CALL_CYCLES         8  // Costo de entrar a una funcion del firmware [ciclos] (aproximado)
+#define  SIM_RET_CYCLES          2  // Costo de volver de una funcion [ciclos]
+#define  SIM_DWT_CYCLES          6  // Costo de un acceso al DWT (una vuelta de un lazo de espera) [ciclos]
+#define  SIM_IRQ_ENTRY          12  // Entrada a una interrupcion: apilado y vector [ciclos]
+#define  SIM_IRQ_EXIT           10  // Salida de una interrupcion [ciclos]
+#define  SIM_EVENTS             16  // Eventos programados a la vez (SIM_AT)
+
+//--------------------------------------------------------------
+// Fin de una corrida (SIM_RUN)
+//--------------------------------------------------------------
+typedef enum {
+  SIM_END_TIME = 0,   // Se cumplio el tiempo pedido
+  SIM_END_RETURN,     // La funcion termino
+  SIM_END_IDLE,       // WFI sin ningun evento por delante
+  SIM_END_FAULT       // Interrupcion habilitada sin handler
+}SIM_END_t;
+
+//--------------------------------------------------------------
+// Contadores del HD44780 simulado (SIM_LCD_STATS)
+//--------------------------------------------------------------
+typedef struct {
+  uint32_t Pulses;      // Flancos de bajada de E (un byte en 8 bits, medio en 4)
+  uint32_t Commands;    // Bytes con RS = 0
+  uint32_t Data;        // Bytes con RS = 1
+  uint32_t Busy;        // Bytes que llegaron antes de terminar el anterior
+  uint32_t Short;       // Pulsos de E de menos de 450 nseg
+  uint32_t Early;       // Bytes antes de los 15 mseg de encendido
+}SIM_LCD_STATS_t;
+
+//--------------------------------------------------------------
+// FUNCIONES GLOBALES
+//--------------------------------------------------------------
+void	SIM_INIT(void);
+SIM_END_t SIM_RUN(int (*)(void), uint32_t);
+uint64_t SIM_CYCLES(void);
+uint8_t	SIM_AT(uint64_t, void (*)(void));
+void	SIM_INPUT(GPIO_TypeDef*, uint16_t, uint16_t);
+void	SIM_ON_OUTPUT(void (*)(void));
+void	SIM_ANALOG(uint16_t (*)(ADC_TypeDef*, uint8_t));
+void	SIM_LCD(LCD_t*);
+uint8_t	SIM_LCD_ROW(uint8_t, char*);
+void	SIM_LCD_STATS(SIM_LCD_STATS_t*);
+uint32_t SIM_GPIO_WRITES(void);
+
+
+#endif //sim_H
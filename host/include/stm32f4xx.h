@@ -0,0 +1,26 @@
+/**********
+  * @file    stm32f4xx.h
+  * @author  A. Riedinger.
+  * @brief   Header del micro para la simulacion en PC: incluye el original
+  *          (los registros quedan en sus direcciones reales, que sim.c mapea
+  *          en memoria) y cambia lo que necesita el simulador:
+  *          - DWT: cada acceso avanza el reloj, asi terminan los lazos de
+  *            espera sobre CYCCNT (DELAY_US, WAIT_CYCLES).
+  *          - P_DMB: barrera de las colas SPSC/seqlock sin assembler de ARM.
+**********/
+
+#ifndef SIM_STM32F4XX_H
+#define SIM_STM32F4XX_H
+
+#include_next "stm32f4xx.h"
+
+//Funciones del simulador (sim.c):
+DWT_Type* SIM_DWT(void);
+
+#undef  DWT
+#define DWT    (SIM_DWT())
+
+//Barrera de mi_libreria.c: tambien es un punto donde puede entrar una interrupcion:
+#define P_DMB()  __DMB()
+
+#endif /* SIM_STM32F4XX_H */
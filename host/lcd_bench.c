@@ -0,0 +1,346 @@
+/**********
+  * @file    lcd_bench.c
+  * @author  A. Riedinger.
+  * @brief   Medicion del costo del LCD en la simulacion en PC, con el
+  *          driver compilado con TLCD_BENCH en 1:
+  *          - Tiempo (BENCH_t, ciclos del DWT) de CLEAR_LCD, PRINT_LCD y de
+  *            un cuadro completo e incremental de REFRESH_LCD, en
+  *            modo bloqueante y por la cola del TIM7.
+  *          - Escrituras al bus por cuadro: las que cuenta el driver
+  *            (BUS_OPS_LCD_2x16) contra las que ve el simulador en los BSRR,
+  *            y pulsos de E contra bytes recibidos por el HD44780.
+  *          Controla que el display muestre el cuadro, que las cuentas
+  *          coincidan, que el cuadro incremental use menos escrituras que el
+  *          completo y que no haya errores de tiempos en el bus. Al final
+  *          escribe por DMA (TIM8) con el lazo de latencia (TIM9) corriendo,
+  *          y con las funciones *_LCD_2x16 y la tabla de pines sola, como
+  *          los programas anteriores a LCD_t.
+  *
+  * USO:
+  	  * lcd_bench		Sale con 0 si todos los controles dan bien.
+**********/
+
+/*------------------------------------------------------------------------------
+LIBRERIAS:
+------------------------------------------------------------------------------*/
+#include "sim.h"
+
+#if !TLCD_BENCH
+#error "lcd_bench necesita el driver con TLCD_BENCH en 1"
+#endif
+
+/*------------------------------------------------------------------------------
+DEFINICIONES:
+------------------------------------------------------------------------------*/
+//Mediciones de cada caso:
+#define Bench_Runs 16
+
+//Tiempo maximo de la corrida [mseg]:
+#define Bench_Limit 5000
+
+//Casos medidos:
+typedef enum {
+	CASE_CLEAR = 0,
+	CASE_PRINT,
+	CASE_FULL,
+	CASE_INCREMENTAL,
+	CASE_QUEUE_FULL,
+	CASE_QUEUE_INCREMENTAL,
+	CASES
+}CASE_NAME_t;
+
+//Una medicion: tiempo y escrituras del driver (BENCH_t), y lo que vio el simulador:
+typedef struct {
+	const char* Name;
+	BENCH_t Bench;
+	uint32_t Writes;	//Escrituras a los BSRR de la ultima medicion
+	uint32_t Pulses;	//Pulsos de E de la ultima medicion
+	uint32_t Bytes;		//Comandos y datos de la ultima medicion
+	uint8_t Match;		//Todas las mediciones con BusOps == Writes y Pulses == 2 x Bytes
+}CASE_t;
+
+/*------------------------------------------------------------------------------
+DECLARACION DE FUNCIONES LOCALES:
+------------------------------------------------------------------------------*/
+int BENCH(void);
+void FRAME(uint32_t Seg);
+void CASE_START(CASE_t* Case);
+void CASE_STOP(CASE_t* Case);
+uint8_t CHECK_ROWS(uint32_t Seg);
+uint8_t DMA_LOOP(void);
+uint8_t LEGACY(void);
+
+/*------------------------------------------------------------------------------
+VARIABLES GLOBALES:
+------------------------------------------------------------------------------*/
+//Mismo display que main.c, 16x2 con bus de 4 bits:
+LCD_2X16_t LCD_2X16[] = {
+			// Name  , PORT ,   PIN      ,         CLOCK       ,   Init
+			{ TLCD_RS, GPIOC, GPIO_Pin_10, RCC_AHB1Periph_GPIOC, Bit_RESET },
+			{ TLCD_E,  GPIOC, GPIO_Pin_11, RCC_AHB1Periph_GPIOC, Bit_RESET },
+			{ TLCD_D4, GPIOC, GPIO_Pin_12, RCC_AHB1Periph_GPIOC, Bit_RESET },
+			{ TLCD_D5, GPIOD, GPIO_Pin_2,  RCC_AHB1Periph_GPIOD, Bit_RESET },
+			{ TLCD_D6, GPIOF, GPIO_Pin_6,  RCC_AHB1Periph_GPIOF, Bit_RESET },
+			{ TLCD_D7, GPIOF, GPIO_Pin_7,  RCC_AHB1Periph_GPIOF, Bit_RESET }, };
+
+LCD_t LCD = { TLCD_PIN_TABLE(LCD_2X16), 16, 2, TLCD_BUS_4BIT };
+
+CASE_t Cases[CASES] = {
+		{ "CLEAR"          , { 0 }, 0, 0, 0, 1 },
+		{ "PRINT (16)"     , { 0 }, 0, 0, 0, 1 },
+		{ "Cuadro completo", { 0 }, 0, 0, 0, 1 },
+		{ "Cuadro incr."   , { 0 }, 0, 0, 0, 1 },
+		{ "Cola completo"  , { 0 }, 0, 0, 0, 1 },
+		{ "Cola incr."     , { 0 }, 0, 0, 0, 1 } };
+
+//Contenido del display despues de cada cuadro y con las funciones *_LCD_2x16:
+uint8_t RowsOk = 1;
+uint8_t DmaOk = 0;
+uint8_t LegacyOk = 0;
+
+//Entradas al EXTI9_5 por el lazo de latencia:
+PROBE_t ProbeLoop;
+
+//Otra tabla, nunca pasada a INIT_LCD_2x16:
+LCD_2X16_t LCD_Other[TLCD_LEGACY_ANZ];
+
+//Contadores al comenzar la medicion en curso:
+uint32_t WritesStart, PulsesStart, BytesStart;
+
+int main(void)
+{
+/*------------------------------------------------------------------------------
+VARIABLES LOCALES:
+------------------------------------------------------------------------------*/
+	double Us = SIM_HCLK / 1e6;
+	SIM_LCD_STATS_t Stats;
+	SIM_END_t End;
+	CASE_t* Case;
+	uint8_t Ok = 1, i;
+
+	SIM_INIT();
+	SIM_LCD(&LCD);
+	End = SIM_RUN(BENCH, Bench_Limit);
+
+/*------------------------------------------------------------------------------
+INFORME:
+------------------------------------------------------------------------------*/
+	printf("%-16s %9s %9s %9s %8s %9s %7s %6s\n", "[useg]", "Minimo", "Medio", "Maximo",
+			"BusOps", "BSRR sim", "Pulsos", "Bytes");
+	for (i = 0; i < CASES; i++) {
+		Case = &Cases[i];
+		printf("%-16s %9.2f %9.2f %9.2f %8lu %9lu %7lu %6lu%s\n", Case->Name,
+				Case->Bench.Min / Us, BENCH_MEAN(&Case->Bench) / Us, Case->Bench.Max / Us,
+				(unsigned long) Case->Bench.BusOps, (unsigned long) Case->Writes,
+				(unsigned long) Case->Pulses, (unsigned long) Case->Bytes, Case->Match ? "" : "  <- no coincide");
+		if (!Case->Match || Case->Bench.Count != Bench_Runs)
+			Ok = 0;
+	}
+
+	SIM_LCD_STATS(&Stats);
+	printf("\nLCD: %lu antes de terminar el anterior, %lu pulsos cortos, %lu antes del encendido\n",
+			(unsigned long) Stats.Busy, (unsigned long) Stats.Short, (unsigned long) Stats.Early);
+
+/*------------------------------------------------------------------------------
+CONTROLES:
+------------------------------------------------------------------------------*/
+	if (End != SIM_END_RETURN) {
+		printf("ERROR: la medicion no termino\n");
+		Ok = 0;
+	}
+	if (!RowsOk) {
+		printf("ERROR: el display no muestra el cuadro\n");
+		Ok = 0;
+	}
+	if (!DmaOk) {
+		printf("ERROR: el modo DMA o el lazo de latencia no funcionan juntos\n");
+		Ok = 0;
+	}
+	if (!LegacyOk) {
+		printf("ERROR: el display no responde a las funciones *_LCD_2x16\n");
+		Ok = 0;
+	}
+	if (Cases[CASE_INCREMENTAL].Bench.BusMax >= Cases[CASE_FULL].Bench.BusOps ||
+		Cases[CASE_QUEUE_INCREMENTAL].Bench.BusMax >= Cases[CASE_QUEUE_FULL].Bench.BusOps) {
+		printf("ERROR: el cuadro incremental no ahorra escrituras\n");
+		Ok = 0;
+	}
+	if (Stats.Busy || Stats.Short || Stats.Early) {
+		printf("ERROR: tiempos del bus del LCD\n");
+		Ok = 0;
+	}
+
+	printf("\n%s\n", Ok ? "OK" : "FALLO");
+	return Ok ? 0 : 1;
+}
+
+/*------------------------------------------------------------------------------
+MEDICIONES (corren en el micro simulado):
+------------------------------------------------------------------------------*/
+int BENCH(void)
+{
+	uint32_t Run, Seg = 0;
+
+	SystemInit();
+	INIT_DWT();
+	INIT_LCD(&LCD);
+	for (Run = 0; Run < CASES; Run++)
+		BENCH_RESET(&Cases[Run].Bench);
+
+	//Modo bloqueante: primitivas y cuadros, el completo siempre contra un display borrado:
+	for (Run = 0; Run < Bench_Runs; Run++) {
+		CASE_START(&Cases[CASE_CLEAR]);
+		CLEAR_LCD(&LCD);
+		CASE_STOP(&Cases[CASE_CLEAR]);
+
+		CASE_START(&Cases[CASE_PRINT]);
+		PRINT_LCD(&LCD, 0, 0, "TDII T: 27.1 ^C ");
+		CASE_STOP(&Cases[CASE_PRINT]);
+
+		CLEAR_LCD(&LCD);
+		FRAME(Seg);
+		CASE_START(&Cases[CASE_FULL]);
+		REFRESH_LCD(&LCD);
+		CASE_STOP(&Cases[CASE_FULL]);
+		RowsOk &= CHECK_ROWS(Seg);
+
+		//Cuadro siguiente: solo cambian los segundos:
+		FRAME(++Seg);
+		CASE_START(&Cases[CASE_INCREMENTAL]);
+		REFRESH_LCD(&LCD);
+		CASE_STOP(&Cases[CASE_INCREMENTAL]);
+		RowsOk &= CHECK_ROWS(Seg);
+	}
+
+	//Por la cola del TIM7: encolar y esperar a que se vacie:
+	INIT_LCD_QUEUE(&LCD, NULL);
+	for (Run = 0; Run < Bench_Runs; Run++) {
+		CLEAR_LCD(&LCD);
+		FLUSH_LCD_2x16();
+		FRAME(Seg);
+		CASE_START(&Cases[CASE_QUEUE_FULL]);
+		REFRESH_LCD(&LCD);
+		FLUSH_LCD_2x16();
+		CASE_STOP(&Cases[CASE_QUEUE_FULL]);
+		RowsOk &= CHECK_ROWS(Seg);
+
+		FRAME(++Seg);
+		CASE_START(&Cases[CASE_QUEUE_INCREMENTAL]);
+		REFRESH_LCD(&LCD);
+		FLUSH_LCD_2x16();
+		CASE_STOP(&Cases[CASE_QUEUE_INCREMENTAL]);
+		RowsOk &= CHECK_ROWS(Seg);
+	}
+
+	FLUSH_LCD_2x16();
+	DmaOk = DMA_LOOP();
+	LegacyOk = LEGACY();
+	return 0;
+}
+
+//Modo DMA (TIM8) con el lazo de latencia (TIM9 en PE6, EXTI9_5) corriendo, el lazo arrancado despues:
+uint8_t DMA_LOOP(void)
+{
+	char Text[TLCD_MAXX + 1];
+
+	if (!INIT_LCD_DMA(&LCD) || !INIT_PROBE_LOOP(GPIOE, GPIO_Pin_6))
+		return 0;
+	if (!PRINT_LCD_DMA(&LCD, 0, 1, "DMA + lazo TIM9 "))
+		return 0;
+	while (BUSY_LCD_2x16_DMA());
+
+	//Un par de flancos del lazo (uno cada 2 x 65536 x PROBE_LOOP_DIV ciclos):
+	DELAY_US(15000);
+
+	SIM_LCD_ROW(1, Text);
+	return strcmp(Text, "DMA + lazo TIM9 ") == 0 && ProbeLoop.Exec.Count > 0 && ProbeLoop.LatencyMax > 0;
+}
+
+void EXTI9_5_IRQHandler(void)
+{
+	if (PROBE_LOOP(&ProbeLoop)) {
+		PROBE_ENTER(&ProbeLoop);
+		PROBE_EXIT(&ProbeLoop);
+	}
+}
+
+//Mismo display con la tabla de pines sola (16x2, bus de 4 bits), una tabla
+//que no paso por INIT_LCD_2x16 no escribe nada:
+uint8_t LEGACY(void)
+{
+	char Text[TLCD_MAXX + 1];
+
+	INIT_LCD_2x16(LCD_2X16);
+	PRINT_LCD_2x16(LCD_2X16, 0, 0, "Tabla 2x16");
+	PRINT_LCD_2x16(LCD_Other, 0, 1, "Otra tabla");
+
+	SIM_LCD_ROW(0, Text);
+	if (strcmp(Text, "Tabla 2x16      ") != 0)
+		return 0;
+	SIM_LCD_ROW(1, Text);
+	if (strcmp(Text, "                ") != 0)
+		return 0;
+
+	CLEAR_FRAME_LCD_2x16();
+	PRINT_FRAME_LCD_2x16(0, 1, "Cuadro");
+	REFRESH_LCD_2x16(LCD_Other);
+	REFRESH_LCD_2x16(LCD_2X16);
+
+	SIM_LCD_ROW(0, Text);
+	if (strcmp(Text, "                ") != 0)
+		return 0;
+	SIM_LCD_ROW(1, Text);
+	return strcmp(Text, "Cuadro          ") == 0;
+}
+
+//Mismo cuadro que DRAW_LCD de main.c:
+void FRAME(uint32_t Seg)
+{
+	CLEAR_FRAME_LCD_2x16();
+	PRINT_FRAME_LCD_2x16(0, 0, "TDII T:");
+	PRINT_FRAME_FIXED_LCD_2x16(8, 0, 271, 1, 0, ' ');
+	PRINT_FRAME_LCD_2x16(13, 0, "^C");
+	PRINT_FRAME_LCD_2x16(0, 1, "Seg:");
+	PRINT_FRAME_INT_LCD_2x16(5, 1, Seg % 100, 2, '0');
+	PRINT_FRAME_LCD_2x16(9, 1, "ind:");
+	PRINT_FRAME_INT_LCD_2x16(14, 1, 23, 2, '0');
+}
+
+void CASE_START(CASE_t* Case)
+{
+	SIM_LCD_STATS_t Stats;
+
+	SIM_LCD_STATS(&Stats);
+	WritesStart = SIM_GPIO_WRITES();
+	PulsesStart = Stats.Pulses;
+	BytesStart = Stats.Commands + Stats.Data;
+	BENCH_START(&Case->Bench);
+}
+
+void CASE_STOP(CASE_t* Case)
+{
+	SIM_LCD_STATS_t Stats;
+
+	BENCH_STOP(&Case->Bench);
+	SIM_LCD_STATS(&Stats);
+	Case->Writes = SIM_GPIO_WRITES() - WritesStart;
+	Case->Pulses = Stats.Pulses - PulsesStart;
+	Case->Bytes = Stats.Commands + Stats.Data - BytesStart;
+
+	//Bus de 4 bits: dos pulsos de E por byte:
+	if (Case->Bench.BusOps != Case->Writes || Case->Pulses != 2 * Case->Bytes)
+		Case->Match = 0;
+}
+
+uint8_t CHECK_ROWS(uint32_t Seg)
+{
+	char Text[TLCD_MAXX + 1], Expected[TLCD_MAXX + 1];
+
+	SIM_LCD_ROW(0, Text);
+	if (strcmp(Text, "TDII T: 27.1 ^C ") != 0)
+		return 0;
+
+	SIM_LCD_ROW(1, Text);
+	snprintf(Expected, sizeof(Expected), "Seg: %02lu  ind: 23", (unsigned long) (Seg % 100));
+	return strcmp(Text, Expected) == 0;
+}
@@ -0,0 +1,1979 @@
+/**********
+  * @file    sim.c
+  * @author  A. Riedinger.
+  * @brief   Simulacion del STM32F429 en PC, para correr el firmware (LCD,
+  *          despachador, colas y timers por software) sin la placa:
+  *          - Los registros de los perifericos son memoria mapeada en sus
+  *            direcciones reales: el firmware y el StdPeriph no cambian.
+  *          - El reloj es virtual (ciclos de CPU a SIM_HCLK) y avanza en cada
+  *            llamada a una funcion del firmware (-finstrument-functions), en
+  *            cada acceso al DWT, en las barreras y en el WFI. Ahi se procesa
+  *            lo escrito por el firmware, avanzan los perifericos y entran las
+  *            interrupciones, por prioridad y con anidamiento.
+  *          - Modelos: GPIO, EXTI, NVIC, SCB (PendSV), SysTick, DWT (CYCCNT),
+  *            TIM1...TIM14, ADC1...ADC3, DMA1/DMA2 y un HD44780 conectado a
+  *            los pines de un LCD_t.
+  *
+  * LIMITACIONES:
+  	  * Los tiempos son aproximados: una funcion del firmware cuesta
+  	    SIM_CALL_CYCLES + SIM_RET_CYCLES, el codigo entre llamadas no cuesta.
+  	  * Timers: solo cuenta ascendente, sin modo esclavo ni captura.
+  	  * ADC: sin modo multiple (INIT_ADC_CAPTURE), sin overrun ni watchdog.
+  	  * DMA: sin FIFO, rafagas ni doble buffer.
+**********/
+
+/*------------------------------------------------------------------------------
+LIBRERIAS:
+------------------------------------------------------------------------------*/
+#include "sim.h"
+#include <stdlib.h>
+#include <setjmp.h>
+#include <sys/mman.h>
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+/*------------------------------------------------------------------------------
+DECLARACION DE FUNCIONES INTERNAS:
+------------------------------------------------------------------------------*/
+//Reloj:
+void P_SIM_Step(void);
+void P_SIM_Update(void);
+void P_SIM_Events(void);
+uint64_t P_SIM_NextEvent(void);
+void P_SIM_End(SIM_END_t End);
+
+//Memoria:
+void P_SIM_Map(uintptr_t Base, size_t Size);
+void P_SIM_Reset(void);
+uint32_t P_SIM_Read(uint32_t Addr, uint8_t Size);
+void P_SIM_Write(uint32_t Addr, uint8_t Size, uint32_t Value);
+
+//NVIC:
+void P_SIM_Nvic(void);
+void P_SIM_Reflect(void);
+void P_SIM_Lines(void);
+void P_SIM_Line(IRQn_Type IRQ);
+uint8_t P_SIM_Preempt(uint8_t Exc);
+int16_t P_SIM_Running(uint8_t Primask);
+uint8_t P_SIM_Best(uint8_t Primask);
+void P_SIM_Dispatch(void);
+
+//DWT y SysTick:
+void P_SIM_Cyccnt(void);
+void P_SIM_SystickRegs(void);
+void P_SIM_Systick(uint64_t Cycles);
+uint64_t P_SIM_SystickNext(void);
+
+//GPIO y EXTI:
+void P_SIM_Pins(void);
+uint16_t P_SIM_Idr(uint8_t Port);
+uint8_t P_SIM_AfLevel(uint8_t Port, uint8_t Pin, uint8_t Af);
+void P_SIM_ExtiRegs(void);
+void P_SIM_Exti(void);
+
+//TIM:
+void P_SIM_TimRegs(uint8_t i);
+void P_SIM_TimAdvance(uint8_t i, uint64_t Cycles);
+uint64_t P_SIM_TimNext(uint8_t i);
+uint64_t P_SIM_TimTicks(uint8_t i, uint32_t Cnt);
+uint32_t P_SIM_TimCycles(uint8_t i);
+uint32_t P_SIM_TimMax(uint8_t i);
+uint32_t P_SIM_TimArr(uint8_t i);
+uint8_t P_SIM_TimMode(uint8_t i, uint8_t Ch);
+void P_SIM_TimUpdate(uint8_t i);
+void P_SIM_TimCompare(uint8_t i, uint8_t Ch);
+void P_SIM_TimTrgo(uint8_t i, uint8_t Event);
+uint8_t P_SIM_TimOutput(uint8_t i, uint8_t Ch);
+
+//ADC:
+void P_SIM_AdcRegs(uint8_t a);
+void P_SIM_AdcTrigger(uint8_t Source);
+void P_SIM_AdcStart(uint8_t a);
+void P_SIM_AdcEnd(uint8_t a);
+void P_SIM_AdcInjected(uint8_t a);
+uint8_t P_SIM_AdcChannel(uint8_t a, uint8_t Rank);
+uint16_t P_SIM_AdcValue(uint8_t a, uint8_t Ch);
+uint32_t P_SIM_AdcCycles(uint8_t a, uint8_t Ch);
+
+//DMA:
+DMA_Stream_TypeDef* P_SIM_DmaStream(uint8_t d, uint8_t s);
+void P_SIM_DmaRegs(uint8_t d);
+uint8_t P_SIM_DmaRequest(uint32_t Periph, uint8_t Event);
+void P_SIM_DmaItem(uint8_t d, uint8_t s);
+void P_SIM_DmaFlag(uint8_t d, uint8_t s, uint32_t Flag);
+
+//LCD:
+void P_SIM_LcdBus(void);
+uint8_t P_SIM_LcdLevel(TLCD_NAME_t Pin);
+void P_SIM_LcdLatch(uint8_t c);
+void P_SIM_LcdByte(uint8_t c, uint8_t Rs, uint8_t Byte);
+uint8_t P_SIM_LcdIndex(uint8_t c, uint8_t Address);
+uint8_t P_SIM_LcdNext(uint8_t c, uint8_t Address);
+
+/*------------------------------------------------------------------------------
+VARIABLES INTERNAS:
+------------------------------------------------------------------------------*/
+//Reloj - Ciclos desde SIM_INIT, hasta donde avanzaron los perifericos, su proximo evento y el fin de la corrida:
+static uint64_t SIM_Now = 0;
+static uint64_t SIM_Synced = 0;
+static uint64_t SIM_Next = UINT64_MAX;
+static uint64_t SIM_Limit = UINT64_MAX;
+static uint8_t SIM_Ready = 0;
+static uint8_t SIM_Busy = 0;
+#define SIM_US(us) ((uint64_t) (us) * (SIM_HCLK / 1000000))
+#define SIM_NS(ns) ((uint64_t) (ns) * (SIM_HCLK / 1000000) / 1000)
+
+//Corrida - Salida de SIM_RUN desde cualquier profundidad de interrupciones:
+static jmp_buf SIM_Exit;
+static uint8_t SIM_Running = 0;
+
+//Eventos - Funciones programadas con SIM_AT:
+static uint64_t SIM_EventAt[SIM_EVENTS];
+static void (*SIM_EventFunc[SIM_EVENTS])(void);
+
+//Memoria - Regiones mapeadas: perifericos (con el alias de bit-band) y perifericos del nucleo:
+#define SIM_PERIPH_SIZE 0x20000000
+#define SIM_CORE_BASE   0xE0000000
+#define SIM_CORE_SIZE   0x00100000
+static uint8_t SIM_Mapped = 0;
+
+//CPU - PRIMASK, FAULTMASK y BASEPRI, excepciones activas (la ultima es la que corre) y monitor exclusivo:
+#define SIM_EXC (16 + 96)
+static uint32_t SIM_Mask[3];
+static uint8_t SIM_Stack[SIM_EXC];
+static uint8_t SIM_Depth = 0;
+static uint8_t SIM_ActiveExc[SIM_EXC];
+static uint32_t SIM_Taken = 0;
+volatile uint8_t SIM_Exclusive = 0;
+
+//NVIC - Interrupciones habilitadas, pendientes y nivel de sus lineas (bit = IRQn):
+static uint32_t SIM_Enabled[3];
+static uint32_t SIM_Pending[3];
+static uint32_t SIM_LineLevel[3];
+static uint8_t SIM_PendSV = 0;
+static uint8_t SIM_PendST = 0;
+
+//NVIC - Tabla de vectores: los handlers que no define el firmware quedan en NULL:
+#define SIM_IRQ_LIST(X) \
+	X(WWDG) X(PVD) X(TAMP_STAMP) X(RTC_WKUP) X(FLASH) X(RCC) X(EXTI0) X(EXTI1) X(EXTI2) X(EXTI3) X(EXTI4) \
+	X(DMA1_Stream0) X(DMA1_Stream1) X(DMA1_Stream2) X(DMA1_Stream3) X(DMA1_Stream4) X(DMA1_Stream5) \
+	X(DMA1_Stream6) X(ADC) X(CAN1_TX) X(CAN1_RX0) X(CAN1_RX1) X(CAN1_SCE) X(EXTI9_5) X(TIM1_BRK_TIM9) \
+	X(TIM1_UP_TIM10) X(TIM1_TRG_COM_TIM11) X(TIM1_CC) X(TIM2) X(TIM3) X(TIM4) X(I2C1_EV) X(I2C1_ER) \
+	X(I2C2_EV) X(I2C2_ER) X(SPI1) X(SPI2) X(USART1) X(USART2) X(USART3) X(EXTI15_10) X(RTC_Alarm) \
+	X(OTG_FS_WKUP) X(TIM8_BRK_TIM12) X(TIM8_UP_TIM13) X(TIM8_TRG_COM_TIM14) X(TIM8_CC) X(DMA1_Stream7) \
+	X(FMC) X(SDIO) X(TIM5) X(SPI3) X(UART4) X(UART5) X(TIM6_DAC) X(TIM7) X(DMA2_Stream0) X(DMA2_Stream1) \
+	X(DMA2_Stream2) X(DMA2_Stream3) X(DMA2_Stream4) X(ETH) X(ETH_WKUP) X(CAN2_TX) X(CAN2_RX0) X(CAN2_RX1) \
+	X(CAN2_SCE) X(OTG_FS) X(DMA2_Stream5) X(DMA2_Stream6) X(DMA2_Stream7) X(USART6) X(I2C3_EV) X(I2C3_ER) \
+	X(OTG_HS_EP1_OUT) X(OTG_HS_EP1_IN) X(OTG_HS_WKUP) X(OTG_HS) X(DCMI) X(CRYP) X(HASH_RNG) X(FPU) \
+	X(UART7) X(UART8) X(SPI4) X(SPI5) X(SPI6) X(SAI1) X(LTDC) X(LTDC_ER) X(DMA2D)
+#define SIM_WEAK(Name)   void Name##_IRQHandler(void) __attribute__((weak));
+#define SIM_VECTOR(Name) [16 + Name##_IRQn] = Name##_IRQHandler,
+void PendSV_Handler(void) __attribute__((weak));
+void SysTick_Handler(void) __attribute__((weak));
+SIM_IRQ_LIST(SIM_WEAK)
+static void (* const SIM_Vector[SIM_EXC])(void) = {
+		[14] = PendSV_Handler,
+		[15] = SysTick_Handler,
+		SIM_IRQ_LIST(SIM_VECTOR) };
+
+//DWT - CYCCNT: valor y ciclo desde el que cuenta, y ultimo valor escrito en el registro:
+static uint32_t SIM_CycValue = 0;
+static uint64_t SIM_CycAt = 0;
+static uint32_t SIM_CycLast = 0;
+
+//SysTick - Cuenta actual, ultimo valor escrito en VAL y ciclos sin llegar a un paso:
+static uint32_t SIM_StVal = 0;
+static uint32_t SIM_StLast = 0;
+static uint64_t SIM_StAcc = 0;
+
+//GPIO - Puertos, entradas externas (SIM_INPUT), ultimo ODR visto e IDR calculado:
+#define SIM_PORTS 11
+static GPIO_TypeDef* const SIM_Gpio[SIM_PORTS] = { GPIOA, GPIOB, GPIOC, GPIOD, GPIOE, GPIOF, GPIOG, GPIOH, GPIOI, GPIOJ, GPIOK };
+static uint16_t SIM_InMask[SIM_PORTS];
+static uint16_t SIM_InLevel[SIM_PORTS];
+static uint16_t SIM_Odr[SIM_PORTS];
+static uint16_t SIM_Idr[SIM_PORTS];
+static void (*SIM_OnOutput)(void) = NULL;
+static uint32_t SIM_GpioWrites = 0;
+
+//GPIO - Pines con salida de un timer: puerto (A = 0), pin, funcion alternativa, timer y canal (0...3):
+typedef struct {
+	uint8_t Port;
+	uint8_t Pin;
+	uint8_t Af;
+	uint8_t Tim;
+	uint8_t Ch;
+}SIM_AF_t;
+static const SIM_AF_t SIM_AfTable[] = {
+		{ 0,  8, 1, 1, 0 }, { 0,  9, 1, 1, 1 }, { 0, 10, 1, 1, 2 }, { 0, 11, 1, 1, 3 },
+		{ 4,  9, 1, 1, 0 }, { 4, 11, 1, 1, 1 }, { 4, 13, 1, 1, 2 }, { 4, 14, 1, 1, 3 },
+		{ 0,  0, 1, 2, 0 }, { 0,  5, 1, 2, 0 }, { 0, 15, 1, 2, 0 }, { 0,  1, 1, 2, 1 },
+		{ 1,  3, 1, 2, 1 }, { 0,  2, 1, 2, 2 }, { 1, 10, 1, 2, 2 }, { 0,  3, 1, 2, 3 }, { 1, 11, 1, 2, 3 },
+		{ 0,  6, 2, 3, 0 }, { 1,  4, 2, 3, 0 }, { 2,  6, 2, 3, 0 }, { 0,  7, 2, 3, 1 }, { 1,  5, 2, 3, 1 },
+		{ 2,  7, 2, 3, 1 }, { 1,  0, 2, 3, 2 }, { 2,  8, 2, 3, 2 }, { 1,  1, 2, 3, 3 }, { 2,  9, 2, 3, 3 },
+		{ 1,  6, 2, 4, 0 }, { 1,  7, 2, 4, 1 }, { 1,  8, 2, 4, 2 }, { 1,  9, 2, 4, 3 },
+		{ 3, 12, 2, 4, 0 }, { 3, 13, 2, 4, 1 }, { 3, 14, 2, 4, 2 }, { 3, 15, 2, 4, 3 },
+		{ 0,  0, 2, 5, 0 }, { 0,  1, 2, 5, 1 }, { 0,  2, 2, 5, 2 }, { 0,  3, 2, 5, 3 },
+		{ 7, 10, 2, 5, 0 }, { 7, 11, 2, 5, 1 }, { 7, 12, 2, 5, 2 }, { 8,  0, 2, 5, 3 },
+		{ 2,  6, 3, 8, 0 }, { 2,  7, 3, 8, 1 }, { 2,  8, 3, 8, 2 }, { 2,  9, 3, 8, 3 },
+		{ 8,  5, 3, 8, 0 }, { 8,  6, 3, 8, 1 }, { 8,  7, 3, 8, 2 }, { 8,  2, 3, 8, 3 },
+		{ 0,  2, 3, 9, 0 }, { 0,  3, 3, 9, 1 }, { 4,  5, 3, 9, 0 }, { 4,  6, 3, 9, 1 } };
+
+//EXTI - Pendientes y nivel de las lineas 0...15. El bit 31 de EXTI->PR marca lo escrito por el simulador:
+#define SIM_EXTI_MARK 0x80000000
+static uint32_t SIM_ExtiPr = 0;
+static uint32_t SIM_ExtiLevel = 0;
+
+//TIM - Timers 1...14: bus, ancho, canales e interrupciones (update y comparacion):
+#define SIM_TIMS 14
+typedef struct {
+	TIM_TypeDef* TIM;
+	uint8_t Apb2;
+	uint8_t Bits32;
+	uint8_t Channels;
+	IRQn_Type IrqUp;
+	IRQn_Type IrqCc;
+}SIM_TIM_DEF_t;
+static const SIM_TIM_DEF_t SIM_TimDef[SIM_TIMS] = {
+		{ TIM1 , 1, 0, 4, TIM1_UP_TIM10_IRQn      , TIM1_CC_IRQn             },
+		{ TIM2 , 0, 1, 4, TIM2_IRQn               , TIM2_IRQn                },
+		{ TIM3 , 0, 0, 4, TIM3_IRQn               , TIM3_IRQn                },
+		{ TIM4 , 0, 0, 4, TIM4_IRQn               , TIM4_IRQn                },
+		{ TIM5 , 0, 1, 4, TIM5_IRQn               , TIM5_IRQn                },
+		{ TIM6 , 0, 0, 0, TIM6_DAC_IRQn           , TIM6_DAC_IRQn            },
+		{ TIM7 , 0, 0, 0, TIM7_IRQn               , TIM7_IRQn                },
+		{ TIM8 , 1, 0, 4, TIM8_UP_TIM13_IRQn      , TIM8_CC_IRQn             },
+		{ TIM9 , 1, 0, 2, TIM1_BRK_TIM9_IRQn      , TIM1_BRK_TIM9_IRQn       },
+		{ TIM10, 1, 0, 1, TIM1_UP_TIM10_IRQn      , TIM1_UP_TIM10_IRQn       },
+		{ TIM11, 1, 0, 1, TIM1_TRG_COM_TIM11_IRQn , TIM1_TRG_COM_TIM11_IRQn  },
+		{ TIM12, 0, 0, 2, TIM8_BRK_TIM12_IRQn     , TIM8_BRK_TIM12_IRQn      },
+		{ TIM13, 0, 0, 1, TIM8_UP_TIM13_IRQn      , TIM8_UP_TIM13_IRQn       },
+		{ TIM14, 0, 0, 1, TIM8_TRG_COM_TIM14_IRQn , TIM8_TRG_COM_TIM14_IRQn  } };
+
+//TIM - Estado: ciclos sin llegar a un paso, registros con precarga, flags y OCxREF:
+typedef struct {
+	uint64_t Acc;
+	uint32_t Arr;
+	uint32_t Psc;
+	uint16_t Sr;
+	uint8_t Ref[4];
+}SIM_TIM_t;
+static SIM_TIM_t SIM_Tim[SIM_TIMS];
+
+//TIM - Eventos de un timer (para el ADC y el DMA): update, comparacion del canal 1...4 y TRGO:
+#define SIM_EV_UPDATE 0
+#define SIM_EV_TRGO   5
+#define SIM_TRIG(Tim, Event) ((Tim) << 4 | (Event))
+
+//ADC - Disparos externos por EXTSEL y JEXTSEL (timer 0 = linea del EXTI):
+static ADC_TypeDef* const SIM_Adc[3] = { ADC1, ADC2, ADC3 };
+static const uint8_t SIM_AdcRegular[16] = {
+		SIM_TRIG(1, 1), SIM_TRIG(1, 2), SIM_TRIG(1, 3), SIM_TRIG(2, 2), SIM_TRIG(2, 3), SIM_TRIG(2, 4),
+		SIM_TRIG(2, SIM_EV_TRGO), SIM_TRIG(3, 1), SIM_TRIG(3, SIM_EV_TRGO), SIM_TRIG(4, 4), SIM_TRIG(5, 1),
+		SIM_TRIG(5, 2), SIM_TRIG(5, 3), SIM_TRIG(8, 1), SIM_TRIG(8, SIM_EV_TRGO), SIM_TRIG(0, 11) };
+static const uint8_t SIM_AdcInjected[16] = {
+		SIM_TRIG(1, 4), SIM_TRIG(1, SIM_EV_TRGO), SIM_TRIG(2, 1), SIM_TRIG(2, SIM_EV_TRGO), SIM_TRIG(3, 2),
+		SIM_TRIG(3, 4), SIM_TRIG(4, 1), SIM_TRIG(4, 2), SIM_TRIG(4, 3), SIM_TRIG(4, SIM_EV_TRGO),
+		SIM_TRIG(5, 4), SIM_TRIG(5, SIM_EV_TRGO), SIM_TRIG(8, 2), SIM_TRIG(8, 3), SIM_TRIG(8, 4), SIM_TRIG(0, 15) };
+static const uint16_t SIM_AdcSample[8] = { 3, 15, 28, 56, 84, 112, 144, 480 };
+
+//ADC - Flags, fin de la conversion en curso (0 = libre) y lugar en la secuencia:
+static uint16_t SIM_AdcSr[3];
+static uint64_t SIM_AdcDone[3];
+static uint8_t SIM_AdcRank[3];
+static uint16_t (*SIM_Analog)(ADC_TypeDef*, uint8_t) = NULL;
+
+//DMA - Pedidos de los perifericos: periferico, evento, DMA (0 = DMA1), stream y canal:
+typedef struct {
+	uint32_t Periph;
+	uint8_t Event;
+	uint8_t Dma;
+	uint8_t Stream;
+	uint8_t Channel;
+}SIM_DMA_REQ_t;
+static const SIM_DMA_REQ_t SIM_DmaReq[] = {
+		{ ADC1_BASE, 0, 1, 0, 0 }, { ADC1_BASE, 0, 1, 4, 0 }, { ADC2_BASE, 0, 1, 2, 1 }, { ADC2_BASE, 0, 1, 3, 1 },
+		{ ADC3_BASE, 0, 1, 0, 2 }, { ADC3_BASE, 0, 1, 1, 2 },
+		{ TIM1_BASE, 0, 1, 5, 6 }, { TIM1_BASE, 1, 1, 1, 6 }, { TIM1_BASE, 1, 1, 3, 6 }, { TIM1_BASE, 1, 1, 6, 0 },
+		{ TIM1_BASE, 2, 1, 2, 6 }, { TIM1_BASE, 2, 1, 6, 0 }, { TIM1_BASE, 3, 1, 6, 6 }, { TIM1_BASE, 3, 1, 6, 0 },
+		{ TIM1_BASE, 4, 1, 4, 6 },
+		{ TIM8_BASE, 0, 1, 1, 7 }, { TIM8_BASE, 1, 1, 2, 7 }, { TIM8_BASE, 1, 1, 2, 0 }, { TIM8_BASE, 2, 1, 3, 7 },
+		{ TIM8_BASE, 2, 1, 2, 0 }, { TIM8_BASE, 3, 1, 4, 7 }, { TIM8_BASE, 3, 1, 2, 0 }, { TIM8_BASE, 4, 1, 7, 7 },
+		{ TIM2_BASE, 0, 0, 1, 3 }, { TIM2_BASE, 0, 0, 7, 3 }, { TIM2_BASE, 1, 0, 5, 3 }, { TIM2_BASE, 2, 0, 6, 3 },
+		{ TIM2_BASE, 3, 0, 1, 3 }, { TIM2_BASE, 4, 0, 6, 3 }, { TIM2_BASE, 4, 0, 7, 3 },
+		{ TIM3_BASE, 0, 0, 2, 5 }, { TIM3_BASE, 1, 0, 4, 5 }, { TIM3_BASE, 2, 0, 5, 5 }, { TIM3_BASE, 3, 0, 7, 5 },
+		{ TIM3_BASE, 4, 0, 2, 5 },
+		{ TIM4_BASE, 0, 0, 6, 2 }, { TIM4_BASE, 1, 0, 0, 2 }, { TIM4_BASE, 2, 0, 3, 2 }, { TIM4_BASE, 3, 0, 7, 2 },
+		{ TIM5_BASE, 0, 0, 0, 6 }, { TIM5_BASE, 0, 0, 6, 6 }, { TIM5_BASE, 1, 0, 2, 6 }, { TIM5_BASE, 2, 0, 4, 6 },
+		{ TIM5_BASE, 3, 0, 0, 6 }, { TIM5_BASE, 4, 0, 1, 6 }, { TIM5_BASE, 4, 0, 3, 6 },
+		{ TIM6_BASE, 0, 0, 1, 7 }, { TIM7_BASE, 0, 0, 2, 1 }, { TIM7_BASE, 0, 0, 4, 1 } };
+
+//DMA - Interrupcion de cada stream y lugar de sus flags en LISR/HISR:
+static const IRQn_Type SIM_DmaIrq[2][8] = {
+		{ DMA1_Stream0_IRQn, DMA1_Stream1_IRQn, DMA1_Stream2_IRQn, DMA1_Stream3_IRQn,
+		  DMA1_Stream4_IRQn, DMA1_Stream5_IRQn, DMA1_Stream6_IRQn, DMA1_Stream7_IRQn },
+		{ DMA2_Stream0_IRQn, DMA2_Stream1_IRQn, DMA2_Stream2_IRQn, DMA2_Stream3_IRQn,
+		  DMA2_Stream4_IRQn, DMA2_Stream5_IRQn, DMA2_Stream6_IRQn, DMA2_Stream7_IRQn } };
+static const uint8_t SIM_DmaShift[4] = { 0, 6, 16, 22 };
+#define SIM_DMA_FE 0x01
+#define SIM_DMA_DME 0x04
+#define SIM_DMA_TE 0x08
+#define SIM_DMA_HT 0x10
+#define SIM_DMA_TC 0x20
+
+//DMA - Estado de cada stream: datos a transferir (NDTR al habilitar), transferidos y habilitado:
+typedef struct {
+	uint16_t Total;
+	uint16_t Pos;
+	uint8_t On;
+}SIM_DMA_t;
+static SIM_DMA_t SIM_Dma[2][8];
+static uint32_t SIM_DmaIsr[2][2];
+
+//LCD - HD44780 (uno por pin de E): memoria, contador de direcciones, modo y tiempos:
+typedef struct {
+	uint8_t Ddram[80];
+	uint8_t Cgram[64];
+	uint8_t Ac;
+	uint8_t Cg;
+	uint8_t Inc;
+	uint8_t Bus8;
+	uint8_t Lines2;
+	uint8_t On;
+	uint8_t Half;
+	uint8_t High;
+	uint8_t Inits;
+	uint8_t E;
+	uint64_t Rise;
+	uint64_t Busy;
+}SIM_HD44780_t;
+static LCD_t* SIM_LcdLCD = NULL;
+static SIM_HD44780_t SIM_Hd[2];
+static SIM_LCD_STATS_t SIM_LcdStats;
+
+/*****************************************************************************
+SIM_INIT
+
+	* @author	A. Riedinger.
+	* @brief	Enciende el micro simulado: mapea los registros en sus
+				direcciones, los deja con sus valores de reset y pone el reloj
+				en 0. Se puede llamar de nuevo para otra corrida desde cero.
+	* @returns	void
+	* @ej
+		- SIM_INIT();
+******************************************************************************/
+void SIM_INIT(void)
+{
+	P_SIM_Map(PERIPH_BASE, SIM_PERIPH_SIZE);
+	P_SIM_Map(SIM_CORE_BASE, SIM_CORE_SIZE);
+	SIM_Mapped = 1;
+
+	P_SIM_Reset();
+	SIM_Ready = 1;
+	SIM_Next = P_SIM_NextEvent();
+}
+
+
+
+/*****************************************************************************
+SIM_RUN
+
+	* @author	A. Riedinger.
+	* @brief	Corre una funcion del firmware (por ejemplo el main) durante un
+				tiempo virtual. Si no termina antes, se corta al cumplirse el
+				tiempo, aunque este dentro de una interrupcion.
+	* @returns
+		- SIM_END_TIME		Se cumplio el tiempo.
+		- SIM_END_RETURN	La funcion termino antes.
+		- SIM_END_IDLE		WFI sin ningun evento que pueda despertar al micro.
+		- SIM_END_FAULT		Interrupcion habilitada sin handler.
+	* @param
+		- Func		Funcion a correr.
+		- Ms		Tiempo maximo [mseg].
+	* @ej
+		- SIM_RUN(firmware_main, 10000);
+******************************************************************************/
+SIM_END_t SIM_RUN(int (*Func)(void), uint32_t Ms)
+{
+	int End;
+
+	SIM_Limit = SIM_Now + (uint64_t) Ms * (SIM_HCLK / 1000);
+	SIM_Running = 1;
+
+	End = setjmp(SIM_Exit);
+	if (End == 0) {
+		Func();
+		End = SIM_END_RETURN + 1;
+	}
+
+	//Lo que quedo a medio atender se descarta:
+	SIM_Running = 0;
+	SIM_Limit = UINT64_MAX;
+	SIM_Depth = 0;
+	memset(SIM_ActiveExc, 0, sizeof(SIM_ActiveExc));
+	memset(SIM_Mask, 0, sizeof(SIM_Mask));
+	SIM_Busy = 0;
+	P_SIM_Reflect();
+
+	return (SIM_END_t) (End - 1);
+}
+
+
+
+/*****************************************************************************
+SIM_CYCLES
+
+	* @author	A. Riedinger.
+	* @brief	Tiempo virtual desde SIM_INIT.
+	* @returns
+		- Cycles	Ciclos de CPU (SIM_HCLK por segundo).
+	* @ej
+		- Seg = SIM_CYCLES() / SIM_HCLK;
+******************************************************************************/
+uint64_t SIM_CYCLES(void)
+{
+	return SIM_Now;
+}
+
+
+
+/*****************************************************************************
+SIM_AT
+
+	* @author	A. Riedinger.
+	* @brief	Programa una funcion del entorno (no del firmware) para un
+				instante virtual, por ejemplo un cambio de una entrada. Corre
+				fuera de las interrupciones, antes de actualizar los perifericos.
+	* @returns
+		- 1		Programada.
+		- 0		Ya hay SIM_EVENTS funciones programadas.
+	* @param
+		- At		Instante [ciclos desde SIM_INIT].
+		- Func		Funcion.
+	* @ej
+		- SIM_AT(SIM_CYCLES() + SIM_HCLK / 10, PRESS); //Dentro de 100 mseg.
+******************************************************************************/
+uint8_t SIM_AT(uint64_t At, void (*Func)(void))
+{
+	uint8_t i;
+
+	for (i = 0; i < SIM_EVENTS; i++)
+		if (SIM_EventFunc[i] == NULL) {
+			SIM_EventAt[i] = At;
+			SIM_EventFunc[i] = Func;
+			if (At < SIM_Next)
+				SIM_Next = At;
+			return 1;
+		}
+
+	return 0;
+}
+
+
+
+/*****************************************************************************
+SIM_INPUT
+
+	* @author	A. Riedinger.
+	* @brief	Fija el nivel externo de pines de entrada (sin senal externa
+				un pin de entrada lee su pull-up/pull-down). Vale desde la
+				proxima actualizacion de los perifericos.
+	* @returns	void
+	* @param
+		- Port		Puerto. Ej: GPIOX.
+		- Pins		Pines. Ej: GPIO_Pin_X | GPIO_Pin_Y.
+		- Levels	Nivel de cada pin (mismos bits que Pins).
+	* @ej
+		- SIM_INPUT(GPIOC, GPIO_Pin_6, GPIO_Pin_6); //PC6 en 1.
+******************************************************************************/
+void SIM_INPUT(GPIO_TypeDef* Port, uint16_t Pins, uint16_t Levels)
+{
+	uint8_t p;
+
+	for (p = 0; p < SIM_PORTS; p++)
+		if (SIM_Gpio[p] == Port) {
+			SIM_InMask[p] |= Pins;
+			SIM_InLevel[p] = (SIM_InLevel[p] & ~Pins) | (Levels & Pins);
+		}
+}
+
+
+
+/*****************************************************************************
+SIM_ON_OUTPUT
+
+	* @author	A. Riedinger.
+	* @brief	Funcion del entorno que se llama cada vez que cambia una salida
+				digital (ODR), por ejemplo el modelo de un teclado matricial.
+				Las entradas que fije con SIM_INPUT valen en el mismo instante.
+	* @returns	void
+	* @param
+		- Func		Funcion (NULL = ninguna).
+	* @ej
+		- SIM_ON_OUTPUT(KEYPAD);
+******************************************************************************/
+void SIM_ON_OUTPUT(void (*Func)(void))
+{
+	SIM_OnOutput = Func;
+}
+
+
+
+/*****************************************************************************
+SIM_ANALOG
+
+	* @author	A. Riedinger.
+	* @brief	Funcion del entorno que da la tension de las entradas analogicas,
+				se llama al terminar cada conversion.
+	* @returns	void
+	* @param
+		- Func		Funcion (ADC, canal) -> cuentas de 12 bits (0...4095).
+	* @ej
+		- SIM_ANALOG(LM35);
+******************************************************************************/
+void SIM_ANALOG(uint16_t (*Func)(ADC_TypeDef*, uint8_t))
+{
+	SIM_Analog = Func;
+}
+
+
+
+/*****************************************************************************
+SIM_LCD
+
+	* @author	A. Riedinger.
+	* @brief	Conecta un HD44780 a los pines de un LCD_t (dos si tiene
+				TLCD_E2). El display arranca como al encenderlo (bus de 8 bits,
+				DDRAM en blanco) y cuenta los errores de tiempos del bus.
+	* @returns	void
+	* @param
+		- LCD		Display del firmware, antes de INIT_LCD.
+	* @ej
+		- SIM_LCD(&LCD);
+******************************************************************************/
+void SIM_LCD(LCD_t* LCD)
+{
+	uint8_t c;
+
+	SIM_LcdLCD = LCD;
+	memset(SIM_Hd, 0, sizeof(SIM_Hd));
+	memset(&SIM_LcdStats, 0, sizeof(SIM_LcdStats));
+	for (c = 0; c < 2; c++) {
+		memset(SIM_Hd[c].Ddram, ' ', sizeof(SIM_Hd[c].Ddram));
+		SIM_Hd[c].Inc = 1;
+		SIM_Hd[c].Bus8 = 1;
+	}
+}
+
+
+
+/*****************************************************************************
+SIM_LCD_ROW
+
+	* @author	A. Riedinger.
+	* @brief	Texto de una fila del display simulado, con las mismas
+				direcciones que usa el driver. Los caracteres de la CGRAM y el
+				bloque lleno se ven como '#', el resto fuera de ASCII como '?'.
+	* @returns
+		- Cols		Caracteres copiados (0 = fila inexistente).
+	* @param
+		- Row		Fila (0...TLCD_ROWS - 1).
+		- Text		Destino, TLCD_COLS + 1 caracteres.
+	* @ej
+		- SIM_LCD_ROW(0, Text);
+******************************************************************************/
+uint8_t SIM_LCD_ROW(uint8_t Row, char* Text)
+{
+	LCD_t* LCD = SIM_LcdLCD;
+	uint8_t c = 0, Base, x, Ch;
+
+	if (LCD == NULL || Row >= LCD->TLCD_ROWS)
+		return 0;
+
+	if (LCD->Port[TLCD_E2] != NULL && Row >= 2) {
+		c = 1;
+		Row -= 2;
+	}
+	Base = ((Row & 1) << 6) + ((Row & 2) ? LCD->TLCD_COLS : 0);
+
+	for (x = 0; x < LCD->TLCD_COLS; x++) {
+		Ch = SIM_Hd[c].Ddram[P_SIM_LcdIndex(c, Base + x)];
+		if (Ch >= 0x20 && Ch < 0x7F)
+			Text[x] = Ch;
+		else if (Ch < 0x10 || Ch == TLCD_CHAR_FULL)
+			Text[x] = '#';
+		else
+			Text[x] = '?';
+	}
+	Text[x] = 0;
+
+	return x;
+}
+
+
+
+/*****************************************************************************
+SIM_LCD_STATS
+
+	* @author	A. Riedinger.
+	* @brief	Contadores del display simulado desde SIM_LCD.
+	* @returns	void
+	* @param
+		- Stats		Destino.
+	* @ej
+		- SIM_LCD_STATS(&Stats);
+******************************************************************************/
+void SIM_LCD_STATS(SIM_LCD_STATS_t* Stats)
+{
+	*Stats = SIM_LcdStats;
+}
+
+
+
+
+/*****************************************************************************
+SIM_GPIO_WRITES
+
+	* @author	A. Riedinger.
+	* @brief	Escrituras a los BSRR de todos los puertos desde SIM_INIT, para
+				comparar con lo que cuenta el firmware (BUS_OPS_LCD_2x16). Dos
+				escrituras al mismo puerto sin una llamada a funcion en el medio
+				cuentan como una.
+	* @returns
+		- Writes	Escrituras.
+	* @ej
+		- Ops = SIM_GPIO_WRITES() - Start;
+******************************************************************************/
+uint32_t SIM_GPIO_WRITES(void)
+{
+	return SIM_GpioWrites;
+}
+
+/*------------------------------------------------------------------------------
+PUNTOS DE ENTRADA DEL FIRMWARE:
+------------------------------------------------------------------------------*/
+//Hooks de -finstrument-functions: entrada y salida de cada funcion del firmware:
+void __cyg_profile_func_enter(void* Func, void* Site)
+{
+	SIM_Now += SIM_CALL_CYCLES;
+	P_SIM_Step();
+}
+
+void __cyg_profile_func_exit(void* Func, void* Site)
+{
+	SIM_Now += SIM_RET_CYCLES;
+	P_SIM_Step();
+}
+
+//DWT (macro DWT del stm32f4xx.h de host/include): solo se actualiza todo al llegar a un evento:
+DWT_Type* SIM_DWT(void)
+{
+	if (SIM_Ready && !SIM_Busy) {
+		SIM_Now += SIM_DWT_CYCLES;
+		if (SIM_Now >= SIM_Next || SIM_Now >= SIM_Limit)
+			P_SIM_Step();
+		else
+			P_SIM_Cyccnt();
+	}
+
+	return (DWT_Type*) DWT_BASE;
+}
+
+//WFI: el reloj salta al proximo evento hasta que haya una excepcion para atender (aun con PRIMASK):
+void SIM_WFI(void)
+{
+	uint32_t Taken = SIM_Taken;
+
+	SIM_Now++;
+	P_SIM_Step();
+	while (SIM_Taken == Taken && P_SIM_Best(0) == 0) {
+		if (SIM_Next == UINT64_MAX)
+			P_SIM_End(SIM_END_IDLE);
+		SIM_Now = (SIM_Next > SIM_Now) ? SIM_Next : SIM_Now + 1;
+		if (SIM_Now > SIM_Limit)
+			SIM_Now = SIM_Limit;
+		P_SIM_Step();
+	}
+}
+
+//Barreras (__DMB, __DSB, __ISB): punto donde puede entrar una interrupcion:
+void SIM_BARRIER(void)
+{
+	SIM_Now++;
+	P_SIM_Step();
+}
+
+//PRIMASK, FAULTMASK y BASEPRI: al desenmascarar entra lo pendiente:
+uint32_t SIM_GET_MASK(uint8_t Reg)
+{
+	return SIM_Mask[Reg];
+}
+
+void SIM_SET_MASK(uint8_t Reg, uint32_t Value)
+{
+	uint32_t Old = SIM_Mask[Reg];
+
+	SIM_Mask[Reg] = Value;
+	if (!SIM_Ready || SIM_Busy)
+		return;
+	if (Value == 0 || (Reg == SIM_BASEPRI && Old != 0 && Value > Old)) {
+		P_SIM_Update();
+		P_SIM_Dispatch();
+	}
+}
+
+uint32_t SIM_GET_IPSR(void)
+{
+	return SIM_Depth ? SIM_Stack[SIM_Depth - 1] : 0;
+}
+
+//Arranque (startup): el SystemInit original espera al PLL, aca el reloj ya queda en 180 MHz:
+void SystemInit(void)
+{
+	RCC->CR |= RCC_CR_HSEON | RCC_CR_HSERDY | RCC_CR_PLLON | RCC_CR_PLLRDY;
+	RCC->PLLCFGR = 4 | (180 << 6) | (((2 >> 1) - 1) << 16) | RCC_PLLCFGR_PLLSRC_HSE | (7 << 24);
+	RCC->CFGR = RCC_CFGR_SW_PLL | RCC_CFGR_SWS_PLL | RCC_CFGR_HPRE_DIV1 | RCC_CFGR_PPRE1_DIV4 | RCC_CFGR_PPRE2_DIV2;
+}
+
+/*------------------------------------------------------------------------------
+FUNCIONES INTERNAS:
+------------------------------------------------------------------------------*/
+//Reloj:
+//Eventos del entorno, lo escrito por el firmware, el tiempo transcurrido y las interrupciones:
+void P_SIM_Step(void)
+{
+	if (!SIM_Ready || SIM_Busy)
+		return;
+
+	P_SIM_Events();
+	P_SIM_Update();
+	P_SIM_Dispatch();
+
+	if (SIM_Now >= SIM_Limit)
+		P_SIM_End(SIM_END_TIME);
+}
+
+void P_SIM_Update(void)
+{
+	uint64_t Elapsed;
+	uint8_t i;
+
+	if (SIM_Busy)
+		return;
+	SIM_Busy = 1;
+
+	//Escrituras del firmware desde la ultima actualizacion:
+	P_SIM_Cyccnt();
+	P_SIM_Nvic();
+	P_SIM_SystickRegs();
+	P_SIM_ExtiRegs();
+	for (i = 0; i < SIM_TIMS; i++)
+		P_SIM_TimRegs(i);
+	for (i = 0; i < 2; i++)
+		P_SIM_DmaRegs(i);
+	for (i = 0; i < 3; i++)
+		P_SIM_AdcRegs(i);
+	P_SIM_Pins();
+
+	//Tiempo transcurrido (salvo en el WFI, a lo sumo un evento por periferico):
+	Elapsed = SIM_Now - SIM_Synced;
+	SIM_Synced = SIM_Now;
+	if (Elapsed) {
+		for (i = 0; i < SIM_TIMS; i++)
+			P_SIM_TimAdvance(i, Elapsed);
+		P_SIM_Systick(Elapsed);
+		for (i = 0; i < 3; i++)
+			while (SIM_AdcDone[i] != 0 && SIM_AdcDone[i] <= SIM_Now)
+				P_SIM_AdcEnd(i);
+		P_SIM_Pins();
+	}
+
+	P_SIM_Lines();
+	SIM_Next = P_SIM_NextEvent();
+	SIM_Busy = 0;
+}
+
+void P_SIM_Events(void)
+{
+	void (*Func)(void);
+	uint8_t i;
+
+	for (i = 0; i < SIM_EVENTS; i++)
+		if (SIM_EventFunc[i] != NULL && SIM_EventAt[i] <= SIM_Now) {
+			Func = SIM_EventFunc[i];
+			SIM_EventFunc[i] = NULL;
+			Func();
+		}
+}
+
+uint64_t P_SIM_NextEvent(void)
+{
+	uint64_t Next = P_SIM_SystickNext(), At;
+	uint8_t i;
+
+	for (i = 0; i < SIM_TIMS; i++)
+		if ((At = P_SIM_TimNext(i)) < Next)
+			Next = At;
+	for (i = 0; i < 3; i++)
+		if (SIM_AdcDone[i] != 0 && SIM_AdcDone[i] < Next)
+			Next = SIM_AdcDone[i];
+	for (i = 0; i < SIM_EVENTS; i++)
+		if (SIM_EventFunc[i] != NULL && SIM_EventAt[i] < Next)
+			Next = SIM_EventAt[i];
+
+	return Next;
+}
+
+//Fin de la corrida: vuelve a SIM_RUN, o termina el programa si no hay corrida:
+void P_SIM_End(SIM_END_t End)
+{
+	if (SIM_Running)
+		longjmp(SIM_Exit, End + 1);
+	if (End == SIM_END_TIME)
+		return;
+
+	fprintf(stderr, "sim: %s fuera de SIM_RUN\n", End == SIM_END_IDLE ? "WFI sin eventos" : "interrupcion sin handler");
+	exit(2);
+}
+
+//Memoria:
+void P_SIM_Map(uintptr_t Base, size_t Size)
+{
+	void* Addr;
+
+	if (SIM_Mapped)
+		munmap((void*) Base, Size);
+
+	Addr = mmap((void*) Base, Size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED_NOREPLACE, -1, 0);
+	if (Addr != (void*) Base) {
+		fprintf(stderr, "sim: no se pudo mapear 0x%08lX\n", (unsigned long) Base);
+		exit(2);
+	}
+}
+
+//Valores de reset (RM0090) de lo que el firmware lee antes de escribir, y estado del simulador:
+void P_SIM_Reset(void)
+{
+	uint8_t i;
+
+	SIM_Now = 0;
+	SIM_Synced = 0;
+	SIM_Limit = UINT64_MAX;
+	SIM_Busy = 0;
+	memset(SIM_EventFunc, 0, sizeof(SIM_EventFunc));
+	memset(SIM_Mask, 0, sizeof(SIM_Mask));
+	memset(SIM_ActiveExc, 0, sizeof(SIM_ActiveExc));
+	SIM_Depth = 0;
+	SIM_Exclusive = 0;
+	memset(SIM_Enabled, 0, sizeof(SIM_Enabled));
+	memset(SIM_Pending, 0, sizeof(SIM_Pending));
+	SIM_PendSV = 0;
+	SIM_PendST = 0;
+	SIM_CycValue = 0;
+	SIM_CycAt = 0;
+	SIM_CycLast = 0;
+	SIM_StVal = 0;
+	SIM_StLast = 0;
+	SIM_StAcc = 0;
+	memset(SIM_InMask, 0, sizeof(SIM_InMask));
+	memset(SIM_InLevel, 0, sizeof(SIM_InLevel));
+	memset(SIM_Odr, 0, sizeof(SIM_Odr));
+	memset(SIM_Idr, 0, sizeof(SIM_Idr));
+	SIM_OnOutput = NULL;
+	SIM_GpioWrites = 0;
+	SIM_ExtiPr = 0;
+	SIM_ExtiLevel = 0;
+	memset(SIM_Tim, 0, sizeof(SIM_Tim));
+	memset(SIM_AdcSr, 0, sizeof(SIM_AdcSr));
+	memset(SIM_AdcDone, 0, sizeof(SIM_AdcDone));
+	SIM_Analog = NULL;
+	memset(SIM_Dma, 0, sizeof(SIM_Dma));
+	memset(SIM_DmaIsr, 0, sizeof(SIM_DmaIsr));
+	SIM_LcdLCD = NULL;
+
+	//RCC: HSI encendido, HSE y PLL listos apenas se encienden:
+	RCC->CR = RCC_CR_HSION | RCC_CR_HSIRDY | (0x10 << 3) | RCC_CR_HSERDY | RCC_CR_PLLRDY;
+	RCC->PLLCFGR = 0x24003010;
+
+	//GPIO: PA13/PA14/PA15 y PB3/PB4 son del debugger:
+	GPIOA->MODER = 0xA8000000;
+	GPIOA->PUPDR = 0x64000000;
+	GPIOB->MODER = 0x00000280;
+	GPIOB->PUPDR = 0x00000100;
+	GPIOB->OSPEEDR = 0x000000C0;
+
+	for (i = 0; i < SIM_TIMS; i++) {
+		SIM_TimDef[i].TIM->ARR = P_SIM_TimMax(i);
+		SIM_Tim[i].Arr = P_SIM_TimMax(i);
+	}
+
+	DWT->CTRL = 0x40000000;
+	*(volatile uint32_t*) &SCB->CPUID = 0x410FC241;
+}
+
+uint32_t P_SIM_Read(uint32_t Addr, uint8_t Size)
+{
+	if (Size == 1)
+		return *(volatile uint8_t*) (uintptr_t) Addr;
+	if (Size == 2)
+		return *(volatile uint16_t*) (uintptr_t) Addr;
+	return *(volatile uint32_t*) (uintptr_t) Addr;
+}
+
+void P_SIM_Write(uint32_t Addr, uint8_t Size, uint32_t Value)
+{
+	if (Size == 1)
+		*(volatile uint8_t*) (uintptr_t) Addr = Value;
+	else if (Size == 2)
+		*(volatile uint16_t*) (uintptr_t) Addr = Value;
+	else
+		*(volatile uint32_t*) (uintptr_t) Addr = Value;
+}
+
+//NVIC:
+//ISER/ICER e ISPR/ICPR se escriben con 1 y se leen con el estado; ICSR pone y saca el PendSV y el SysTick:
+void P_SIM_Nvic(void)
+{
+	uint32_t Icsr = SCB->ICSR;
+	uint8_t w;
+
+	for (w = 0; w < 3; w++) {
+		SIM_Enabled[w] = (SIM_Enabled[w] | NVIC->ISER[w]) & ~NVIC->ICER[w];
+		SIM_Pending[w] = (SIM_Pending[w] | NVIC->ISPR[w]) & ~NVIC->ICPR[w];
+		NVIC->ICER[w] = 0;
+		NVIC->ICPR[w] = 0;
+	}
+
+	if (Icsr & SCB_ICSR_PENDSVSET_Msk)
+		SIM_PendSV = 1;
+	if (Icsr & SCB_ICSR_PENDSVCLR_Msk)
+		SIM_PendSV = 0;
+	if (Icsr & SCB_ICSR_PENDSTSET_Msk)
+		SIM_PendST = 1;
+	if (Icsr & SCB_ICSR_PENDSTCLR_Msk)
+		SIM_PendST = 0;
+
+	P_SIM_Reflect();
+}
+
+//Estado del NVIC en sus registros, para lo que lee el firmware:
+void P_SIM_Reflect(void)
+{
+	uint8_t w, Exc;
+
+	for (w = 0; w < 3; w++) {
+		NVIC->ISER[w] = SIM_Enabled[w];
+		NVIC->ISPR[w] = SIM_Pending[w];
+		NVIC->IABR[w] = 0;
+	}
+	for (Exc = 16; Exc < SIM_EXC; Exc++)
+		if (SIM_ActiveExc[Exc])
+			NVIC->IABR[(Exc - 16) >> 5] |= 1UL << ((Exc - 16) & 31);
+
+	SCB->ICSR = (SIM_PendSV ? SCB_ICSR_PENDSVSET_Msk : 0) | (SIM_PendST ? SCB_ICSR_PENDSTSET_Msk : 0) |
+			SIM_GET_IPSR();
+}
+
+//Lineas de interrupcion por nivel: quedan pendientes mientras esten arriba y no esten activas:
+void P_SIM_Lines(void)
+{
+	DMA_Stream_TypeDef* Stream;
+	TIM_TypeDef* TIMx;
+	uint32_t Flags, Cr;
+	uint8_t i, s, w, Line;
+
+	memset(SIM_LineLevel, 0, sizeof(SIM_LineLevel));
+
+	//EXTI:
+	Flags = SIM_ExtiPr & EXTI->IMR;
+	for (Line = 0; Line < 5; Line++)
+		if (Flags & (1 << Line))
+			P_SIM_Line(EXTI0_IRQn + Line);
+	if (Flags & 0x03E0)
+		P_SIM_Line(EXTI9_5_IRQn);
+	if (Flags & 0xFC00)
+		P_SIM_Line(EXTI15_10_IRQn);
+
+	//Timers (TIF con el update, BIF/COMIF no se generan):
+	for (i = 0; i < SIM_TIMS; i++) {
+		TIMx = SIM_TimDef[i].TIM;
+		Flags = SIM_Tim[i].Sr & TIMx->DIER & 0x5F;
+		if (Flags & (TIM_SR_UIF | TIM_SR_TIF))
+			P_SIM_Line(SIM_TimDef[i].IrqUp);
+		if (Flags & 0x1E)
+			P_SIM_Line(SIM_TimDef[i].IrqCc);
+	}
+
+	//ADC (una interrupcion para los tres):
+	for (i = 0; i < 3; i++) {
+		Cr = SIM_Adc[i]->CR1;
+		Flags = SIM_AdcSr[i];
+		if (((Flags & ADC_SR_EOC) && (Cr & ADC_CR1_EOCIE)) || ((Flags & ADC_SR_JEOC) && (Cr & ADC_CR1_JEOCIE)) ||
+			((Flags & ADC_SR_AWD) && (Cr & ADC_CR1_AWDIE)) || ((Flags & ADC_SR_OVR) && (Cr & ADC_CR1_OVRIE)))
+			P_SIM_Line(ADC_IRQn);
+	}
+
+	//DMA:
+	for (i = 0; i < 2; i++)
+		for (s = 0; s < 8; s++) {
+			Stream = P_SIM_DmaStream(i, s);
+			Flags = SIM_DmaIsr[i][s >> 2] >> SIM_DmaShift[s & 3];
+			Cr = Stream->CR;
+			if (((Flags & SIM_DMA_TC) && (Cr & DMA_SxCR_TCIE)) || ((Flags & SIM_DMA_HT) && (Cr & DMA_SxCR_HTIE)) ||
+				((Flags & SIM_DMA_TE) && (Cr & DMA_SxCR_TEIE)) || ((Flags & SIM_DMA_DME) && (Cr & DMA_SxCR_DMEIE)) ||
+				((Flags & SIM_DMA_FE) && (Stream->FCR & DMA_SxFCR_FEIE)))
+				P_SIM_Line(SIM_DmaIrq[i][s]);
+		}
+
+	for (w = 0; w < 3; w++)
+		for (i = 0; i < 32; i++)
+			if ((SIM_LineLevel[w] & (1UL << i)) && !SIM_ActiveExc[16 + w * 32 + i])
+				SIM_Pending[w] |= 1UL << i;
+
+	P_SIM_Reflect();
+}
+
+void P_SIM_Line(IRQn_Type IRQ)
+{
+	SIM_LineLevel[IRQ >> 5] |= 1UL << (IRQ & 31);
+}
+
+//Prioridad de desalojo de una excepcion (los bits de subprioridad no desalojan):
+uint8_t P_SIM_Preempt(uint8_t Exc)
+{
+	uint32_t Group = (SCB->AIRCR & SCB_AIRCR_PRIGROUP_Msk) >> SCB_AIRCR_PRIGROUP_Pos;
+	uint8_t Shift = (Group + 1 > 8 - __NVIC_PRIO_BITS) ? Group + 1 : 8 - __NVIC_PRIO_BITS;
+
+	if (Exc < 16)
+		return SCB->SHP[Exc - 4] >> Shift;
+	return NVIC->IP[Exc - 16] >> Shift;
+}
+
+//Prioridad de lo que corre: excepciones activas, BASEPRI y PRIMASK/FAULTMASK (256 = thread):
+int16_t P_SIM_Running(uint8_t Primask)
+{
+	uint32_t Group = (SCB->AIRCR & SCB_AIRCR_PRIGROUP_Msk) >> SCB_AIRCR_PRIGROUP_Pos;
+	uint8_t Shift = (Group + 1 > 8 - __NVIC_PRIO_BITS) ? Group + 1 : 8 - __NVIC_PRIO_BITS;
+	int16_t Level = 256;
+	uint8_t d;
+
+	for (d = 0; d < SIM_Depth; d++)
+		if (P_SIM_Preempt(SIM_Stack[d]) < Level)
+			Level = P_SIM_Preempt(SIM_Stack[d]);
+	if (SIM_Mask[SIM_BASEPRI] != 0 && (SIM_Mask[SIM_BASEPRI] >> Shift) < Level)
+		Level = SIM_Mask[SIM_BASEPRI] >> Shift;
+	if (SIM_Mask[SIM_FAULTMASK] || (Primask && SIM_Mask[SIM_PRIMASK]))
+		Level = 0;
+
+	return Level;
+}
+
+//Excepcion pendiente que desaloja a lo que corre (0 = ninguna): menor prioridad y luego menor numero:
+uint8_t P_SIM_Best(uint8_t Primask)
+{
+	uint32_t Ready;
+	uint8_t Best = 0, BestPrio = 0, Exc, w, Prio;
+
+	if (SIM_PendSV) {
+		Best = 14;
+		BestPrio = SCB->SHP[10];
+	}
+	if (SIM_PendST && (!Best || SCB->SHP[11] < BestPrio)) {
+		Best = 15;
+		BestPrio = SCB->SHP[11];
+	}
+	for (w = 0; w < 3; w++)
+		for (Ready = SIM_Pending[w] & SIM_Enabled[w]; Ready; Ready &= Ready - 1) {
+			Exc = 16 + w * 32 + __builtin_ctz(Ready);
+			Prio = NVIC->IP[Exc - 16];
+			if (!Best || Prio < BestPrio) {
+				Best = Exc;
+				BestPrio = Prio;
+			}
+		}
+
+	if (Best && P_SIM_Preempt(Best) < P_SIM_Running(Primask))
+		return Best;
+	return 0;
+}
+
+//Entrada a las excepciones, una por vez (las de mayor prioridad entran desde los hooks del handler):
+void P_SIM_Dispatch(void)
+{
+	void (*Handler)(void);
+	uint8_t Exc;
+
+	while ((Exc = P_SIM_Best(1)) != 0) {
+		Handler = SIM_Vector[Exc];
+		if (Handler == NULL) {
+			fprintf(stderr, "sim: excepcion %u habilitada sin handler\n", Exc);
+			P_SIM_End(SIM_END_FAULT);
+		}
+
+		if (Exc == 14)
+			SIM_PendSV = 0;
+		else if (Exc == 15)
+			SIM_PendST = 0;
+		else
+			SIM_Pending[(Exc - 16) >> 5] &= ~(1UL << ((Exc - 16) & 31));
+		SIM_ActiveExc[Exc] = 1;
+		SIM_Stack[SIM_Depth++] = Exc;
+		SIM_Exclusive = 0;
+		SIM_Taken++;
+		P_SIM_Reflect();
+
+		SIM_Now += SIM_IRQ_ENTRY;
+		Handler();
+		SIM_Now += SIM_IRQ_EXIT;
+
+		SIM_Depth--;
+		SIM_ActiveExc[Exc] = 0;
+		SIM_Exclusive = 0;
+		P_SIM_Events();
+		P_SIM_Update();
+		if (SIM_Now >= SIM_Limit)
+			P_SIM_End(SIM_END_TIME);
+	}
+}
+
+//DWT y SysTick:
+//CYCCNT: cuenta mientras CYCCNTENA este en 1, lo que escriba el firmware es el nuevo valor:
+void P_SIM_Cyccnt(void)
+{
+	DWT_Type* Dwt = (DWT_Type*) DWT_BASE;
+
+	if (Dwt->CYCCNT != SIM_CycLast) {
+		SIM_CycValue = Dwt->CYCCNT;
+		SIM_CycAt = SIM_Now;
+	}
+	else if (!(Dwt->CTRL & DWT_CTRL_CYCCNTENA_Msk)) {
+		SIM_CycValue = SIM_CycLast;
+		SIM_CycAt = SIM_Now;
+	}
+
+	SIM_CycLast = SIM_CycValue + (uint32_t) (SIM_Now - SIM_CycAt);
+	Dwt->CYCCNT = SIM_CycLast;
+}
+
+//Escribir VAL lo pone en 0 y borra COUNTFLAG:
+void P_SIM_SystickRegs(void)
+{
+	if (SysTick->VAL != SIM_StLast) {
+		SIM_StVal = 0;
+		SysTick->CTRL &= ~SysTick_CTRL_COUNTFLAG_Msk;
+	}
+	SysTick->VAL = SIM_StLast = SIM_StVal;
+}
+
+//Cuenta descendente de 24 bits: al llegar a 0 pide la excepcion y en el paso siguiente recarga LOAD:
+void P_SIM_Systick(uint64_t Cycles)
+{
+	uint32_t Div = (SysTick->CTRL & SysTick_CTRL_CLKSOURCE_Msk) ? 1 : 8;
+	uint32_t Load = SysTick->LOAD & SysTick_LOAD_RELOAD_Msk;
+	uint64_t Ticks, Step;
+
+	if (!(SysTick->CTRL & SysTick_CTRL_ENABLE_Msk))
+		return;
+
+	SIM_StAcc += Cycles;
+	Ticks = SIM_StAcc / Div;
+	SIM_StAcc %= Div;
+
+	while (Ticks) {
+		if (SIM_StVal == 0) {
+			if (Load == 0)
+				break;
+			SIM_StVal = Load;
+			Ticks--;
+			continue;
+		}
+		Step = (Ticks < SIM_StVal) ? Ticks : SIM_StVal;
+		SIM_StVal -= Step;
+		Ticks -= Step;
+		if (SIM_StVal == 0) {
+			SysTick->CTRL |= SysTick_CTRL_COUNTFLAG_Msk;
+			if (SysTick->CTRL & SysTick_CTRL_TICKINT_Msk)
+				SIM_PendST = 1;
+		}
+	}
+
+	SysTick->VAL = SIM_StLast = SIM_StVal;
+}
+
+uint64_t P_SIM_SystickNext(void)
+{
+	uint32_t Div = (SysTick->CTRL & SysTick_CTRL_CLKSOURCE_Msk) ? 1 : 8;
+	uint32_t Load = SysTick->LOAD & SysTick_LOAD_RELOAD_Msk;
+	uint64_t Ticks;
+
+	if (!(SysTick->CTRL & SysTick_CTRL_ENABLE_Msk) || Load == 0)
+		return UINT64_MAX;
+
+	Ticks = SIM_StVal ? SIM_StVal : (uint64_t) Load + 1;
+	return SIM_Synced + Ticks * Div - SIM_StAcc;
+}
+
+//GPIO y EXTI:
+//BSRR al ODR, IDR segun el modo de cada pin, flancos del EXTI y modelos conectados a las salidas:
+void P_SIM_Pins(void)
+{
+	GPIO_TypeDef* Port;
+	uint32_t Bsrr;
+	uint8_t p, Pass, Changed;
+
+	for (Pass = 0; Pass < 4; Pass++) {
+		Changed = 0;
+		for (p = 0; p < SIM_PORTS; p++) {
+			Port = SIM_Gpio[p];
+			Bsrr = *(volatile uint32_t*) &Port->BSRRL;
+			if (Bsrr) {
+				SIM_GpioWrites++;
+				Port->ODR = (Port->ODR & ~(Bsrr >> 16)) | (Bsrr & 0xFFFF);
+				*(volatile uint32_t*) &Port->BSRRL = 0;
+			}
+			if ((Port->ODR & 0xFFFF) != SIM_Odr[p]) {
+				SIM_Odr[p] = Port->ODR & 0xFFFF;
+				Changed = 1;
+			}
+			SIM_Idr[p] = P_SIM_Idr(p);
+			Port->IDR = SIM_Idr[p];
+		}
+		P_SIM_Exti();
+
+		if (!Changed)
+			break;
+		P_SIM_LcdBus();
+		if (SIM_OnOutput != NULL)
+			SIM_OnOutput();
+	}
+}
+
+uint16_t P_SIM_Idr(uint8_t p)
+{
+	GPIO_TypeDef* Port = SIM_Gpio[p];
+	uint32_t Moder = Port->MODER, Pupdr = Port->PUPDR;
+	uint16_t Idr = 0;
+	uint8_t Pin, Level;
+
+	for (Pin = 0; Pin < 16; Pin++) {
+		switch ((Moder >> (2 * Pin)) & 3) {
+		case 0:
+			if (SIM_InMask[p] & (1 << Pin))
+				Level = (SIM_InLevel[p] >> Pin) & 1;
+			else
+				Level = ((Pupdr >> (2 * Pin)) & 3) == 1;
+			break;
+		case 1:
+			Level = (SIM_Odr[p] >> Pin) & 1;
+			break;
+		case 2:
+			Level = P_SIM_AfLevel(p, Pin, (Port->AFR[Pin >> 3] >> (4 * (Pin & 7))) & 0xF);
+			break;
+		default:
+			Level = 0;
+			break;
+		}
+		Idr |= Level << Pin;
+	}
+
+	return Idr;
+}
+
+//Salida de un canal de timer en un pin en modo alternativo (otras funciones leen 0):
+uint8_t P_SIM_AfLevel(uint8_t Port, uint8_t Pin, uint8_t Af)
+{
+	uint8_t i;
+
+	for (i = 0; i < sizeof(SIM_AfTable) / sizeof(SIM_AfTable[0]); i++)
+		if (SIM_AfTable[i].Port == Port && SIM_AfTable[i].Pin == Pin && SIM_AfTable[i].Af == Af)
+			return P_SIM_TimOutput(SIM_AfTable[i].Tim - 1, SIM_AfTable[i].Ch);
+
+	return 0;
+}
+
+//PR se borra escribiendo 1 (sin la marca, lo escribio el firmware); SWIER pide la interrupcion:
+void P_SIM_ExtiRegs(void)
+{
+	uint32_t Pr = EXTI->PR;
+
+	if (!(Pr & SIM_EXTI_MARK)) {
+		SIM_ExtiPr &= ~Pr;
+		EXTI->SWIER &= ~Pr;
+	}
+	SIM_ExtiPr |= EXTI->SWIER & EXTI->IMR;
+	EXTI->PR = SIM_ExtiPr | SIM_EXTI_MARK;
+}
+
+void P_SIM_Exti(void)
+{
+	uint32_t Levels = 0, Edges;
+	uint8_t Line, Port;
+
+	for (Line = 0; Line < 16; Line++) {
+		Port = (SYSCFG->EXTICR[Line >> 2] >> (4 * (Line & 3))) & 0xF;
+		if (Port < SIM_PORTS && (SIM_Idr[Port] & (1 << Line)))
+			Levels |= 1 << Line;
+	}
+
+	Edges = ((Levels & ~SIM_ExtiLevel & EXTI->RTSR) | (~Levels & SIM_ExtiLevel & EXTI->FTSR)) & 0xFFFF;
+	SIM_ExtiLevel = Levels;
+	if (!Edges)
+		return;
+
+	if (Edges & (1 << 11))
+		P_SIM_AdcTrigger(SIM_TRIG(0, 11));
+	if (Edges & (1 << 15))
+		P_SIM_AdcTrigger(SIM_TRIG(0, 15));
+
+	SIM_ExtiPr |= Edges & EXTI->IMR;
+	EXTI->PR = SIM_ExtiPr | SIM_EXTI_MARK;
+}
+
+//TIM:
+//Flags (se borran escribiendo 0) y eventos por software de EGR:
+void P_SIM_TimRegs(uint8_t i)
+{
+	TIM_TypeDef* TIMx = SIM_TimDef[i].TIM;
+	SIM_TIM_t* Tim = &SIM_Tim[i];
+	uint16_t Egr = TIMx->EGR;
+	uint8_t Ch;
+
+	Tim->Sr &= TIMx->SR;
+
+	if (Egr) {
+		TIMx->EGR = 0;
+		if (Egr & TIM_EGR_UG) {
+			TIMx->CNT = 0;
+			Tim->Acc = 0;
+			Tim->Arr = TIMx->ARR & P_SIM_TimMax(i);
+			Tim->Psc = TIMx->PSC;
+			if (!(TIMx->CR1 & TIM_CR1_URS)) {
+				Tim->Sr |= TIM_SR_UIF;
+				if (TIMx->DIER & TIM_DIER_UDE)
+					P_SIM_DmaRequest((uint32_t) (uintptr_t) TIMx, SIM_EV_UPDATE);
+			}
+		}
+		for (Ch = 0; Ch < SIM_TimDef[i].Channels; Ch++)
+			if (Egr & (TIM_EGR_CC1G << Ch)) {
+				Tim->Sr |= TIM_SR_CC1IF << Ch;
+				if (TIMx->DIER & (TIM_DIER_CC1DE << Ch))
+					P_SIM_DmaRequest((uint32_t) (uintptr_t) TIMx, 1 + Ch);
+			}
+		if (Egr & TIM_EGR_TG)
+			Tim->Sr |= TIM_SR_TIF;
+	}
+
+	TIMx->SR = Tim->Sr;
+}
+
+//Cuenta ascendente de evento en evento (update y comparaciones), con el prescaler activo en cada tramo:
+void P_SIM_TimAdvance(uint8_t i, uint64_t Cycles)
+{
+	TIM_TypeDef* TIMx = SIM_TimDef[i].TIM;
+	SIM_TIM_t* Tim = &SIM_Tim[i];
+	uint64_t Ticks, Step;
+	uint32_t Per, Cnt, Arr;
+	uint8_t Ch;
+
+	if (!(TIMx->CR1 & TIM_CR1_CEN)) {
+		Tim->Acc = 0;
+		return;
+	}
+
+	Tim->Acc += Cycles;
+	while (TIMx->CR1 & TIM_CR1_CEN) {
+		Per = P_SIM_TimCycles(i);
+		Ticks = Tim->Acc / Per;
+		if (Ticks == 0)
+			break;
+
+		Cnt = TIMx->CNT & P_SIM_TimMax(i);
+		Step = P_SIM_TimTicks(i, Cnt);
+		if (Step > Ticks) {
+			TIMx->CNT = Cnt + (uint32_t) Ticks;
+			Tim->Acc -= Ticks * Per;
+			break;
+		}
+		Tim->Acc -= Step * Per;
+
+		//Desborde en ARR (update) o en el maximo si la cuenta quedo por encima de ARR:
+		Arr = P_SIM_TimArr(i);
+		if (Step == (uint64_t) ((Cnt <= Arr) ? Arr : P_SIM_TimMax(i)) - Cnt + 1) {
+			TIMx->CNT = 0;
+			if (Cnt <= Arr)
+				P_SIM_TimUpdate(i);
+		}
+		else
+			TIMx->CNT = Cnt + (uint32_t) Step;
+
+		for (Ch = 0; Ch < SIM_TimDef[i].Channels; Ch++)
+			if ((P_SIM_TimMode(i, Ch) & 3) == 0 && (&TIMx->CCR1)[Ch] == TIMx->CNT)
+				P_SIM_TimCompare(i, Ch);
+
+		P_SIM_Pins();
+	}
+
+	if (!(TIMx->CR1 & TIM_CR1_CEN))
+		Tim->Acc = 0;
+}
+
+uint64_t P_SIM_TimNext(uint8_t i)
+{
+	TIM_TypeDef* TIMx = SIM_TimDef[i].TIM;
+	uint64_t Need;
+
+	if (!(TIMx->CR1 & TIM_CR1_CEN))
+		return UINT64_MAX;
+
+	Need = P_SIM_TimTicks(i, TIMx->CNT & P_SIM_TimMax(i)) * P_SIM_TimCycles(i);
+	return SIM_Synced + ((Need > SIM_Tim[i].Acc) ? Need - SIM_Tim[i].Acc : 0);
+}
+
+//Pasos hasta el proximo evento: desborde o comparacion de un canal de salida:
+uint64_t P_SIM_TimTicks(uint8_t i, uint32_t Cnt)
+{
+	TIM_TypeDef* TIMx = SIM_TimDef[i].TIM;
+	uint32_t Arr = P_SIM_TimArr(i), Top = (Cnt <= Arr) ? Arr : P_SIM_TimMax(i), Ccr;
+	uint64_t Wrap = (uint64_t) Top - Cnt + 1, Ticks = Wrap;
+	uint8_t Ch;
+
+	for (Ch = 0; Ch < SIM_TimDef[i].Channels; Ch++) {
+		if (P_SIM_TimMode(i, Ch) & 3)
+			continue;
+		Ccr = (&TIMx->CCR1)[Ch] & P_SIM_TimMax(i);
+		if (Ccr > Cnt && Ccr <= Top && Ccr - Cnt < Ticks)
+			Ticks = Ccr - Cnt;
+		else if (Ccr <= Cnt && Ccr <= Arr && Wrap + Ccr < Ticks)
+			Ticks = Wrap + Ccr;
+	}
+
+	return Ticks;
+}
+
+//Ciclos de CPU por paso: reloj del timer = PCLK, o 2 x PCLK si el APB esta dividido:
+uint32_t P_SIM_TimCycles(uint8_t i)
+{
+	uint32_t Ppre;
+
+	if (SIM_TimDef[i].Apb2)
+		Ppre = (RCC->CFGR & RCC_CFGR_PPRE2) >> 13;
+	else
+		Ppre = (RCC->CFGR & RCC_CFGR_PPRE1) >> 10;
+
+	if (Ppre < 4)
+		return SIM_Tim[i].Psc + 1;
+	return (SIM_Tim[i].Psc + 1) << (Ppre - 4);
+}
+
+uint32_t P_SIM_TimMax(uint8_t i)
+{
+	return SIM_TimDef[i].Bits32 ? 0xFFFFFFFF : 0xFFFF;
+}
+
+uint32_t P_SIM_TimArr(uint8_t i)
+{
+	TIM_TypeDef* TIMx = SIM_TimDef[i].TIM;
+
+	if (TIMx->CR1 & TIM_CR1_ARPE)
+		return SIM_Tim[i].Arr;
+	return TIMx->ARR & P_SIM_TimMax(i);
+}
+
+//Byte de CCMR1/CCMR2 del canal (CCxS en los bits 1:0, OCxM en los bits 6:4):
+uint8_t P_SIM_TimMode(uint8_t i, uint8_t Ch)
+{
+	TIM_TypeDef* TIMx = SIM_TimDef[i].TIM;
+
+	return (((Ch < 2) ? TIMx->CCMR1 : TIMx->CCMR2) >> (8 * (Ch & 1))) & 0xFF;
+}
+
+void P_SIM_TimUpdate(uint8_t i)
+{
+	TIM_TypeDef* TIMx = SIM_TimDef[i].TIM;
+	SIM_TIM_t* Tim = &SIM_Tim[i];
+
+	if (TIMx->CR1 & TIM_CR1_UDIS)
+		return;
+
+	Tim->Arr = TIMx->ARR & P_SIM_TimMax(i);
+	Tim->Psc = TIMx->PSC;
+	Tim->Sr |= TIM_SR_UIF;
+	TIMx->SR = Tim->Sr;
+
+	if (TIMx->DIER & TIM_DIER_UDE)
+		P_SIM_DmaRequest((uint32_t) (uintptr_t) TIMx, SIM_EV_UPDATE);
+	P_SIM_TimTrgo(i, SIM_EV_UPDATE);
+
+	if (TIMx->CR1 & TIM_CR1_OPM)
+		TIMx->CR1 &= ~TIM_CR1_CEN;
+}
+
+//Comparacion: OCxREF segun el modo (1 = activo, 2 = inactivo, 3 = cambia), flag, DMA y disparos:
+void P_SIM_TimCompare(uint8_t i, uint8_t Ch)
+{
+	TIM_TypeDef* TIMx = SIM_TimDef[i].TIM;
+	SIM_TIM_t* Tim = &SIM_Tim[i];
+
+	switch ((P_SIM_TimMode(i, Ch) >> 4) & 7) {
+	case 1:
+		Tim->Ref[Ch] = 1;
+		break;
+	case 2:
+		Tim->Ref[Ch] = 0;
+		break;
+	case 3:
+		Tim->Ref[Ch] ^= 1;
+		break;
+	}
+
+	Tim->Sr |= TIM_SR_CC1IF << Ch;
+	TIMx->SR = Tim->Sr;
+
+	if (TIMx->DIER & (TIM_DIER_CC1DE << Ch))
+		P_SIM_DmaRequest((uint32_t) (uintptr_t) TIMx, 1 + Ch);
+	P_SIM_AdcTrigger(SIM_TRIG(i + 1, 1 + Ch));
+	P_SIM_TimTrgo(i, 1 + Ch);
+}
+
+//TRGO segun MMS: 2 = update, 3 = comparacion del canal 1, 4...7 = OC1REF...OC4REF:
+void P_SIM_TimTrgo(uint8_t i, uint8_t Event)
+{
+	uint8_t Mms = (SIM_TimDef[i].TIM->CR2 & TIM_CR2_MMS) >> 4;
+
+	if ((Mms == 2 && Event == SIM_EV_UPDATE) || (Mms == 3 && Event == 1) || (Mms >= 4 && Event == Mms - 3))
+		P_SIM_AdcTrigger(SIM_TRIG(i + 1, SIM_EV_TRGO));
+}
+
+//Nivel del pin de un canal: OCxREF (o PWM con la cuenta actual) con su polaridad, si la salida esta habilitada:
+uint8_t P_SIM_TimOutput(uint8_t i, uint8_t Ch)
+{
+	TIM_TypeDef* TIMx = SIM_TimDef[i].TIM;
+	uint8_t Mode = P_SIM_TimMode(i, Ch), Ref;
+
+	if (Ch >= SIM_TimDef[i].Channels || !(TIMx->CCER & (TIM_CCER_CC1E << (4 * Ch))))
+		return 0;
+	if ((TIMx == TIM1 || TIMx == TIM8) && !(TIMx->BDTR & TIM_BDTR_MOE))
+		return 0;
+
+	switch ((Mode >> 4) & 7) {
+	case 4:
+		Ref = 0;
+		break;
+	case 5:
+		Ref = 1;
+		break;
+	case 6:
+		Ref = (TIMx->CNT & P_SIM_TimMax(i)) < ((&TIMx->CCR1)[Ch] & P_SIM_TimMax(i));
+		break;
+	case 7:
+		Ref = (TIMx->CNT & P_SIM_TimMax(i)) >= ((&TIMx->CCR1)[Ch] & P_SIM_TimMax(i));
+		break;
+	default:
+		Ref = SIM_Tim[i].Ref[Ch];
+		break;
+	}
+
+	return Ref ^ ((TIMx->CCER >> (4 * Ch + 1)) & 1);
+}
+
+//ADC:
+//Flags (se borran escribiendo 0), arranque por software y apagado:
+void P_SIM_AdcRegs(uint8_t a)
+{
+	ADC_TypeDef* ADCx = SIM_Adc[a];
+
+	SIM_AdcSr[a] &= ADCx->SR;
+
+	if (!(ADCx->CR2 & ADC_CR2_ADON)) {
+		SIM_AdcDone[a] = 0;
+		ADCx->CR2 &= ~(ADC_CR2_SWSTART | ADC_CR2_JSWSTART);
+	}
+	else {
+		if (ADCx->CR2 & ADC_CR2_SWSTART) {
+			ADCx->CR2 &= ~ADC_CR2_SWSTART;
+			P_SIM_AdcStart(a);
+		}
+		if (ADCx->CR2 & ADC_CR2_JSWSTART) {
+			ADCx->CR2 &= ~ADC_CR2_JSWSTART;
+			P_SIM_AdcInjected(a);
+		}
+	}
+
+	ADCx->SR = SIM_AdcSr[a];
+}
+
+//Disparo externo: conversion regular (EXTSEL) o inyectada (JEXTSEL) de los ADC que lo esperan:
+void P_SIM_AdcTrigger(uint8_t Source)
+{
+	ADC_TypeDef* ADCx;
+	uint8_t a;
+
+	for (a = 0; a < 3; a++) {
+		ADCx = SIM_Adc[a];
+		if (!(ADCx->CR2 & ADC_CR2_ADON))
+			continue;
+		if ((ADCx->CR2 & ADC_CR2_EXTEN) && SIM_AdcRegular[(ADCx->CR2 & ADC_CR2_EXTSEL) >> 24] == Source)
+			P_SIM_AdcStart(a);
+		if ((ADCx->CR2 & ADC_CR2_JEXTEN) && SIM_AdcInjected[(ADCx->CR2 & ADC_CR2_JEXTSEL) >> 16] == Source)
+			P_SIM_AdcInjected(a);
+	}
+}
+
+//Comienzo de la secuencia regular (un disparo durante una conversion se ignora):
+void P_SIM_AdcStart(uint8_t a)
+{
+	if (SIM_AdcDone[a] != 0)
+		return;
+
+	SIM_AdcRank[a] = 0;
+	SIM_AdcDone[a] = SIM_Now + P_SIM_AdcCycles(a, P_SIM_AdcChannel(a, 0));
+	SIM_AdcSr[a] = (SIM_AdcSr[a] & ~ADC_SR_EOC) | ADC_SR_STRT;
+	SIM_Adc[a]->SR = SIM_AdcSr[a];
+}
+
+//Fin de una conversion: DR, EOC (o el pedido al DMA, que lo borra al leer DR) y la siguiente de la secuencia:
+void P_SIM_AdcEnd(uint8_t a)
+{
+	ADC_TypeDef* ADCx = SIM_Adc[a];
+	uint8_t Len;
+
+	ADCx->DR = P_SIM_AdcValue(a, P_SIM_AdcChannel(a, SIM_AdcRank[a]));
+	SIM_AdcSr[a] |= ADC_SR_EOC;
+	ADCx->SR = SIM_AdcSr[a];
+	if ((ADCx->CR2 & ADC_CR2_DMA) && P_SIM_DmaRequest((uint32_t) (uintptr_t) ADCx, 0))
+		SIM_AdcSr[a] &= ~ADC_SR_EOC;
+	ADCx->SR = SIM_AdcSr[a];
+
+	Len = (ADCx->CR1 & ADC_CR1_SCAN) ? ((ADCx->SQR1 & ADC_SQR1_L) >> 20) + 1 : 1;
+	if (++SIM_AdcRank[a] < Len)
+		SIM_AdcDone[a] += P_SIM_AdcCycles(a, P_SIM_AdcChannel(a, SIM_AdcRank[a]));
+	else if (ADCx->CR2 & ADC_CR2_CONT) {
+		SIM_AdcRank[a] = 0;
+		SIM_AdcDone[a] += P_SIM_AdcCycles(a, P_SIM_AdcChannel(a, 0));
+	}
+	else
+		SIM_AdcDone[a] = 0;
+}
+
+//Secuencia inyectada completa al instante: JL + 1 canales desde el rango 4 - JL, menos el offset:
+void P_SIM_AdcInjected(uint8_t a)
+{
+	ADC_TypeDef* ADCx = SIM_Adc[a];
+	uint8_t Jl = (ADCx->JSQR & ADC_JSQR_JL) >> 20, k, Ch;
+
+	for (k = 0; k <= Jl; k++) {
+		Ch = (ADCx->JSQR >> (5 * (3 - Jl + k))) & 0x1F;
+		(&ADCx->JDR1)[k] = (uint16_t) (P_SIM_AdcValue(a, Ch) - (&ADCx->JOFR1)[k]);
+	}
+
+	SIM_AdcSr[a] |= ADC_SR_JEOC | ADC_SR_JSTRT;
+	ADCx->SR = SIM_AdcSr[a];
+}
+
+//Canal del rango (0 = primero): SQR3 tiene los rangos 1...6, SQR2 7...12 y SQR1 13...16:
+uint8_t P_SIM_AdcChannel(uint8_t a, uint8_t Rank)
+{
+	ADC_TypeDef* ADCx = SIM_Adc[a];
+	uint32_t Sqr = (Rank < 6) ? ADCx->SQR3 : (Rank < 12) ? ADCx->SQR2 : ADCx->SQR1;
+
+	return (Sqr >> (5 * (Rank % 6))) & 0x1F;
+}
+
+//Valor convertido: resolucion (RES) y alineacion (ALIGN) del registro:
+uint16_t P_SIM_AdcValue(uint8_t a, uint8_t Ch)
+{
+	ADC_TypeDef* ADCx = SIM_Adc[a];
+	uint8_t Res = (ADCx->CR1 & ADC_CR1_RES) >> 24;
+	uint16_t Value = (SIM_Analog != NULL) ? SIM_Analog(ADCx, Ch) : 0;
+
+	if (Value > 4095)
+		Value = 4095;
+	Value >>= 2 * Res;
+	if (ADCx->CR2 & ADC_CR2_ALIGN)
+		Value <<= (Res == 3) ? 2 : 4 + 2 * Res;
+
+	return Value;
+}
+
+//Ciclos de CPU de una conversion: muestreo + 12 ciclos de ADCCLK (PCLK2 / ADCPRE):
+uint32_t P_SIM_AdcCycles(uint8_t a, uint8_t Ch)
+{
+	ADC_TypeDef* ADCx = SIM_Adc[a];
+	uint32_t Ppre = (RCC->CFGR & RCC_CFGR_PPRE2) >> 13, Smp;
+
+	if (Ch < 10)
+		Smp = (ADCx->SMPR2 >> (3 * Ch)) & 7;
+	else
+		Smp = (ADCx->SMPR1 >> (3 * (Ch - 10))) & 7;
+
+	return (SIM_AdcSample[Smp] + 12) * 2 * (((ADC->CCR & ADC_CCR_ADCPRE) >> 16) + 1) * ((Ppre < 4) ? 1 : 1 << (Ppre - 3));
+}
+
+//DMA:
+DMA_Stream_TypeDef* P_SIM_DmaStream(uint8_t d, uint8_t s)
+{
+	return (DMA_Stream_TypeDef*) ((d ? DMA2_BASE : DMA1_BASE) + 0x10 + 0x18 * s);
+}
+
+//Flags (LIFCR/HIFCR borran con 1), habilitacion de los streams (NDTR al habilitar) y memoria a memoria:
+void P_SIM_DmaRegs(uint8_t d)
+{
+	DMA_TypeDef* DMAx = d ? DMA2 : DMA1;
+	DMA_Stream_TypeDef* Stream;
+	SIM_DMA_t* Dma;
+	uint8_t s;
+
+	SIM_DmaIsr[d][0] &= ~DMAx->LIFCR;
+	SIM_DmaIsr[d][1] &= ~DMAx->HIFCR;
+	DMAx->LIFCR = 0;
+	DMAx->HIFCR = 0;
+	DMAx->LISR = SIM_DmaIsr[d][0];
+	DMAx->HISR = SIM_DmaIsr[d][1];
+
+	for (s = 0; s < 8; s++) {
+		Stream = P_SIM_DmaStream(d, s);
+		Dma = &SIM_Dma[d][s];
+		if ((Stream->CR & DMA_SxCR_EN) && !Dma->On) {
+			Dma->Total = Stream->NDTR;
+			Dma->Pos = 0;
+			Dma->On = (Dma->Total != 0);
+			if (!Dma->On)
+				Stream->CR &= ~DMA_SxCR_EN;
+			else if ((Stream->CR & DMA_SxCR_DIR) == DMA_SxCR_DIR_1)
+				while (Dma->On)
+					P_SIM_DmaItem(d, s);
+		}
+		else if (!(Stream->CR & DMA_SxCR_EN))
+			Dma->On = 0;
+	}
+}
+
+//Pedido de un periferico: un dato en cada stream habilitado con ese canal:
+uint8_t P_SIM_DmaRequest(uint32_t Periph, uint8_t Event)
+{
+	const SIM_DMA_REQ_t* Req;
+	uint8_t i, Done = 0;
+
+	for (i = 0; i < sizeof(SIM_DmaReq) / sizeof(SIM_DmaReq[0]); i++) {
+		Req = &SIM_DmaReq[i];
+		if (Req->Periph == Periph && Req->Event == Event && SIM_Dma[Req->Dma][Req->Stream].On &&
+			((P_SIM_DmaStream(Req->Dma, Req->Stream)->CR & DMA_SxCR_CHSEL) >> 25) == Req->Channel) {
+			P_SIM_DmaItem(Req->Dma, Req->Stream);
+			Done = 1;
+		}
+	}
+
+	return Done;
+}
+
+//Un dato: lectura y escritura con PSIZE/MSIZE, incrementos, NDTR, mitad (HT), fin (TC) y modo circular:
+void P_SIM_DmaItem(uint8_t d, uint8_t s)
+{
+	DMA_Stream_TypeDef* Stream = P_SIM_DmaStream(d, s);
+	SIM_DMA_t* Dma = &SIM_Dma[d][s];
+	uint32_t Cr = Stream->CR, Par, Mar;
+	uint8_t Psize = 1 << ((Cr & DMA_SxCR_PSIZE) >> 11), Msize = 1 << ((Cr & DMA_SxCR_MSIZE) >> 13);
+
+	Par = Stream->PAR + ((Cr & DMA_SxCR_PINC) ? Dma->Pos * Psize : 0);
+	Mar = Stream->M0AR + ((Cr & DMA_SxCR_MINC) ? Dma->Pos * Msize : 0);
+	if ((Cr & DMA_SxCR_DIR) == DMA_SxCR_DIR_0)
+		P_SIM_Write(Par, Psize, P_SIM_Read(Mar, Msize));
+	else
+		P_SIM_Write(Mar, Msize, P_SIM_Read(Par, Psize));
+
+	Dma->Pos++;
+	Stream->NDTR = Dma->Total - Dma->Pos;
+	if (Dma->Pos == Dma->Total / 2)
+		P_SIM_DmaFlag(d, s, SIM_DMA_HT);
+	if (Dma->Pos == Dma->Total) {
+		P_SIM_DmaFlag(d, s, SIM_DMA_TC);
+		if ((Cr & DMA_SxCR_CIRC) && (Cr & DMA_SxCR_DIR) != DMA_SxCR_DIR_1) {
+			Dma->Pos = 0;
+			Stream->NDTR = Dma->Total;
+		}
+		else {
+			Stream->CR &= ~DMA_SxCR_EN;
+			Dma->On = 0;
+		}
+	}
+}
+
+void P_SIM_DmaFlag(uint8_t d, uint8_t s, uint32_t Flag)
+{
+	SIM_DmaIsr[d][s >> 2] |= Flag << SIM_DmaShift[s & 3];
+	(d ? DMA2 : DMA1)->LISR = SIM_DmaIsr[d][0];
+	(d ? DMA2 : DMA1)->HISR = SIM_DmaIsr[d][1];
+}
+
+//LCD:
+//Flancos de E de cada controlador: el HD44780 toma RS y los datos en el de bajada:
+void P_SIM_LcdBus(void)
+{
+	SIM_HD44780_t* Hd;
+	uint8_t c, Level;
+
+	if (SIM_LcdLCD == NULL)
+		return;
+
+	for (c = 0; c < 2; c++) {
+		if (SIM_LcdLCD->Port[c ? TLCD_E2 : TLCD_E] == NULL)
+			continue;
+		Hd = &SIM_Hd[c];
+		Level = P_SIM_LcdLevel(c ? TLCD_E2 : TLCD_E);
+		if (Level && !Hd->E)
+			Hd->Rise = SIM_Now;
+		else if (!Level && Hd->E)
+			P_SIM_LcdLatch(c);
+		Hd->E = Level;
+	}
+}
+
+uint8_t P_SIM_LcdLevel(TLCD_NAME_t Pin)
+{
+	if (SIM_LcdLCD->Port[Pin] == NULL)
+		return 0;
+	return (SIM_LcdLCD->Port[Pin]->ODR & SIM_LcdLCD->Pin[Pin]) != 0;
+}
+
+//Un pulso de E: un byte en 8 bits, medio byte (primero el alto) en 4 bits:
+void P_SIM_LcdLatch(uint8_t c)
+{
+	SIM_HD44780_t* Hd = &SIM_Hd[c];
+	uint8_t Data;
+
+	SIM_LcdStats.Pulses++;
+	if (SIM_Now - Hd->Rise < SIM_NS(450))
+		SIM_LcdStats.Short++;
+	if (P_SIM_LcdLevel(TLCD_RW))
+		return;
+
+	//Comienzo de un byte: el anterior tiene que haber terminado:
+	if (Hd->Bus8 || !Hd->Half) {
+		if (SIM_Now < Hd->Busy)
+			SIM_LcdStats.Busy++;
+		if (SIM_Now < SIM_US(15000))
+			SIM_LcdStats.Early++;
+	}
+
+	Data = P_SIM_LcdLevel(TLCD_D7) << 7 | P_SIM_LcdLevel(TLCD_D6) << 6 |
+		   P_SIM_LcdLevel(TLCD_D5) << 5 | P_SIM_LcdLevel(TLCD_D4) << 4 |
+		   P_SIM_LcdLevel(TLCD_D3) << 3 | P_SIM_LcdLevel(TLCD_D2) << 2 |
+		   P_SIM_LcdLevel(TLCD_D1) << 1 | P_SIM_LcdLevel(TLCD_D0);
+
+	if (Hd->Bus8)
+		P_SIM_LcdByte(c, P_SIM_LcdLevel(TLCD_RS), Data);
+	else if (!Hd->Half) {
+		Hd->High = Data & 0xF0;
+		Hd->Half = 1;
+	}
+	else {
+		Hd->Half = 0;
+		P_SIM_LcdByte(c, P_SIM_LcdLevel(TLCD_RS), Hd->High | (Data >> 4));
+	}
+}
+
+//Comandos y datos del HD44780, con su tiempo de ejecucion (37 useg, 1,52 mseg CLEAR/HOME):
+void P_SIM_LcdByte(uint8_t c, uint8_t Rs, uint8_t Byte)
+{
+	SIM_HD44780_t* Hd = &SIM_Hd[c];
+	uint64_t Exec = SIM_US(37);
+
+	if (Rs) {
+		SIM_LcdStats.Data++;
+		if (Hd->Cg) {
+			Hd->Cgram[Hd->Ac & 0x3F] = Byte;
+			Hd->Ac = (Hd->Ac + (Hd->Inc ? 1 : -1)) & 0x3F;
+		}
+		else {
+			Hd->Ddram[P_SIM_LcdIndex(c, Hd->Ac)] = Byte;
+			Hd->Ac = P_SIM_LcdNext(c, Hd->Ac);
+		}
+	}
+	else {
+		SIM_LcdStats.Commands++;
+		if (Byte & 0x80) {
+			Hd->Ac = Byte & 0x7F;
+			Hd->Cg = 0;
+		}
+		else if (Byte & 0x40) {
+			Hd->Ac = Byte & 0x3F;
+			Hd->Cg = 1;
+		}
+		else if (Byte & 0x20) {
+			//Inicio por instrucciones: 4,1 mseg tras el 1er function set de 8 bits y 100 useg tras el 2do:
+			if (Hd->Bus8 && (Byte & 0x10)) {
+				if (Hd->Inits == 0)
+					Exec = SIM_US(4100);
+				else if (Hd->Inits == 1)
+					Exec = SIM_US(100);
+				Hd->Inits++;
+			}
+			Hd->Bus8 = (Byte >> 4) & 1;
+			Hd->Lines2 = (Byte >> 3) & 1;
+			Hd->Half = 0;
+		}
+		else if (Byte & 0x10) {
+			if (!(Byte & 0x08))
+				Hd->Ac = (Byte & 0x04) ? P_SIM_LcdNext(c, Hd->Ac) : (Hd->Ac ? Hd->Ac - 1 : 0);
+		}
+		else if (Byte & 0x08)
+			Hd->On = (Byte >> 2) & 1;
+		else if (Byte & 0x04)
+			Hd->Inc = (Byte >> 1) & 1;
+		else if (Byte & 0x02) {
+			Hd->Ac = 0;
+			Hd->Cg = 0;
+			Exec = SIM_US(1520);
+		}
+		else if (Byte & 0x01) {
+			memset(Hd->Ddram, ' ', sizeof(Hd->Ddram));
+			Hd->Ac = 0;
+			Hd->Cg = 0;
+			Hd->Inc = 1;
+			Exec = SIM_US(1520);
+		}
+	}
+
+	Hd->Busy = SIM_Now + Exec;
+}
+
+//Lugar en la DDRAM: con 2 lineas, 0x00...0x27 y 0x40...0x67:
+uint8_t P_SIM_LcdIndex(uint8_t c, uint8_t Address)
+{
+	if (SIM_Hd[c].Lines2)
+		return ((Address & 0x40) ? 40 : 0) + (Address & 0x3F) % 40;
+	return Address % 80;
+}
+
+//Direccion siguiente de la DDRAM segun el modo de entrada:
+uint8_t P_SIM_LcdNext(uint8_t c, uint8_t Address)
+{
+	SIM_HD44780_t* Hd = &SIM_Hd[c];
+
+	if (!Hd->Lines2)
+		return Hd->Inc ? (Address + 1) % 80 : (Address + 79) % 80;
+	if (Hd->Inc)
+		return (Address == 0x27) ? 0x40 : (Address == 0x67) ? 0x00 : Address + 1;
+	return (Address == 0x40) ? 0x27 : (Address == 0x00) ? 0x67 : Address - 1;
+}
+
+/*------------------------------------------------------------------------------
+NOTAS
+------------------------------------------------------------------------------*/
+/* -----------------------------------------------------------------------
+[1]	 Por que se mapean las direcciones reales: el StdPeriph y mi_libreria.c
+	 acceden a los registros con las macros del stm32f4xx.h (GPIOC, TIM2,
+	 DWT...), que son direcciones fijas. Con la memoria en 0x40000000 y
+	 0xE0000000 el codigo del micro compila y corre sin cambios. El binario
+	 es no-PIE para que las direcciones de las variables entren en 32 bits
+	 (el DMA las recibe como uint32_t).
+
+[2]	 Registros que el simulador lee y escribe: lo que el firmware escribe
+	 entre dos actualizaciones se procesa en la siguiente. Los flags que se
+	 borran escribiendo 0 (TIM->SR, ADC->SR) se guardan aparte y se hace un
+	 AND con lo leido; los que se borran escribiendo 1 (EXTI->PR, DMA->LIFCR)
+	 se distinguen con una marca o con el registro de borrado.
+ ----------------------------------------------------------------------- */
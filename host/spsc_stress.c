@@ -0,0 +1,413 @@
+/**********
+  * @file    spsc_stress.c
+  * @author  A. Riedinger.
+  * @brief   Prueba de carga de las colas SPSC y los seqlocks en la simulacion
+  *          en PC, entre una interrupcion (TIM6, periodo pseudoaleatorio en
+  *          cada disparo) y el programa principal, en los dos sentidos:
+  *          - Cola, productor en la interrupcion y consumidor en el principal.
+  *          - Cola, productor en el principal y consumidor en la interrupcion.
+  *          - Seqlock, escritor en la interrupcion y lector en el principal.
+  *          - Seqlock, escritor en el principal y lector en la interrupcion.
+  *          La biblioteca se compila con memcpy = SIM_COPY, una copia byte a
+  *          byte donde cada byte es un punto en que puede entrar la
+  *          interrupcion: las copias de la cola y del seqlock se cortan a
+  *          mitad de camino.
+  *
+  * CONTROLES:
+  	  * Cola: los elementos llegan en orden, sin repetidos ni dañados, y los
+  	    unicos que faltan son los descartados por cola llena (Lost).
+  	  * Seqlock: ninguna lectura valida mezcla dos escrituras y los valores
+  	    leidos nunca vuelven atras.
+  	  * En cada caso la interrupcion corto al principal dentro de la cola o
+  	    del seqlock (Cortes), si no la prueba no probo nada.
+  	  * Fallidos: intentos con la cola llena o lecturas invalidas del
+  	    seqlock (reintentadas), solo informativo.
+  	  * Sale con 0 si todos los controles dan bien.
+**********/
+
+/*------------------------------------------------------------------------------
+LIBRERIAS:
+------------------------------------------------------------------------------*/
+#include "sim.h"
+
+/*------------------------------------------------------------------------------
+DEFINICIONES:
+------------------------------------------------------------------------------*/
+//Elementos (o escrituras) por caso y largo de la cola (potencia de 2, chica para que se llene):
+#define Stress_Items 5000
+#define Stress_Queue 8
+
+//Periodo de la interrupcion [pasos del TIM6, 2 ciclos de CPU] y espera maxima del principal [llamadas]:
+#define Stress_ArrMin 60
+#define Stress_ArrMax 1500
+#define Stress_Spin   300
+
+//Tiempo maximo de cada caso [mseg]:
+#define Stress_Limit 2000
+
+//Elemento de la cola: numero de orden, un control y relleno, todo derivado del numero:
+typedef struct {
+	uint32_t Seq;
+	uint32_t Check;
+	uint8_t Pad[8];
+}ITEM_t;
+
+//Estado del seqlock: todas las palabras con el numero de escritura:
+typedef struct {
+	uint32_t Value[6];
+}STATE_t;
+
+//Trabajo de la interrupcion en cada caso:
+typedef enum {
+	MODE_OFF = 0,
+	MODE_PRODUCER,
+	MODE_CONSUMER,
+	MODE_WRITER,
+	MODE_READER
+}MODE_t;
+
+//Resultado de un caso:
+typedef struct {
+	const char* Name;
+	uint32_t Done;		//Elementos recibidos o lecturas validas
+	uint32_t Cuts;		//Interrupciones con el principal dentro de la cola o del seqlock
+	uint32_t Missed;	//Intentos con la cola llena o lecturas invalidas
+	uint32_t Errors;	//Elementos fuera de orden o dañados, lecturas mezcladas
+	SIM_END_t End;
+}RESULT_t;
+
+/*------------------------------------------------------------------------------
+DECLARACION DE FUNCIONES LOCALES:
+------------------------------------------------------------------------------*/
+void* SIM_COPY(void* Dst, const void* Src, size_t Size);
+int QUEUE_ISR_TO_MAIN(void);
+int QUEUE_MAIN_TO_ISR(void);
+int SEQLOCK_ISR_TO_MAIN(void);
+int SEQLOCK_MAIN_TO_ISR(void);
+void START_ISR(MODE_t Mode);
+void STOP_ISR(void);
+uint32_t RANDOM(uint32_t Max);
+void SPIN(uint32_t Calls);
+void SPIN_STEP(void);
+void MAKE_ITEM(ITEM_t* Item, uint32_t Seq);
+uint8_t CHECK_ITEM(const ITEM_t* Item, uint32_t Seq);
+void MAKE_STATE(STATE_t* State, uint32_t Count);
+uint8_t CHECK_STATE(const STATE_t* State, uint32_t* Last);
+
+/*------------------------------------------------------------------------------
+VARIABLES GLOBALES:
+------------------------------------------------------------------------------*/
+//Cola y seqlock bajo prueba:
+ITEM_t Buffer[Stress_Queue];
+SPSC_t Queue;
+STATE_t Shared;
+SEQLOCK_t Lock;
+
+//Trabajo de la interrupcion y contadores de los dos lados:
+volatile MODE_t Mode = MODE_OFF;
+volatile uint32_t Sent = 0;
+volatile uint32_t Received = 0;
+volatile uint32_t Written = 0;
+volatile uint32_t Reads = 0;
+volatile uint32_t Failed = 0;
+volatile uint32_t Errors = 0;
+volatile uint8_t Inside = 0;
+volatile uint32_t Cuts = 0;
+uint32_t IsrLast = 0;
+
+//Generador pseudoaleatorio (congruencial), comun a los dos lados:
+uint32_t Seed = 12345;
+
+RESULT_t Results[] = {
+		{ "Cola ISR -> main"   , 0, 0, 0, 0, SIM_END_TIME },
+		{ "Cola main -> ISR"   , 0, 0, 0, 0, SIM_END_TIME },
+		{ "Seqlock ISR -> main", 0, 0, 0, 0, SIM_END_TIME },
+		{ "Seqlock main -> ISR", 0, 0, 0, 0, SIM_END_TIME } };
+
+int (* const Cases[])(void) = { QUEUE_ISR_TO_MAIN, QUEUE_MAIN_TO_ISR, SEQLOCK_ISR_TO_MAIN, SEQLOCK_MAIN_TO_ISR };
+
+int main(void)
+{
+/*------------------------------------------------------------------------------
+VARIABLES LOCALES:
+------------------------------------------------------------------------------*/
+	RESULT_t* Result;
+	uint8_t Ok = 1, i;
+
+	printf("%-20s %9s %9s %9s %8s\n", "", "Hechos", "Cortes", "Fallidos", "Errores");
+	for (i = 0; i < sizeof(Results) / sizeof(Results[0]); i++) {
+		Result = &Results[i];
+
+		//Cada caso desde el reset, con la cola y el seqlock vacios:
+		SIM_INIT();
+		SystemInit();
+		INIT_SPSC(&Queue, TSPSC_BUFFER(Buffer));
+		memset(&Shared, 0, sizeof(Shared));
+		Lock.Seq = 0;
+		Sent = Received = Written = Reads = Failed = Errors = IsrLast = Cuts = 0;
+
+		Result->End = SIM_RUN(Cases[i], Stress_Limit);
+		Result->Done = (i < 2) ? Received : Reads;
+		Result->Cuts = Cuts;
+		Result->Missed = (i < 2) ? Queue.Lost : Failed;
+		Result->Errors = Errors;
+
+		printf("%-20s %9lu %9lu %9lu %8lu%s\n", Result->Name, (unsigned long) Result->Done,
+				(unsigned long) Result->Cuts, (unsigned long) Result->Missed, (unsigned long) Result->Errors,
+				Result->End != SIM_END_RETURN ? "  <- no termino" : Result->Cuts == 0 ? "  <- sin cortes" : "");
+
+		if (Result->End != SIM_END_RETURN || Result->Errors || Result->Cuts == 0 || Result->Done == 0)
+			Ok = 0;
+		if (i < 2 && Received != Stress_Items)
+			Ok = 0;
+	}
+
+	printf("\n%s\n", Ok ? "OK" : "FALLO");
+	return Ok ? 0 : 1;
+}
+
+/*------------------------------------------------------------------------------
+CASOS (corren en el micro simulado):
+------------------------------------------------------------------------------*/
+//Productor en la interrupcion: el principal consume con esperas al azar, la cola se llena:
+int QUEUE_ISR_TO_MAIN(void)
+{
+	ITEM_t Item;
+
+	START_ISR(MODE_PRODUCER);
+	while (Received < Stress_Items) {
+		Inside = 1;
+		if (GET_SPSC(&Queue, &Item)) {
+			Inside = 0;
+			if (!CHECK_ITEM(&Item, Received))
+				Errors++;
+			Received = Item.Seq + 1;
+		}
+		Inside = 0;
+		SPIN(RANDOM(Stress_Spin));
+	}
+	STOP_ISR();
+
+	return 0;
+}
+
+//Productor en el principal (reintenta si la cola esta llena), consumidor en la interrupcion:
+int QUEUE_MAIN_TO_ISR(void)
+{
+	ITEM_t Item;
+	uint8_t Put;
+
+	START_ISR(MODE_CONSUMER);
+	while (Sent < Stress_Items) {
+		MAKE_ITEM(&Item, Sent);
+		Inside = 1;
+		Put = PUT_SPSC(&Queue, &Item);
+		Inside = 0;
+		if (Put)
+			Sent++;
+		SPIN(RANDOM(Stress_Spin));
+	}
+	while (Received < Sent)
+		SPIN(1);
+	STOP_ISR();
+
+	return 0;
+}
+
+//Escritor en la interrupcion: el principal reintenta hasta leer una copia valida:
+int SEQLOCK_ISR_TO_MAIN(void)
+{
+	STATE_t Copy;
+	uint32_t Last = 0;
+	uint8_t Read;
+
+	START_ISR(MODE_WRITER);
+	while (Last < Stress_Items) {
+		Inside = 1;
+		Read = READ_SEQLOCK(&Lock, &Copy, &Shared, sizeof(Copy));
+		Inside = 0;
+		if (Read) {
+			Reads++;
+			if (!CHECK_STATE(&Copy, &Last))
+				Errors++;
+		}
+		else
+			Failed++;
+		SPIN(RANDOM(Stress_Spin / 10));
+	}
+	STOP_ISR();
+
+	return 0;
+}
+
+//Escritor en el principal: la interrupcion lee una vez y, si corto a la escritura, no reintenta:
+int SEQLOCK_MAIN_TO_ISR(void)
+{
+	STATE_t State;
+
+	START_ISR(MODE_READER);
+	while (Written < Stress_Items) {
+		MAKE_STATE(&State, ++Written);
+		Inside = 1;
+		WRITE_SEQLOCK(&Lock, &Shared, &State, sizeof(State));
+		Inside = 0;
+		SPIN(RANDOM(Stress_Spin / 10));
+	}
+	STOP_ISR();
+
+	return 0;
+}
+
+/*------------------------------------------------------------------------------
+INTERRUPCION:
+------------------------------------------------------------------------------*/
+void TIM6_DAC_IRQHandler(void)
+{
+	ITEM_t Item;
+	STATE_t State;
+	uint8_t n;
+
+	TIM_ClearITPendingBit(TIM6, TIM_IT_Update);
+	if (Inside)
+		Cuts++;
+
+	switch (Mode) {
+	case MODE_PRODUCER:
+		if (Sent < Stress_Items) {
+			MAKE_ITEM(&Item, Sent);
+			if (PUT_SPSC(&Queue, &Item))
+				Sent++;
+		}
+		break;
+	case MODE_CONSUMER:
+		for (n = RANDOM(3); n < 3 && GET_SPSC(&Queue, &Item); n++) {
+			if (!CHECK_ITEM(&Item, Received))
+				Errors++;
+			Received = Item.Seq + 1;
+		}
+		break;
+	case MODE_WRITER:
+		if (Written < Stress_Items) {
+			MAKE_STATE(&State, ++Written);
+			WRITE_SEQLOCK(&Lock, &Shared, &State, sizeof(State));
+		}
+		break;
+	case MODE_READER:
+		if (READ_SEQLOCK(&Lock, &State, &Shared, sizeof(State))) {
+			Reads++;
+			if (!CHECK_STATE(&State, &IsrLast))
+				Errors++;
+		}
+		else
+			Failed++;
+		break;
+	default:
+		break;
+	}
+
+	//Proximo disparo a un tiempo al azar (sin precarga, vale desde este periodo):
+	TIM_SetAutoreload(TIM6, Stress_ArrMin + RANDOM(Stress_ArrMax - Stress_ArrMin));
+}
+
+void START_ISR(MODE_t NewMode)
+{
+	TIM_TimeBaseInitTypeDef TIM_BaseStructure;
+
+	RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM6, ENABLE);
+	TIM_BaseStructure.TIM_Period = Stress_ArrMax;
+	TIM_BaseStructure.TIM_Prescaler = 0;
+	TIM_BaseStructure.TIM_ClockDivision = 0;
+	TIM_BaseStructure.TIM_CounterMode = TIM_CounterMode_Up;
+	TIM_BaseStructure.TIM_RepetitionCounter = 0;
+	TIM_TimeBaseInit(TIM6, &TIM_BaseStructure);
+	TIM_ClearITPendingBit(TIM6, TIM_IT_Update);
+	TIM_ITConfig(TIM6, TIM_IT_Update, ENABLE);
+
+	Mode = NewMode;
+	NVIC_SetPriority(TIM6_DAC_IRQn, 1);
+	NVIC_EnableIRQ(TIM6_DAC_IRQn);
+	TIM_Cmd(TIM6, ENABLE);
+}
+
+void STOP_ISR(void)
+{
+	TIM_Cmd(TIM6, DISABLE);
+	NVIC_DisableIRQ(TIM6_DAC_IRQn);
+	Mode = MODE_OFF;
+}
+
+/*------------------------------------------------------------------------------
+FUNCIONES AUXILIARES:
+------------------------------------------------------------------------------*/
+//memcpy de la biblioteca en esta prueba: cada byte es un punto donde puede entrar la interrupcion:
+void* SIM_COPY(void* Dst, const void* Src, size_t Size)
+{
+	uint8_t* To = Dst;
+	const uint8_t* From = Src;
+
+	while (Size--) {
+		*To++ = *From++;
+		SIM_BARRIER();
+	}
+
+	return Dst;
+}
+
+uint32_t RANDOM(uint32_t Max)
+{
+	Seed = Seed * 1103515245 + 12345;
+	return Max ? (Seed >> 16) % Max : 0;
+}
+
+//Espera del principal: cada llamada avanza el reloj y deja entrar a la interrupcion:
+void SPIN(uint32_t Calls)
+{
+	while (Calls--)
+		SPIN_STEP();
+}
+
+void SPIN_STEP(void)
+{
+}
+
+void MAKE_ITEM(ITEM_t* Item, uint32_t Seq)
+{
+	uint8_t i;
+
+	Item->Seq = Seq;
+	Item->Check = Seq * 2654435761u;
+	for (i = 0; i < sizeof(Item->Pad); i++)
+		Item->Pad[i] = (uint8_t) (Seq + i);
+}
+
+//Elemento sano y en orden (los descartados por cola llena se reintentan, no dejan huecos):
+uint8_t CHECK_ITEM(const ITEM_t* Item, uint32_t Seq)
+{
+	ITEM_t Expected;
+
+	MAKE_ITEM(&Expected, Seq);
+	return memcmp(Item, &Expected, sizeof(Expected)) == 0;
+}
+
+void MAKE_STATE(STATE_t* State, uint32_t Count)
+{
+	uint8_t i;
+
+	for (i = 0; i < sizeof(State->Value) / sizeof(State->Value[0]); i++)
+		State->Value[i] = Count;
+}
+
+//Copia de una sola escritura y no anterior a la ultima leida:
+uint8_t CHECK_STATE(const STATE_t* State, uint32_t* Last)
+{
+	uint8_t i;
+
+	for (i = 1; i < sizeof(State->Value) / sizeof(State->Value[0]); i++)
+		if (State->Value[i] != State->Value[0])
+			return 0;
+	if (State->Value[0] < *Last)
+		return 0;
+
+	*Last = State->Value[0];
+	return 1;
+}
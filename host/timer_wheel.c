@@ -0,0 +1,162 @@
+/**********
+  * @file    timer_wheel.c
+  * @author  A. Riedinger.
+  * @brief   Prueba de la rueda de timers por software (START_TIMER,
+  *          STOP_TIMER y TICK_TIMERS) en la simulacion en PC:
+  *          - One-shots a distancias que caen en cada nivel de la rueda y en
+  *            sus bordes (63/64, 4095/4096...), y uno mas alla del alcance
+  *            (se limita y no vence dentro de la prueba).
+  *          - Periodicos de 1 tick y de una vuelta justa del nivel 0 (64).
+  *          - Un timer que se rearranca con Delay 0 desde su funcion.
+  *          - Un timer que detiene a otro de la misma ranura antes de que corra.
+  *
+  * CONTROLES:
+  	  * Cada timer vence en el tick exacto y las veces que corresponde.
+  	  * El rearranque con Delay 0 corre una sola vez por tick (sin quedar
+  	    atrapado dentro de TICK_TIMERS).
+  	  * El timer detenido no corre.
+  	  * Sale con 0 si todos los controles dan bien.
+**********/
+
+/*------------------------------------------------------------------------------
+LIBRERIAS:
+------------------------------------------------------------------------------*/
+#include "sim.h"
+
+/*------------------------------------------------------------------------------
+DEFINICIONES:
+------------------------------------------------------------------------------*/
+//Ticks de la prueba (pasa el borde del nivel 2, 2^18):
+#define Wheel_Ticks 270000
+
+//Tiempo maximo de la corrida [mseg] (la prueba usa unos 150):
+#define Wheel_Limit 300
+
+//Un timer bajo prueba y lo que vio:
+typedef struct {
+	const char* Name;
+	TIMER_t Timer;
+	uint32_t Delay;		//Delay de START_TIMER
+	uint32_t Expected;	//Vencimientos esperados en Wheel_Ticks
+	uint32_t First;		//Tick esperado del primer vencimiento
+	uint32_t Count;		//Vencimientos
+	uint32_t Errors;	//Vencimientos fuera de tick o repetidos en un tick
+	uint32_t Last;		//Tick del ultimo vencimiento
+}CASE_t;
+
+/*------------------------------------------------------------------------------
+DECLARACION DE FUNCIONES LOCALES:
+------------------------------------------------------------------------------*/
+int WHEEL(void);
+void FIRED(void* Arg);
+void REARM(void* Arg);
+void STOPPER(void* Arg);
+
+/*------------------------------------------------------------------------------
+VARIABLES GLOBALES:
+------------------------------------------------------------------------------*/
+//Tick que esta atendiendo TICK_TIMERS:
+uint32_t Tick = 0;
+
+CASE_t Cases[] = {
+		{ "One-shot 0"      , { FIRED  , &Cases[0] , 0  },      0,     1,      0 },
+		{ "One-shot 1"      , { FIRED  , &Cases[1] , 0  },      1,     1,      1 },
+		{ "One-shot 63"     , { FIRED  , &Cases[2] , 0  },     63,     1,     63 },
+		{ "One-shot 64"     , { FIRED  , &Cases[3] , 0  },     64,     1,     64 },
+		{ "One-shot 65"     , { FIRED  , &Cases[4] , 0  },     65,     1,     65 },
+		{ "One-shot 4095"   , { FIRED  , &Cases[5] , 0  },   4095,     1,   4095 },
+		{ "One-shot 4096"   , { FIRED  , &Cases[6] , 0  },   4096,     1,   4096 },
+		{ "One-shot 262145" , { FIRED  , &Cases[7] , 0  }, 262145,     1, 262145 },
+		{ "Periodo 1"       , { FIRED  , &Cases[8] , 1  },      5, Wheel_Ticks - 5, 5 },
+		{ "Periodo 64"      , { FIRED  , &Cases[9] , 64 },      3, (Wheel_Ticks - 3 + 63) / 64, 3 },
+		{ "Delay 0 en FUNC" , { REARM  , &Cases[10], 0  },      7, Wheel_Ticks - 7, 7 },
+		{ "Fuera de alcance", { FIRED  , &Cases[11], 0  }, 0xFFFFFFFF, 0,      0 },
+		{ "Detenido"        , { FIRED  , &Cases[12], 0  },     10,     0,      0 },
+		{ "Detiene al otro" , { STOPPER, &Cases[13], 0  },     10,     1,     10 } };
+
+#define CASES (sizeof(Cases) / sizeof(Cases[0]))
+
+int main(void)
+{
+/*------------------------------------------------------------------------------
+VARIABLES LOCALES:
+------------------------------------------------------------------------------*/
+	SIM_END_t End;
+	CASE_t* Case;
+	uint8_t Ok = 1, i;
+
+	SIM_INIT();
+	End = SIM_RUN(WHEEL, Wheel_Limit);
+
+/*------------------------------------------------------------------------------
+INFORME:
+------------------------------------------------------------------------------*/
+	printf("%-16s %8s %8s %8s\n", "", "Vencidos", "Esperado", "Errores");
+	for (i = 0; i < CASES; i++) {
+		Case = &Cases[i];
+		printf("%-16s %8lu %8lu %8lu%s\n", Case->Name, (unsigned long) Case->Count,
+				(unsigned long) Case->Expected, (unsigned long) Case->Errors,
+				Case->Count != Case->Expected || Case->Errors ? "  <- mal" : "");
+		if (Case->Count != Case->Expected || Case->Errors)
+			Ok = 0;
+	}
+
+/*------------------------------------------------------------------------------
+CONTROLES:
+------------------------------------------------------------------------------*/
+	if (End != SIM_END_RETURN) {
+		printf("ERROR: TICK_TIMERS no termino (tick %lu)\n", (unsigned long) Tick);
+		Ok = 0;
+	}
+
+	printf("\n%s\n", Ok ? "OK" : "FALLO");
+	return Ok ? 0 : 1;
+}
+
+/*------------------------------------------------------------------------------
+PRUEBA (corre en el micro simulado):
+------------------------------------------------------------------------------*/
+int WHEEL(void)
+{
+	uint8_t i;
+
+	SystemInit();
+	INIT_TIMERS();
+
+	//El ultimo queda primero en su ranura y detiene al anterior antes de que corra:
+	for (i = 0; i < CASES; i++)
+		START_TIMER(&Cases[i].Timer, Cases[i].Delay);
+
+	for (Tick = 0; Tick < Wheel_Ticks; Tick++)
+		TICK_TIMERS();
+
+	return 0;
+}
+
+//Vencimiento: en el tick esperado y como mucho uno por tick:
+void FIRED(void* Arg)
+{
+	CASE_t* Case = Arg;
+	uint32_t Expected = Case->Count ? Case->Last + (Case->Timer.TIMER_PERIOD ? Case->Timer.TIMER_PERIOD : 1) : Case->First;
+
+	if (Tick != Expected)
+		Case->Errors++;
+	Case->Last = Tick;
+	Case->Count++;
+}
+
+//Se rearranca con Delay 0: tiene que volver en el tick siguiente, no en este:
+void REARM(void* Arg)
+{
+	CASE_t* Case = Arg;
+
+	FIRED(Case);
+	START_TIMER(&Case->Timer, 0);
+}
+
+//Detiene al de la misma ranura que todavia no corrio:
+void STOPPER(void* Arg)
+{
+	FIRED(Arg);
+	STOP_TIMER(&Cases[12].Timer);
+}
@@ -0,0 +1,940 @@
+/**********
+  * @file    cmsis_os.c
+  * @author  A. Riedinger.
+  * @version 0.1
+  * @brief   Nucleo apropiativo minimo para la API CMSIS-RTOS (cmsis_os.h).
+  *
+  * Implementa:
+  	  * Kernel:    osKernelInitialize, osKernelStart, osKernelRunning, osKernelSysTick
+  	  * Threads:   osThreadCreate, osThreadGetId, osThreadTerminate, osThreadYield,
+  	  *            osThreadSetPriority, osThreadGetPriority, osDelay
+  	  * Semaforos: osSemaphoreCreate, osSemaphoreWait, osSemaphoreRelease, osSemaphoreDelete
+  	  * Mensajes:  osMessageCreate, osMessagePut, osMessageGet
+  *
+  * Planificacion por prioridad fija, round-robin entre threads de igual
+  * prioridad en cada tick (1 ms del SysTick). El cambio de contexto se hace en
+  * el PendSV a la menor prioridad, guardando S16..S31 solo si el thread uso la
+  * FPU (el resto lo apila el hardware en forma diferida, lazy stacking). El
+  * main pasa a ser un thread de prioridad normal en osKernelStart.
+  *
+  * Los objetos salen de tablas estaticas (OS_MAX_*) y las pilas de un unico
+  * bloque (OS_STACK_POOL): no hay malloc y lo creado no se libera.
+  *
+  * Solo se compila con Use_RTOS en 1 (mi_libreria.h). Con 0 el SysTick y el
+  * PendSV son los de stm32f4xx_it.c (TICK_SCHED y RUN_DEFER).
+**********/
+
+/*------------------------------------------------------------------------------
+LIBRERIAS:
+------------------------------------------------------------------------------*/
+#include "mi_libreria.h"
+#include "cmsis_os.h"
+
+#if Use_RTOS
+
+/*------------------------------------------------------------------------------
+DEFINICIONES:
+------------------------------------------------------------------------------*/
+#define OS_TICK_HZ          1000  // Frecuencia del tick del kernel [Hz]
+#define OS_MAX_THREADS         8  // Threads, incluidos el main y el idle
+#define OS_STACK_POOL       6144  // Memoria para las pilas de todos los threads [bytes]
+#define OS_STACK_DEFAULT     512  // Pila con stacksize = 0 [bytes]
+#define OS_STACK_IDLE        256  // Pila del thread idle [bytes]
+#define OS_STACK_HANDLER    1024  // Pila de las interrupciones (MSP) [bytes]
+#define OS_MAX_SEMAPHORES      8
+#define OS_MAX_MESSAGEQS       4
+#define OS_MESSAGE_POOL       64  // Mensajes de todas las colas [palabras]
+
+//Estados de un thread:
+#define OS_FREE      0
+#define OS_READY     1
+#define OS_BLOCKED   2
+
+//Marco inicial de la pila: R4..R11 y EXC_RETURN (software), R0..R3, R12, LR, PC, xPSR (hardware):
+#define OS_FRAME_WORDS     17
+#define OS_EXC_RETURN      0xFFFFFFFD  // Vuelta a modo thread con PSP, sin contexto de FPU
+#define OS_XPSR_THUMB      0x01000000
+
+/*------------------------------------------------------------------------------
+ESTRUCTURAS:
+------------------------------------------------------------------------------*/
+struct os_thread_cb {
+  uint32_t* Sp;           // Pila guardada (debe ser el primer campo, lo usa el PendSV)
+  osPriority Priority;
+  uint8_t State;
+  uint8_t Timed;          // Bloqueado con timeout en Wake
+  uint32_t Wake;          // Tick de desbloqueo
+  void* WaitObj;          // Objeto esperado (semaforo o cola)
+  osStatus Result;        // osOK = despertado por el objeto, osEventTimeout = vencio el tiempo
+};
+
+struct os_semaphore_cb {
+  uint8_t Used;
+  int32_t Count;
+};
+
+struct os_messageQ_cb {
+  uint32_t* Buffer;
+  uint32_t Size;
+  volatile uint32_t Head;
+  volatile uint32_t Tail;
+  volatile uint32_t Count;
+};
+
+/*------------------------------------------------------------------------------
+DECLARACION DE FUNCIONES INTERNAS:
+------------------------------------------------------------------------------*/
+osThreadId P_OS_NewThread(os_pthread Func, void* Arg, osPriority Priority, uint32_t StackSize);
+void P_OS_ThreadExit(void);
+void P_OS_Idle(void const* Arg);
+void P_OS_Schedule(uint8_t Slice);
+osStatus P_OS_Block(void* WaitObj, uint32_t Deadline, uint8_t Timed);
+void P_OS_Wake(void* WaitObj);
+uint8_t P_OS_InISR(void);
+
+/*------------------------------------------------------------------------------
+VARIABLES INTERNAS:
+------------------------------------------------------------------------------*/
+//Threads - Bloques de control, el actual y el elegido para el proximo PendSV:
+static struct os_thread_cb OS_Threads[OS_MAX_THREADS];
+struct os_thread_cb* volatile OS_Current = NULL;
+struct os_thread_cb* volatile OS_Next = NULL;
+
+//Threads - Pilas (alineadas a 8 bytes segun el AAPCS) y pila de las interrupciones:
+static uint64_t OS_StackPool[OS_STACK_POOL / 8];
+static uint32_t OS_StackUsed = 0;
+static uint64_t OS_HandlerStack[OS_STACK_HANDLER / 8];
+
+//Kernel - Ticks de 1 ms desde osKernelStart:
+static volatile uint32_t OS_Ticks = 0;
+static uint8_t OS_Running = 0;
+
+//Semaforos y colas de mensajes:
+static struct os_semaphore_cb OS_Semaphores[OS_MAX_SEMAPHORES];
+static struct os_messageQ_cb OS_MessageQs[OS_MAX_MESSAGEQS];
+static uint8_t OS_MessageQAnz = 0;
+static uint32_t OS_MessagePool[OS_MESSAGE_POOL];
+static uint32_t OS_MessageUsed = 0;
+
+//Thread idle, corre cuando no hay otro listo:
+osThreadDef(P_OS_Idle, osPriorityIdle, 1, OS_STACK_IDLE);
+
+/*****************************************************************************
+osKernelInitialize
+
+	* @author	A. Riedinger.
+	* @brief	Inicializa las tablas del kernel y crea el thread idle. Se llama
+				una vez, antes de crear threads y objetos.
+	* @returns
+		- osOK		Kernel listo.
+		- osErrorISR	Llamada desde una interrupcion.
+	* @ej
+		- osKernelInitialize();
+******************************************************************************/
+osStatus osKernelInitialize(void)
+{
+	uint8_t i;
+
+	if (P_OS_InISR())
+		return osErrorISR;
+
+	for (i = 0; i < OS_MAX_THREADS; i++)
+		OS_Threads[i].State = OS_FREE;
+	for (i = 0; i < OS_MAX_SEMAPHORES; i++)
+		OS_Semaphores[i].Used = 0;
+	OS_StackUsed = 0;
+	OS_MessageQAnz = 0;
+	OS_MessageUsed = 0;
+	OS_Ticks = 0;
+	OS_Running = 0;
+
+	osThreadCreate(osThread(P_OS_Idle), NULL);
+	return osOK;
+}
+
+
+
+/*****************************************************************************
+osKernelStart
+
+	* @author	A. Riedinger.
+	* @brief	Arranca el kernel: el main sigue como thread de prioridad normal
+				sobre la PSP, las interrupciones pasan a una pila propia (MSP),
+				el SysTick da el tick de 1 ms y el PendSV (menor prioridad)
+				hace los cambios de contexto.
+	* @returns
+		- osOK		Kernel corriendo, el main ya es un thread.
+		- osErrorISR	Llamada desde una interrupcion.
+		- osErrorOS		Sin lugar para el thread del main.
+	* @ej
+		- osKernelStart();
+******************************************************************************/
+osStatus osKernelStart(void)
+{
+	struct os_thread_cb* Main = NULL;
+	uint8_t i;
+
+	if (P_OS_InISR())
+		return osErrorISR;
+
+	for (i = 0; i < OS_MAX_THREADS && Main == NULL; i++)
+		if (OS_Threads[i].State == OS_FREE)
+			Main = &OS_Threads[i];
+	if (Main == NULL)
+		return osErrorOS;
+
+	Main->Priority = osPriorityNormal;
+	Main->State = OS_READY;
+	Main->Timed = 0;
+	Main->WaitObj = NULL;
+
+	//PendSV a la menor prioridad, SysTick justo encima:
+	NVIC_SetPriority(PendSV_IRQn, (1 << __NVIC_PRIO_BITS) - 1);
+	NVIC_SetPriority(SysTick_IRQn, (1 << __NVIC_PRIO_BITS) - 2);
+
+	//El main sigue en la misma pila pero como PSP; las interrupciones a la suya:
+	__disable_irq();
+	__set_PSP(__get_MSP());
+	__set_CONTROL(__get_CONTROL() | 0x02);
+	__ISB();
+	__set_MSP((uint32_t) &OS_HandlerStack[OS_STACK_HANDLER / 8]);
+	OS_Current = Main;
+	OS_Next = Main;
+	OS_Running = 1;
+
+	SystemCoreClockUpdate();
+	SysTick_Config(SystemCoreClock / OS_TICK_HZ);
+	__enable_irq();
+
+	return osOK;
+}
+
+
+
+/*****************************************************************************
+osKernelRunning
+
+	* @author	A. Riedinger.
+	* @brief	Indica si el kernel ya arranco.
+	* @returns
+		- 1		Kernel corriendo.
+		- 0		Antes de osKernelStart.
+	* @ej
+		- if (osKernelRunning()) osDelay(10);
+******************************************************************************/
+int32_t osKernelRunning(void)
+{
+	return OS_Running;
+}
+
+
+
+/*****************************************************************************
+osKernelSysTick
+
+	* @author	A. Riedinger.
+	* @brief	Tiempo del kernel en unidades de osKernelSysTickFrequency,
+				armado con los ticks de 1 ms y la cuenta del SysTick.
+	* @returns
+		- Time		Tiempo actual (da la vuelta a los 2^32).
+	* @ej
+		- Start = osKernelSysTick();
+******************************************************************************/
+uint32_t osKernelSysTick(void)
+{
+	uint32_t Ticks, Count, Load = SysTick->LOAD + 1;
+
+	//Si el SysTick dio la vuelta entre las lecturas se repite:
+	do {
+		Ticks = OS_Ticks;
+		Count = Load - SysTick->VAL;
+	} while (Ticks != OS_Ticks);
+
+	return Ticks * (osKernelSysTickFrequency / OS_TICK_HZ) +
+			(uint32_t) (((uint64_t) Count * (osKernelSysTickFrequency / OS_TICK_HZ)) / Load);
+}
+
+
+
+/*****************************************************************************
+osThreadCreate
+
+	* @author	A. Riedinger.
+	* @brief	Crea un thread listo para correr. Si tiene mas prioridad que el
+				actual, lo desplaza en el momento.
+	* @returns
+		- Id		Thread creado.
+		- NULL		Sin lugar en OS_MAX_THREADS u OS_STACK_POOL.
+	* @param
+		- thread_def	Definicion hecha con osThreadDef (stacksize 0 = OS_STACK_DEFAULT).
+		- argument		Argumento del thread.
+	* @ej
+		- osThreadCreate(osThread(TASK_THREAD), &Tasks[0]);
+******************************************************************************/
+osThreadId osThreadCreate(const osThreadDef_t* thread_def, void* argument)
+{
+	osThreadId Thread;
+
+	if (thread_def == NULL || P_OS_InISR())
+		return NULL;
+
+	Thread = P_OS_NewThread(thread_def->pthread, argument, thread_def->tpriority, thread_def->stacksize);
+	if (Thread != NULL && OS_Running)
+		P_OS_Schedule(0);
+
+	return Thread;
+}
+
+
+
+/*****************************************************************************
+osThreadGetId
+
+	* @author	A. Riedinger.
+	* @brief	Thread que esta corriendo.
+	* @returns
+		- Id		Thread actual (NULL antes de osKernelStart).
+	* @ej
+		- Self = osThreadGetId();
+******************************************************************************/
+osThreadId osThreadGetId(void)
+{
+	return OS_Current;
+}
+
+
+
+/*****************************************************************************
+osThreadTerminate
+
+	* @author	A. Riedinger.
+	* @brief	Termina un thread. Su pila no se recupera. Un thread que vuelve
+				de su funcion termina igual.
+	* @returns
+		- osOK				Thread terminado (si es el actual, no vuelve).
+		- osErrorParameter	Id invalido o thread idle.
+		- osErrorISR		Llamada desde una interrupcion.
+	* @param
+		- thread_id		Thread a terminar.
+	* @ej
+		- osThreadTerminate(osThreadGetId());
+******************************************************************************/
+osStatus osThreadTerminate(osThreadId thread_id)
+{
+	if (P_OS_InISR())
+		return osErrorISR;
+	if (thread_id == NULL || thread_id->State == OS_FREE || thread_id->Priority == osPriorityIdle)
+		return osErrorParameter;
+
+	__disable_irq();
+	thread_id->State = OS_FREE;
+	P_OS_Schedule(0);
+	__enable_irq();
+
+	return osOK;
+}
+
+
+
+/*****************************************************************************
+osThreadYield
+
+	* @author	A. Riedinger.
+	* @brief	Cede la CPU al proximo thread listo de igual prioridad.
+	* @returns
+		- osOK			Listo.
+		- osErrorISR	Llamada desde una interrupcion.
+	* @ej
+		- osThreadYield();
+******************************************************************************/
+osStatus osThreadYield(void)
+{
+	if (P_OS_InISR())
+		return osErrorISR;
+
+	P_OS_Schedule(1);
+	return osOK;
+}
+
+
+
+/*****************************************************************************
+osThreadSetPriority
+
+	* @author	A. Riedinger.
+	* @brief	Cambia la prioridad de un thread y replanifica.
+	* @returns
+		- osOK				Listo.
+		- osErrorParameter	Id invalido.
+		- osErrorValue		Prioridad fuera de rango.
+		- osErrorISR		Llamada desde una interrupcion.
+	* @param
+		- thread_id		Thread.
+		- priority		osPriorityIdle ... osPriorityRealtime.
+	* @ej
+		- osThreadSetPriority(Id, osPriorityHigh);
+******************************************************************************/
+osStatus osThreadSetPriority(osThreadId thread_id, osPriority priority)
+{
+	if (P_OS_InISR())
+		return osErrorISR;
+	if (thread_id == NULL || thread_id->State == OS_FREE)
+		return osErrorParameter;
+	if (priority < osPriorityIdle || priority > osPriorityRealtime)
+		return osErrorValue;
+
+	thread_id->Priority = priority;
+	P_OS_Schedule(0);
+	return osOK;
+}
+
+
+
+/*****************************************************************************
+osThreadGetPriority
+
+	* @author	A. Riedinger.
+	* @brief	Prioridad de un thread.
+	* @returns
+		- Priority		Prioridad actual (osPriorityError si el id es invalido).
+	* @param
+		- thread_id		Thread.
+	* @ej
+		- Prio = osThreadGetPriority(osThreadGetId());
+******************************************************************************/
+osPriority osThreadGetPriority(osThreadId thread_id)
+{
+	if (thread_id == NULL || thread_id->State == OS_FREE)
+		return osPriorityError;
+
+	return thread_id->Priority;
+}
+
+
+
+/*****************************************************************************
+osDelay
+
+	* @author	A. Riedinger.
+	* @brief	Bloquea el thread actual durante la cantidad de ms indicada.
+	* @returns
+		- osEventTimeout	Tiempo cumplido.
+		- osErrorISR		Llamada desde una interrupcion.
+	* @param
+		- millisec		Demora [ms] (0 = solo cede la CPU).
+	* @ej
+		- osDelay(100);
+******************************************************************************/
+osStatus osDelay(uint32_t millisec)
+{
+	if (P_OS_InISR())
+		return osErrorISR;
+
+	//Antes de osKernelStart no hay a quien ceder la CPU:
+	if (!OS_Running) {
+		DELAY_US(millisec * 1000);
+		return osEventTimeout;
+	}
+
+	if (millisec == 0) {
+		P_OS_Schedule(1);
+		return osEventTimeout;
+	}
+
+	__disable_irq();
+	P_OS_Block(NULL, OS_Ticks + millisec, 1);
+	return osEventTimeout;
+}
+
+
+
+/*****************************************************************************
+osSemaphoreCreate
+
+	* @author	A. Riedinger.
+	* @brief	Crea un semaforo con la cantidad inicial de fichas indicada.
+	* @returns
+		- Id		Semaforo creado.
+		- NULL		Sin lugar en OS_MAX_SEMAPHORES o cantidad invalida.
+	* @param
+		- semaphore_def		Definicion hecha con osSemaphoreDef.
+		- count				Fichas iniciales (0 = senal de una interrupcion a un thread).
+	* @ej
+		- Sem = osSemaphoreCreate(osSemaphore(Render), 0);
+******************************************************************************/
+osSemaphoreId osSemaphoreCreate(const osSemaphoreDef_t* semaphore_def, int32_t count)
+{
+	uint8_t i;
+
+	if (P_OS_InISR() || count < 0 || count > osFeature_Semaphore)
+		return NULL;
+
+	for (i = 0; i < OS_MAX_SEMAPHORES; i++)
+		if (!OS_Semaphores[i].Used) {
+			OS_Semaphores[i].Used = 1;
+			OS_Semaphores[i].Count = count;
+			return &OS_Semaphores[i];
+		}
+
+	return NULL;
+}
+
+
+
+/*****************************************************************************
+osSemaphoreWait
+
+	* @author	A. Riedinger.
+	* @brief	Toma una ficha del semaforo, esperando hasta millisec si no hay.
+	* @returns
+		- Tokens	Fichas que habia al tomarla (> 0).
+		- 0			No hubo ficha en el tiempo indicado.
+		- -1		Id invalido o llamada desde una interrupcion.
+	* @param
+		- semaphore_id	Semaforo.
+		- millisec		Espera maxima [ms] (osWaitForever = sin limite).
+	* @ej
+		- osSemaphoreWait(Sem, osWaitForever);
+******************************************************************************/
+int32_t osSemaphoreWait(osSemaphoreId semaphore_id, uint32_t millisec)
+{
+	uint32_t Deadline = OS_Ticks + millisec;
+	int32_t Tokens;
+
+	if (semaphore_id == NULL || !semaphore_id->Used || P_OS_InISR())
+		return -1;
+
+	//Si otro thread se lleva la ficha al despertar, se vuelve a esperar:
+	while (1) {
+		__disable_irq();
+		if (semaphore_id->Count > 0) {
+			Tokens = semaphore_id->Count--;
+			__enable_irq();
+			return Tokens;
+		}
+		if (millisec == 0) {
+			__enable_irq();
+			return 0;
+		}
+		if (P_OS_Block(semaphore_id, Deadline, millisec != osWaitForever) == osEventTimeout)
+			return 0;
+	}
+}
+
+
+
+/*****************************************************************************
+osSemaphoreRelease
+
+	* @author	A. Riedinger.
+	* @brief	Devuelve una ficha y despierta al thread de mayor prioridad que
+				la espera. Puede llamarse desde interrupciones.
+	* @returns
+		- osOK				Listo.
+		- osErrorResource	El semaforo ya tiene osFeature_Semaphore fichas.
+		- osErrorParameter	Id invalido.
+	* @param
+		- semaphore_id	Semaforo.
+	* @ej
+		- osSemaphoreRelease(Sem);
+******************************************************************************/
+osStatus osSemaphoreRelease(osSemaphoreId semaphore_id)
+{
+	uint32_t Primask = __get_PRIMASK();
+
+	if (semaphore_id == NULL || !semaphore_id->Used)
+		return osErrorParameter;
+
+	__disable_irq();
+	if (semaphore_id->Count >= osFeature_Semaphore) {
+		__set_PRIMASK(Primask);
+		return osErrorResource;
+	}
+	semaphore_id->Count++;
+	P_OS_Wake(semaphore_id);
+	__set_PRIMASK(Primask);
+
+	return osOK;
+}
+
+
+
+/*****************************************************************************
+osSemaphoreDelete
+
+	* @author	A. Riedinger.
+	* @brief	Libera el semaforo. Los threads que lo esperan vencen por timeout
+				(o quedan bloqueados si esperaban sin limite).
+	* @returns
+		- osOK				Listo.
+		- osErrorParameter	Id invalido.
+		- osErrorISR		Llamada desde una interrupcion.
+	* @param
+		- semaphore_id	Semaforo.
+	* @ej
+		- osSemaphoreDelete(Sem);
+******************************************************************************/
+osStatus osSemaphoreDelete(osSemaphoreId semaphore_id)
+{
+	if (P_OS_InISR())
+		return osErrorISR;
+	if (semaphore_id == NULL || !semaphore_id->Used)
+		return osErrorParameter;
+
+	semaphore_id->Used = 0;
+	return osOK;
+}
+
+
+
+/*****************************************************************************
+osMessageCreate
+
+	* @author	A. Riedinger.
+	* @brief	Crea una cola de mensajes de 32 bits. La memoria sale de
+				OS_MESSAGE_POOL, el campo pool de la definicion no se usa.
+	* @returns
+		- Id		Cola creada.
+		- NULL		Sin lugar en OS_MAX_MESSAGEQS u OS_MESSAGE_POOL.
+	* @param
+		- queue_def		Definicion hecha con osMessageQDef (item de hasta 4 bytes).
+		- thread_id		No se usa.
+	* @ej
+		- Queue = osMessageCreate(osMessageQ(Keys), NULL);
+******************************************************************************/
+osMessageQId osMessageCreate(const osMessageQDef_t* queue_def, osThreadId thread_id)
+{
+	struct os_messageQ_cb* Queue;
+
+	(void) thread_id;
+	if (queue_def == NULL || queue_def->queue_sz == 0 || queue_def->item_sz > 4 || P_OS_InISR())
+		return NULL;
+	if (OS_MessageQAnz == OS_MAX_MESSAGEQS || OS_MessageUsed + queue_def->queue_sz > OS_MESSAGE_POOL)
+		return NULL;
+
+	Queue = &OS_MessageQs[OS_MessageQAnz++];
+	Queue->Buffer = &OS_MessagePool[OS_MessageUsed];
+	Queue->Size = queue_def->queue_sz;
+	Queue->Head = 0;
+	Queue->Tail = 0;
+	Queue->Count = 0;
+	OS_MessageUsed += queue_def->queue_sz;
+
+	return Queue;
+}
+
+
+
+/*****************************************************************************
+osMessagePut
+
+	* @author	A. Riedinger.
+	* @brief	Agrega un mensaje al final de la cola. Desde una interrupcion
+				millisec debe ser 0.
+	* @returns
+		- osOK					Mensaje encolado.
+		- osErrorResource		Cola llena (millisec = 0).
+		- osErrorTimeoutResource	Cola llena durante millisec.
+		- osErrorParameter		Id invalido o espera desde una interrupcion.
+	* @param
+		- queue_id		Cola.
+		- info			Mensaje.
+		- millisec		Espera maxima si esta llena [ms].
+	* @ej
+		- osMessagePut(Queue, Key, 0);
+******************************************************************************/
+osStatus osMessagePut(osMessageQId queue_id, uint32_t info, uint32_t millisec)
+{
+	uint32_t Primask = __get_PRIMASK();
+	uint32_t Deadline = OS_Ticks + millisec;
+
+	if (queue_id == NULL || (millisec != 0 && P_OS_InISR()))
+		return osErrorParameter;
+
+	while (1) {
+		__disable_irq();
+		if (queue_id->Count < queue_id->Size) {
+			queue_id->Buffer[queue_id->Head] = info;
+			queue_id->Head = (queue_id->Head + 1) % queue_id->Size;
+			queue_id->Count++;
+			//Los que esperan mensajes esperan la cola, los que esperan lugar su Head:
+			P_OS_Wake(queue_id);
+			__set_PRIMASK(Primask);
+			return osOK;
+		}
+		if (millisec == 0) {
+			__set_PRIMASK(Primask);
+			return osErrorResource;
+		}
+		if (P_OS_Block((void*) &queue_id->Head, Deadline, millisec != osWaitForever) == osEventTimeout)
+			return osErrorTimeoutResource;
+	}
+}
+
+
+
+/*****************************************************************************
+osMessageGet
+
+	* @author	A. Riedinger.
+	* @brief	Saca el mensaje mas viejo de la cola, esperando hasta millisec
+				si esta vacia. Desde una interrupcion millisec debe ser 0.
+	* @returns
+		- Event		status = osEventMessage con value.v, osOK si esta vacia
+					(millisec = 0), osEventTimeout u osErrorParameter.
+	* @param
+		- queue_id		Cola.
+		- millisec		Espera maxima [ms] (osWaitForever = sin limite).
+	* @ej
+		- Event = osMessageGet(Queue, osWaitForever);
+******************************************************************************/
+osEvent osMessageGet(osMessageQId queue_id, uint32_t millisec)
+{
+	uint32_t Primask = __get_PRIMASK();
+	uint32_t Deadline = OS_Ticks + millisec;
+	osEvent Event;
+
+	Event.def.message_id = queue_id;
+	Event.value.v = 0;
+
+	if (queue_id == NULL || (millisec != 0 && P_OS_InISR())) {
+		Event.status = osErrorParameter;
+		return Event;
+	}
+
+	while (1) {
+		__disable_irq();
+		if (queue_id->Count > 0) {
+			Event.value.v = queue_id->Buffer[queue_id->Tail];
+			queue_id->Tail = (queue_id->Tail + 1) % queue_id->Size;
+			queue_id->Count--;
+			P_OS_Wake((void*) &queue_id->Head);
+			__set_PRIMASK(Primask);
+			Event.status = osEventMessage;
+			return Event;
+		}
+		if (millisec == 0) {
+			__set_PRIMASK(Primask);
+			Event.status = osOK;
+			return Event;
+		}
+		if (P_OS_Block(queue_id, Deadline, millisec != osWaitForever) == osEventTimeout) {
+			Event.status = osEventTimeout;
+			return Event;
+		}
+	}
+}
+
+
+
+/*****************************************************************************
+SysTick_Handler
+
+	* @author	A. Riedinger.
+	* @brief	Tick del kernel: vence timeouts y reparte la CPU entre threads
+				de igual prioridad.
+******************************************************************************/
+void SysTick_Handler(void)
+{
+	uint8_t i;
+	uint32_t Ticks = ++OS_Ticks;
+
+	if (!OS_Running)
+		return;
+
+	for (i = 0; i < OS_MAX_THREADS; i++)
+		if (OS_Threads[i].State == OS_BLOCKED && OS_Threads[i].Timed &&
+				(int32_t) (Ticks - OS_Threads[i].Wake) >= 0) {
+			OS_Threads[i].State = OS_READY;
+			OS_Threads[i].Result = osEventTimeout;
+		}
+
+	P_OS_Schedule(1);
+}
+
+
+
+/*****************************************************************************
+PendSV_Handler
+
+	* @author	A. Riedinger.
+	* @brief	Primero el trabajo diferido de las interrupciones (DEFER), luego
+				el cambio de contexto de OS_Current a OS_Next. S16..S31 solo se
+				guardan si el thread uso la FPU (bit 4 de EXC_RETURN en 0).
+******************************************************************************/
+__attribute__((naked)) void PendSV_Handler(void)
+{
+	__asm volatile (
+		"	push	{r4, lr}			\n"
+		"	bl		RUN_DEFER			\n"
+		"	pop		{r4, lr}			\n"
+		"	cpsid	i					\n"
+		"	ldr		r3, =OS_Current		\n"
+		"	ldr		r1, [r3]			\n"
+		"	ldr		r2, =OS_Next		\n"
+		"	ldr		r2, [r2]			\n"
+		//Kernel sin arrancar o sin cambio de thread:
+		"	cbz		r1, 1f				\n"
+		"	cmp		r1, r2				\n"
+		"	beq		1f					\n"
+		//Guardado del thread actual en su pila:
+		"	mrs		r0, psp				\n"
+		"	tst		lr, #0x10			\n"
+		"	it		eq					\n"
+		"	vstmdbeq	r0!, {s16-s31}	\n"
+		"	stmdb	r0!, {r4-r11, lr}	\n"
+		"	str		r0, [r1]			\n"
+		//Restauracion del proximo:
+		"	str		r2, [r3]			\n"
+		"	ldr		r0, [r2]			\n"
+		"	ldmia	r0!, {r4-r11, lr}	\n"
+		"	tst		lr, #0x10			\n"
+		"	it		eq					\n"
+		"	vldmiaeq	r0!, {s16-s31}	\n"
+		"	msr		psp, r0				\n"
+		"1:								\n"
+		"	cpsie	i					\n"
+		"	bx		lr					\n"
+		"	.ltorg						\n"
+	);
+}
+
+/*------------------------------------------------------------------------------
+FUNCIONES INTERNAS:
+------------------------------------------------------------------------------*/
+osThreadId P_OS_NewThread(os_pthread Func, void* Arg, osPriority Priority, uint32_t StackSize)
+{
+	struct os_thread_cb* Thread = NULL;
+	uint32_t* Sp;
+	uint8_t i;
+
+	if (StackSize == 0)
+		StackSize = OS_STACK_DEFAULT;
+	//Multiplo de 8 bytes para mantener la alineacion de la pila:
+	StackSize = (StackSize + 7) & ~7;
+	if (Func == NULL || OS_StackUsed + StackSize > OS_STACK_POOL)
+		return NULL;
+
+	__disable_irq();
+	for (i = 0; i < OS_MAX_THREADS && Thread == NULL; i++)
+		if (OS_Threads[i].State == OS_FREE)
+			Thread = &OS_Threads[i];
+	if (Thread == NULL) {
+		__enable_irq();
+		return NULL;
+	}
+	OS_StackUsed += StackSize;
+	Sp = (uint32_t*) ((uint8_t*) OS_StackPool + OS_StackUsed);
+
+	//Marco como si el thread hubiera sido interrumpido justo al entrar a Func:
+	Sp -= OS_FRAME_WORDS;
+	for (i = 0; i < 8; i++)
+		Sp[i] = 0;                           // R4..R11
+	Sp[8] = OS_EXC_RETURN;
+	Sp[9] = (uint32_t) Arg;                  // R0
+	Sp[10] = Sp[11] = Sp[12] = Sp[13] = 0;   // R1, R2, R3, R12
+	Sp[14] = (uint32_t) P_OS_ThreadExit;     // LR: vuelta de Func
+	Sp[15] = (uint32_t) Func;                // PC
+	Sp[16] = OS_XPSR_THUMB;
+
+	Thread->Sp = Sp;
+	Thread->Priority = Priority;
+	Thread->Timed = 0;
+	Thread->WaitObj = NULL;
+	Thread->State = OS_READY;
+	__enable_irq();
+
+	return Thread;
+}
+
+void P_OS_ThreadExit(void)
+{
+	osThreadTerminate(osThreadGetId());
+	while (1);
+}
+
+void P_OS_Idle(void const* Arg)
+{
+	(void) Arg;
+
+	//Sin threads listos se duerme hasta la proxima interrupcion:
+	while (1)
+		__WFI();
+}
+
+void P_OS_Schedule(uint8_t Slice)
+{
+	uint32_t Primask = __get_PRIMASK();
+	struct os_thread_cb* Best = NULL;
+	struct os_thread_cb* Thread;
+	uint8_t i, Start;
+
+	if (!OS_Running)
+		return;
+
+	__disable_irq();
+	//Se recorre desde el siguiente al actual, asi entre iguales se rota en orden:
+	Start = OS_Current - OS_Threads;
+	for (i = 1; i <= OS_MAX_THREADS; i++) {
+		Thread = &OS_Threads[(Start + i) % OS_MAX_THREADS];
+		if (Thread->State == OS_READY && (Best == NULL || Thread->Priority > Best->Priority))
+			Best = Thread;
+	}
+	//Sin Slice el actual sigue si nadie lo supera (sin thread idle tambien):
+	if (Best == NULL || (!Slice && OS_Current->State == OS_READY && OS_Current->Priority >= Best->Priority))
+		Best = OS_Current;
+
+	OS_Next = Best;
+	if (Best != OS_Current)
+		SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+	__set_PRIMASK(Primask);
+}
+
+osStatus P_OS_Block(void* WaitObj, uint32_t Deadline, uint8_t Timed)
+{
+	//Se entra con las interrupciones deshabilitadas y se sale con ellas habilitadas:
+	if (!OS_Running) {
+		__enable_irq();
+		return osEventTimeout;
+	}
+
+	OS_Current->State = OS_BLOCKED;
+	OS_Current->WaitObj = WaitObj;
+	OS_Current->Wake = Deadline;
+	OS_Current->Timed = Timed;
+	OS_Current->Result = osEventTimeout;
+	P_OS_Schedule(0);
+	__enable_irq();
+
+	//El PendSV corre aca; se vuelve cuando el thread esta listo otra vez:
+	__DSB();
+	__ISB();
+
+	return OS_Current->Result;
+}
+
+void P_OS_Wake(void* WaitObj)
+{
+	struct os_thread_cb* Best = NULL;
+	uint8_t i;
+
+	//Se despierta al de mayor prioridad que espera el objeto:
+	for (i = 0; i < OS_MAX_THREADS; i++)
+		if (OS_Threads[i].State == OS_BLOCKED && OS_Threads[i].WaitObj == WaitObj && WaitObj != NULL &&
+				(Best == NULL || OS_Threads[i].Priority > Best->Priority))
+			Best = &OS_Threads[i];
+
+	if (Best != NULL) {
+		Best->State = OS_READY;
+		Best->WaitObj = NULL;
+		Best->Result = osOK;
+		P_OS_Schedule(0);
+	}
+}
+
+uint8_t P_OS_InISR(void)
+{
+	return __get_IPSR() != 0;
+}
+
+#endif //Use_RTOS
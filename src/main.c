@@ -7,6 +7,7 @@
   *
   * SALIDAS:
   	  *	LCD
+  	  * Lazo de latencia - PE5/TIM9_CH1 (vuelve por el EXTI5, sin conectar nada)
   *
   * ENTRADAS:
   	  * UserButton - PC13
@@ -21,13 +22,11 @@
 LIBRERIAS:
 ------------------------------------------------------------------------------*/
 #include "mi_libreria.h"
+#include "cmsis_os.h"
 
 /*------------------------------------------------------------------------------
 DEFINICIONES:
 ------------------------------------------------------------------------------*/
-//Tiempo de interrupcion por Systick - 50mseg:
-#define TimeINT_Systick 0.05
-
 //Parámetros de configuración del TIM3:
 #define Freq 	 4		//Equivalente a 250mseg
 #define TimeBase 200e3
@@ -42,49 +41,154 @@ DEFINICIONES:
 #define C2_Port GPIOC
 #define C2		GPIO_Pin_8
 
-//Ticks del despachador de tareas:
-#define Ticks_Switchs     2
-#define Ticks_TimeIND 	  20
-#define Ticks_Temperature 10
+//Pin libre del lazo de medicion de latencia del EXTI9_5 (TIM9_CH1):
+#define Loop_Port GPIOE
+#define Loop	  GPIO_Pin_5
+
+//Periodos del despachador de tareas (sin ticks, en useg):
+#define Period_Switchs     100000
+#define Period_Timers      10000
+
+//Periodos de los timers por software (en ticks de Period_Timers):
+#define Period_TimeIND 	   100
+#define Period_Temperature 250		//Una conversion cada 2,5seg
+#define Phase_Temperature  5
 
 //Pin de conexion del LM35:
 #define LM35 	  GPIO_Pin_0
 #define LM35_Port GPIOC
 
+//Muestras del buffer circular del LM35 (ADC1 por DMA) y frecuencia de muestreo
+//fija, disparada por el TIM5 [muestras/seg]:
+#define LM35_Samples 64
+#define LM35_Rate    1000
+
+//Filtro CIC del LM35: 2 etapas, una salida cada 64 muestras (15,6 por seg). La suma
+//tiene 12 + 2 * 6 = 24 bits y se dejan 16 (4 bits mas que el ADC):
+#define LM35_Order     2
+#define LM35_Decim     64
+#define LM35_Shift     8
+#define LM35_FullScale (4095 << 4)
+
 //[3] Temperatura maxima medida en grados centrigados:
 #define MAXTempDegrees 206
 
+//Pantalla del LCD: 0 = texto, 1 = temperatura en digitos dobles con barra:
+#define LCD_View 0
+
+//Medicion de tiempos del LCD con el DWT (resultados en las variables Bench*, ver con el debugger):
+#define LCD_Bench 0
+#define LCD_Bench_Runs 32
+
+//Planificacion (Use_RTOS en mi_libreria.h): 0 = despachador sin ticks (TIM2) y dibujo
+//en el PendSV, 1 = threads del kernel CMSIS-RTOS (cmsis_os.c), uno por tarea y otro para el LCD.
+
+//Pulsaciones que entran en la cola del EXTI (potencia de 2):
+#define KeyQueue_Len 16
+
+//Contadores de pulsaciones, solo los escribe SWITCHS:
+typedef struct {
+	uint32_t S1Cont;
+	uint32_t S2Cont;
+	uint32_t S3Cont;
+	uint32_t S4Cont;
+	uint32_t Cont;
+} KEYS_t;
+
+//Estado a mostrar, lo publica el TIM3 y lo lee el dibujo del LCD:
+typedef struct {
+	uint32_t Temp;
+	uint32_t Seg;
+	uint32_t Cont;
+} VIEW_t;
+
 /*------------------------------------------------------------------------------
 DECLARACION DE FUNCIONES LOCALES:
 ------------------------------------------------------------------------------*/
-void REFRESH_LCD(void);
+void DRAW_LCD(void);
 void SWITCHS(void);
-void TIME_IND(void);
-void TEMPERATURE(void);
+void TIME_IND(void* Arg);
+void TEMPERATURE(void* Arg);
+void LM35_SAMPLES(uint16_t* Samples, uint16_t Count);
+#if Use_RTOS
+void TASK_THREAD(void const* argument);
+void RENDER_THREAD(void const* argument);
+#endif
 
 /*------------------------------------------------------------------------------
 VARIABLES GLOBALES:
 ------------------------------------------------------------------------------*/
-//Almacenamiento del valor de temperatura en grados centigrados:
-float TempDegrees;
-
-//Variables del TS:
-uint32_t Switchs;
-uint32_t TimeIND;
-uint32_t Temperature;
-
-//Variables para el conteo de los pulsadores:
-uint32_t S1Cont = 0;
-uint32_t S2Cont = 0;
-uint32_t S3Cont = 0;
-uint32_t S4Cont = 0;
-uint32_t Cont   = 0;
+//Almacenamiento del valor de temperatura en decimas de grado centigrado:
+uint32_t TempDeciDegrees;
+
+//Muestras del LM35, las escribe el DMA sin parar:
+uint16_t LM35Buffer[LM35_Samples];
+
+//Sobremuestreo y decimacion del LM35, todas las muestras pasan por el filtro:
+DECIM_t LM35Filter = { LM35_Order, LM35_Decim, LM35_Shift };
+
+//Copia del estado a mostrar, tomada por el TIM3 para el dibujo diferido:
+VIEW_t View;
+SEQLOCK_t ViewLock;
+
+//Pulsaciones del teclado, del EXTI (productor) a SWITCHS (consumidor):
+uint8_t KeyBuffer[KeyQueue_Len];
+SPSC_t KeyQueue;
+
+//Tabla del TS: se agrega una tarea con una fila nueva, sin tocar el bucle principal:
+SCHED_TASK_t Tasks[] = {
+			// Tarea     ,      Periodo      , Fase , Prioridad
+			{ SWITCHS    , Period_Switchs    ,   0  ,    0 },
+			{ TICK_TIMERS, Period_Timers     ,   0  ,    1 }, };
+
+//Timers por software: lo periodico sin contadores propios ni filas en Tasks:
+TIMER_t TimerTimeIND = { TIME_IND   , NULL, Period_TimeIND     };
+TIMER_t TimerTemp    = { TEMPERATURE, NULL, Period_Temperature };
+
+//Mapa de prioridades del NVIC (0 = la mas alta, 14 y 15 son del SysTick y el PendSV):
+IRQ_PRIO_t IrqPrio[] = {
+			//   Interrupcion   , Prioridad
+#if !Use_RTOS
+			{ TIM2_IRQn         ,    1 },		//Despachador: liberacion de las tareas y del tick de los timers
+#endif
+			{ EXTI9_5_IRQn      ,    2 },		//Teclado: leer F1/F2 antes del proximo cambio de SWITCHS
+			{ TIM3_IRQn         ,    3 },		//Copia del estado a mostrar
+			{ TIM7_IRQn         ,    4 },		//Cola del LCD: solo tiempos minimos, puede atrasarse
+			{ DMA2_Stream0_IRQn ,    5 }, };	//Mitades del buffer del LM35 al filtro
+
+//Tiempos de las interrupciones (las tareas del TS los tienen en Tasks[i].Probe y
+//el TIM2 del despachador en SCHED_Probe). LatencyMax es la peor demora de entrada
+//desde el evento: comparacion del timer (PROBE_TIMER) o flanco del lazo en PE5 (PROBE_LOOP):
+PROBE_t ProbeTIM3;
+PROBE_t ProbeEXTI;
+PROBE_t ProbeRender;
+
+#if Use_RTOS
+//Threads: las tareas del TS (prioridad segun la tabla) y el dibujo del LCD, el mas bajo:
+osThreadDef(TASK_THREAD, osPriorityNormal, 3, 512);
+osThreadDef(RENDER_THREAD, osPriorityLow, 1, 1024);
+osSemaphoreDef(Render);
+osSemaphoreId RenderSem;
+#endif
+
+//Ciclos de CPU dormidos en WFI (carga = 1 - IdleCycles / ciclos transcurridos):
+uint32_t IdleCycles = 0;
+
+//Variables para el conteo de los pulsadores (KeysCount es de SWITCHS, el resto lee Keys):
+KEYS_t KeysCount;
+KEYS_t Keys;
+SEQLOCK_t KeysLock;
 
 //Variables para el cronometro:
 uint32_t Seg = 0;
 
-//Variables de temperatura:
-uint32_t ContTemp = 0;
+#if LCD_Bench
+//Mediciones del LCD: primitivas en modo bloqueante y cuadro completo del TIM3:
+BENCH_t BenchClear;
+BENCH_t BenchPrint;
+BENCH_t BenchRefresh;
+BENCH_t BenchFrame;
+#endif
 
 ////Definicion de los pines del LCD:
 LCD_2X16_t LCD_2X16[] = {
@@ -96,24 +200,70 @@ LCD_2X16_t LCD_2X16[] = {
 			{ TLCD_D6, GPIOF, GPIO_Pin_6,  RCC_AHB1Periph_GPIOF, Bit_RESET },
 			{ TLCD_D7, GPIOF, GPIO_Pin_7,  RCC_AHB1Periph_GPIOF, Bit_RESET }, };
 
+//Display 16x2 con bus de 4 bits:
+LCD_t LCD = { TLCD_PIN_TABLE(LCD_2X16), 16, 2, TLCD_BUS_4BIT };
+
 int main(void)
 {
 /*------------------------------------------------------------------------------
 VARIABLES LOCALES:
 ------------------------------------------------------------------------------*/
+	uint32_t IdleStart;
+#if Use_RTOS
+	osThreadId Thread;
+	uint8_t i;
+#endif
+#if LCD_Bench
+	uint32_t Run;
+#endif
 
 /*------------------------------------------------------------------------------
 CONFIGURACION DEL MICRO:
 ------------------------------------------------------------------------------*/
 	SystemInit();
 
+	//Contador de ciclos del DWT (retardos y medicion del tiempo dormido):
+	INIT_DWT();
+
+	//Prioridades de todas las interrupciones, antes de habilitar cualquiera:
+	INIT_IRQ_PRIO(TIRQ_TABLE(IrqPrio));
+
 	//Inicializacion User LED de prueba como salida digital:
 	INIT_DO(GPIOB, GPIO_Pin_0);
 	INIT_DO(GPIOB, GPIO_Pin_7);
 
 	//Inicializacion del DISPLAY LCD:
-	INIT_LCD_2x16(LCD_2X16);
+	INIT_LCD(&LCD);
+
+#if LCD_Bench
+	//Linea de base de las primitivas, antes de activar la cola (escritura bloqueante):
+	for (Run = 0; Run < LCD_Bench_Runs; Run++) {
+		BENCH_START(&BenchClear);
+		CLEAR_LCD(&LCD);
+		BENCH_STOP(&BenchClear);
+
+		BENCH_START(&BenchPrint);
+		PRINT_LCD(&LCD, 0, 0, "TDII T: 000.0^C");
+		BENCH_STOP(&BenchPrint);
+
+		//Cuadro completo contra un display borrado (peor caso del refresco):
+		CLEAR_LCD(&LCD);
+		CLEAR_FRAME_LCD_2x16();
+		PRINT_FRAME_LCD_2x16(0, 0, "TDII T: 000.0^C");
+		PRINT_FRAME_LCD_2x16(0, 1, "Seg: 00  ind: 00");
+		BENCH_START(&BenchRefresh);
+		REFRESH_LCD(&LCD);
+		BENCH_STOP(&BenchRefresh);
+	}
+	CLEAR_LCD(&LCD);
+#endif
 
+	//Escritura no bloqueante del LCD, despachada por el TIM7:
+	INIT_LCD_QUEUE(&LCD, NULL);
+
+
+	//Cola de pulsaciones, antes de habilitar el EXTI:
+	INIT_SPSC(&KeyQueue, TSPSC_BUFFER(KeyBuffer));
 
 	//Inicializacion de la interrupcion por pulso externo en los pines de lecura del teclado:
 	INIT_EXTINT(C1_Port, C1);
@@ -124,29 +274,67 @@ CONFIGURACION DEL MICRO:
 	//Se setea F1 en 1 para que arranque en un valor logico distinto a F2:
 	GPIO_SetBits(F1_Port, F1);
 
-	//Inicializacion del LM35 como ENTRADA ANALOGICA / ADC1:
-	INIT_ADC(LM35_Port, LM35);
-
-	//Inicializacion de interrupcion por tiempo cada 50 mseg:
-	INIT_SYSTICK(TimeINT_Systick);
+	//Lazo de latencia del EXTI9_5: el TIM9 cambia PE5 y la linea 5 interrumpe:
+	INIT_PROBE_LOOP(Loop_Port, Loop);
+
+	//Inicializacion del LM35 como ENTRADA ANALOGICA / ADC1, muestreo a LM35_Rate por DMA
+	//y cada mitad del buffer al filtro:
+	INIT_DECIM(&LM35Filter);
+	INIT_ADC_DMA(LM35_Port, LM35, LM35Buffer, LM35_Samples, LM35_Rate, LM35_SAMPLES);
+
+	//Timers por software, avanzan con la tarea TICK_TIMERS:
+	INIT_TIMERS();
+	START_TIMER(&TimerTimeIND, 0);
+	START_TIMER(&TimerTemp, Phase_Temperature);
+
+#if Use_RTOS
+	//Un thread por tarea de la tabla, prioridad 0 = osPriorityHigh, y el del LCD:
+	osKernelInitialize();
+	RenderSem = osSemaphoreCreate(osSemaphore(Render), 0);
+	for (i = 0; i < sizeof(Tasks) / sizeof(Tasks[0]); i++) {
+		Thread = osThreadCreate(osThread(TASK_THREAD), &Tasks[i]);
+		osThreadSetPriority(Thread, osPriorityHigh - Tasks[i].TASK_PRIO);
+	}
+	osThreadCreate(osThread(RENDER_THREAD), NULL);
+#else
+	//Despachador de tareas sin ticks: el TIM2 interrumpe solo cuando vence una tarea:
+	INIT_SCHED(TSCHED_TABLE(Tasks));
+	INIT_SCHED_TICKLESS();
+#endif
+
+#if !Use_RTOS
+	//Dibujo del LCD diferido al PendSV, el TIM3 solo copia el estado:
+	INIT_DEFER();
+#endif
 
 	//Inicialización del TIM3:
 	INIT_TIM3();
 	SET_TIM3(TimeBase, Freq);
+	ProbeTIM3.PROBE_PERIOD = SystemCoreClock / Freq;
+
+#if Use_RTOS
+	//El main pasa a ser un thread y, sin mas trabajo, termina:
+	osKernelStart();
+	osThreadTerminate(osThreadGetId());
+#endif
 
 /*------------------------------------------------------------------------------
 BUCLE PRINCIPAL:
 ------------------------------------------------------------------------------*/
     while(1)
     {
-		if (Switchs == Ticks_Switchs)
-			SWITCHS();
-		else if(TimeIND == Ticks_TimeIND)
-			TIME_IND();
-		else if(Temperature == Ticks_Temperature)
-			TEMPERATURE();
-		else if(TimeIND == Ticks_TimeIND)
-			TIME_IND();
+		//Se atienden todas las tareas liberadas, por prioridad:
+		RUN_SCHED();
+
+		//Sin tareas se duerme hasta la proxima interrupcion (el WFI despierta
+		//aun con las interrupciones deshabilitadas, se atienden al habilitarlas):
+		__disable_irq();
+		if (!PENDING_SCHED()) {
+			IdleStart = DWT->CYCCNT;
+			__WFI();
+			IdleCycles += DWT->CYCCNT - IdleStart;
+		}
+		__enable_irq();
     }
 
 }
@@ -154,66 +342,57 @@ BUCLE PRINCIPAL:
 /*------------------------------------------------------------------------------
 INTERRUPCIONES:
 ------------------------------------------------------------------------------*/
-//Interrupcion por tiempo - Systick cada 50mseg:
-void SysTick_Handler()
-{
-	Switchs++;
-	TimeIND++;
-	Temperature++;
-}
-
 //Interrupcion al vencimiento de cuenta de TIM3:
 void TIM3_IRQHandler(void)
 {
+	VIEW_t Next;
+	KEYS_t KeysCopy;
+
+	PROBE_TIMER(&ProbeTIM3, TIM3, TIM3->CCR1);
+	PROBE_ENTER(&ProbeTIM3);
+
 	if (TIM_GetITStatus(TIM3, TIM_IT_CC1) != RESET) {
 		TIM_ClearITPendingBit(TIM3, TIM_IT_CC1);
 
-		//Buffers para mostrar valores de variables:
-		char BufferTemperature[BufferLength];
-		char BufferSeg[BufferLength];
-		char BufferCont[BufferLength];
-
-		//Refresco del LCD:
-		CLEAR_LCD_2x16(LCD_2X16);
-
-		//Mostrar temperatura:
-		PRINT_LCD_2x16(LCD_2X16, 0, 0, "TDII T:");
-		sprintf(BufferTemperature, "%.1f", TempDegrees);
-		PRINT_LCD_2x16(LCD_2X16, 8, 0, BufferTemperature);
-		PRINT_LCD_2x16(LCD_2X16, 13, 0, "^C");
-
-		//Mostrar segundos:
-		PRINT_LCD_2x16(LCD_2X16, 0, 1, "Seg:");
-		sprintf(BufferSeg, "%d", Seg);
-		if (Seg < 10) {
-			PRINT_LCD_2x16(LCD_2X16, 5, 1, "0");
-			PRINT_LCD_2x16(LCD_2X16, 6, 1, BufferSeg);
-		} else
-			PRINT_LCD_2x16(LCD_2X16, 5, 1, BufferSeg);
-
-		//Mostrar indicador de pulsaciones:
-		PRINT_LCD_2x16(LCD_2X16, 9, 1, "ind:");
-		sprintf(BufferCont, "%d", Cont);
-		if (Cont < 10) {
-			PRINT_LCD_2x16(LCD_2X16, 14, 1, "0");
-			PRINT_LCD_2x16(LCD_2X16, 15, 1, BufferCont);
-		} else
-			PRINT_LCD_2x16(LCD_2X16, 14, 1, BufferCont);
+		//Solo se copia el estado a mostrar, el dibujo queda para el PendSV:
+		Next.Temp = TempDeciDegrees;
+		Next.Seg = Seg;
+
+		//Si se corto a SWITCHS a mitad de publicar, queda el indicador anterior:
+		Next.Cont = View.Cont;
+		if (READ_SEQLOCK(&KeysLock, &KeysCopy, &Keys, sizeof(Keys)))
+			Next.Cont = KeysCopy.Cont;
+
+		WRITE_SEQLOCK(&ViewLock, &View, &Next, sizeof(View));
+#if Use_RTOS
+		osSemaphoreRelease(RenderSem);
+#else
+		DEFER(DRAW_LCD);
+#endif
 	}
+
+	PROBE_EXIT(&ProbeTIM3);
 }
 
 //Interrupcion al pulso por PC6-C1 o PC8-C2:
 void EXTI9_5_IRQHandler(void)
 {
+  //Pulsador detectado (1 a 4), se cuenta en SWITCHS:
+  uint8_t Key = 0;
+
+  //Flanco del lazo (PE5): el instante del evento lo da la comparacion del TIM9:
+  PROBE_LOOP(&ProbeEXTI);
+  PROBE_ENTER(&ProbeEXTI);
+
   //Si la interrupcion fue por linea 6 (PC6 - C1):
   if(EXTI_GetITStatus(EXTI_Line6) != RESET)
   {
 	//Si ademas de estar C1 en 1 tambien esta F1 en 1, entonces el switch pulsado es S1:
 	if(GPIO_ReadInputDataBit(F1_Port, F1))
-		S1Cont = S1Cont + 1;
+		Key = 1;
 	//Si ademas de estar C1 en 1 tambien esta F2 en 1, entonces el switch pulsado es S2:
 	else if(GPIO_ReadInputDataBit(F2_Port, F2))
-		S2Cont = S2Cont + 2;
+		Key = 2;
 
     //Clear the EXTI line 6 pending bit:
     EXTI_ClearITPendingBit(EXTI_Line6);
@@ -223,37 +402,64 @@ void EXTI9_5_IRQHandler(void)
   {
 	//Si ademas de estar C2 en 1 tambien esta F1 en 1, entonces el switch pulsado es S3:
 	if (GPIO_ReadInputDataBit(F1_Port, F1))
-		S3Cont = S3Cont + 3;
+		Key = 3;
 	//Si ademas de estar C2 en 1 tambien esta F2 en 1, entonces el switch pulsado es S4:
 	else if (GPIO_ReadInputDataBit(F2_Port, F2))
-		S4Cont = S4Cont + 4;
+		Key = 4;
 
     //Clear the EXTI line 8 pending bit:
     EXTI_ClearITPendingBit(EXTI_Line8);
   }
 
-  //Si cont llega a 100, se reseta y comienza de cero:
-  if(Cont >= 100)
-  	{
-  		Cont = 0;
-  		S1Cont = 0;
-  		S2Cont = 0;
-  		S3Cont = 0;
-  		S4Cont = 0;
-  	}
-  //Sino, se actualiza el valor de cont y se agrega a la sumatoria general:
-  else
-		Cont = S1Cont + S2Cont + S3Cont + S4Cont;
+  //Sin tocar los contadores: la pulsacion pasa por la cola, si esta llena se pierde:
+  if (Key)
+	PUT_SPSC(&KeyQueue, &Key);
+
+  PROBE_EXIT(&ProbeEXTI);
+}
+
+//Mitad del buffer del LM35 recien completada por el DMA:
+void LM35_SAMPLES(uint16_t* Samples, uint16_t Count)
+{
+	uint16_t i;
+
+	for (i = 0; i < Count; i++)
+		DECIM_PUT(&LM35Filter, Samples[i]);
 }
 
 /*------------------------------------------------------------------------------
-TAREAS DEL TS:
+TAREAS DEL TS Y TIMERS:
 ------------------------------------------------------------------------------*/
 //Manejo de los pulsadores:
 void SWITCHS(void)
 {
-	//Reset variables del TS:
-	Switchs = 0;
+	uint8_t Key;
+
+	//Pulsaciones recibidas del EXTI, S1 suma 1, S2 suma 2, S3 suma 3 y S4 suma 4:
+	if (COUNT_SPSC(&KeyQueue)) {
+		while (GET_SPSC(&KeyQueue, &Key)) {
+			//Si cont llega a 100, se reseta y comienza de cero:
+			if (KeysCount.Cont >= 100) {
+				memset(&KeysCount, 0, sizeof(KeysCount));
+				continue;
+			}
+
+			if (Key == 1)
+				KeysCount.S1Cont += 1;
+			else if (Key == 2)
+				KeysCount.S2Cont += 2;
+			else if (Key == 3)
+				KeysCount.S3Cont += 3;
+			else
+				KeysCount.S4Cont += 4;
+
+			//Se actualiza el valor de cont con la sumatoria general:
+			KeysCount.Cont = KeysCount.S1Cont + KeysCount.S2Cont + KeysCount.S3Cont + KeysCount.S4Cont;
+		}
+
+		//Se publica la copia que leen las interrupciones:
+		WRITE_SEQLOCK(&KeysLock, &Keys, &KeysCount, sizeof(Keys));
+	}
 
 	//Se prender y apagan F1 y F2 para preguntar en el INT_Handler:
 	GPIO_ToggleBits(F1_Port, F1);
@@ -261,11 +467,8 @@ void SWITCHS(void)
 }
 
 //Manejo del indicador de tiempo:
-void TIME_IND(void)
+void TIME_IND(void* Arg)
 {
-	//Reset variables del TS:
-	TimeIND = 0;
-
 	//Si la variable de tiempo es mayor a 100, se resetea:
 	if(Seg >= 99)
 		Seg = 0;
@@ -274,21 +477,106 @@ void TIME_IND(void)
 		Seg++;
 }
 //Manejo del la temperatura:
-void TEMPERATURE(void)
+void TEMPERATURE(void* Arg)
 {
-	//Reset variables del TS:
-	Temperature = 0;
-
 	//Almacenamiento del valor de temperatura en cuentas digitales:
 	uint32_t TempDig;
 
-	//Lectura del valor de temperatura digital:
-	TempDig = READ_ADC(LM35_Port, LM35);
+	//Lectura del valor de temperatura digital (ultima salida del filtro, 16 bits):
+	TempDig = LM35Filter.Out;
+
+	//[4] Conversion de valor digital a grados centigrados,
+	//en punto fijo (decimas de grado), redondeado a la decima mas cercana:
+	TempDeciDegrees = (TempDig * MAXTempDegrees * 10 + LM35_FullScale / 2) / LM35_FullScale;
+}
 
-	//[4] Conversion de valor digital a grados centigrados:
-	ContTemp++;
-	if (ContTemp == 5) {
-		TempDegrees = (float) TempDig * MAXTempDegrees / 4095;
-		ContTemp = 0;
+/*------------------------------------------------------------------------------
+TRABAJO DIFERIDO (PendSV):
+------------------------------------------------------------------------------*/
+//Dibujo del LCD con la copia tomada por el TIM3, a la menor prioridad:
+void DRAW_LCD(void)
+{
+	VIEW_t Frame;
+
+	PROBE_ENTER(&ProbeRender);
+
+	//El TIM3 puede publicar mientras se copia (tiene mayor prioridad), se reintenta:
+	while (!READ_SEQLOCK(&ViewLock, &Frame, &View, sizeof(Frame)));
+
+#if LCD_Bench
+	BENCH_START(&BenchFrame);
+#endif
+
+	//Armado del cuadro en RAM:
+	CLEAR_FRAME_LCD_2x16();
+
+#if LCD_View
+	//Mostrar temperatura: parte entera en digitos dobles, decimas y barra:
+	uint8_t x = BIG_FRAME_LCD_2x16(0, Frame.Temp / 10);
+	PRINT_FRAME_LCD_2x16(x, 0, "^C");
+	PRINT_FRAME_LCD_2x16(x, 1, ".");
+	PRINT_FRAME_INT_LCD_2x16(x + 1, 1, Frame.Temp % 10, 1, '0');
+	BAR_FRAME_LCD_2x16(6, 0, 10, Frame.Temp, MAXTempDegrees * 10);
+
+	//Mostrar segundos e indicador de pulsaciones:
+	PRINT_FRAME_LCD_2x16(7, 1, "S:");
+	PRINT_FRAME_INT_LCD_2x16(9, 1, Frame.Seg, 2, '0');
+	PRINT_FRAME_LCD_2x16(12, 1, "i:");
+	PRINT_FRAME_INT_LCD_2x16(14, 1, Frame.Cont, 2, '0');
+#else
+	//Mostrar temperatura:
+	PRINT_FRAME_LCD_2x16(0, 0, "TDII T:");
+	PRINT_FRAME_FIXED_LCD_2x16(8, 0, Frame.Temp, 1, 0, ' ');
+	PRINT_FRAME_LCD_2x16(13, 0, "^C");
+
+	//Mostrar segundos:
+	PRINT_FRAME_LCD_2x16(0, 1, "Seg:");
+	PRINT_FRAME_INT_LCD_2x16(5, 1, Frame.Seg, 2, '0');
+
+	//Mostrar indicador de pulsaciones:
+	PRINT_FRAME_LCD_2x16(9, 1, "ind:");
+	PRINT_FRAME_INT_LCD_2x16(14, 1, Frame.Cont, 2, '0');
+#endif
+
+	//Refresco del LCD, solo se envian los caracteres que cambiaron:
+	REFRESH_LCD(&LCD);
+
+#if LCD_Bench
+	BENCH_STOP(&BenchFrame);
+#endif
+
+	PROBE_EXIT(&ProbeRender);
+}
+
+/*------------------------------------------------------------------------------
+THREADS (Use_RTOS):
+------------------------------------------------------------------------------*/
+#if Use_RTOS
+//Tarea periodica de la tabla del TS, el argumento es su fila (periodo en useg):
+void TASK_THREAD(void const* argument)
+{
+	const SCHED_TASK_t* Task = argument;
+	uint32_t Next, Left, Tick = osKernelSysTickMicroSec(1000);
+
+	//Liberaciones en tiempos absolutos (como el TS): lo que tarda la tarea o
+	//los desalojos no corren las siguientes. El tiempo del kernel da la vuelta
+	//cada 42 seg, las diferencias se toman con signo:
+	Next = osKernelSysTick() + osKernelSysTickMicroSec(Task->TASK_PHASE);
+	while (1) {
+		Left = Next - osKernelSysTick();
+		if ((int32_t) Left > 0)
+			osDelay((Left + Tick - 1) / Tick);
+		Task->TASK_FUNC();
+		Next += osKernelSysTickMicroSec(Task->TASK_PERIOD);
+	}
+}
+
+//Dibujo del LCD cada vez que el TIM3 toma una copia del estado:
+void RENDER_THREAD(void const* argument)
+{
+	while (1) {
+		osSemaphoreWait(RenderSem, osWaitForever);
+		DRAW_LCD();
 	}
 }
+#endif
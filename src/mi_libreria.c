@@ -10,17 +10,42 @@ uint32_t FIND_CLOCK(GPIO_TypeDef* Port);
 ADC_TypeDef* FIND_ADC_TYPE(GPIO_TypeDef* Port, uint32_t Pin);
 uint32_t FIND_RCC_APB(ADC_TypeDef* ADCX);
 uint8_t FIND_CHANNEL(GPIO_TypeDef* Port, uint32_t Pin);
+uint8_t P_ADC_Index(ADC_TypeDef* ADCX);
+void P_ADC_Start(ADC_TypeDef* ADCX, ADC_SCAN_t* Table, uint8_t Anz, uint16_t* Buffer, uint16_t Length,
+		uint8_t Halves, uint32_t Rate, void (*Callback)(uint16_t*, uint16_t));
+void P_ADC_Trigger(uint32_t Rate);
+void P_ADC_DmaIRQ(uint8_t Index, uint32_t HalfFlag, uint32_t FullFlag);
+void P_ADC_CaptureStop(void);
 
 //LCD:
-void P_LCD_2x16_InitIO(LCD_2X16_t* LCD_2X16);
-void P_LCD_2x16_PinLo(TLCD_NAME_t lcd_pin, LCD_2X16_t* LCD_2X16);
-void P_LCD_2x16_PinHi(TLCD_NAME_t lcd_pin, LCD_2X16_t* LCD_2X16);
-void P_LCD_2x16_Delay(volatile uint32_t nCount);
-void P_LCD_2x16_InitSequenz(LCD_2X16_t* LCD_2X16);
-void P_LCD_2x16_Clk(LCD_2X16_t* LCD_2X16);
-void P_LCD_2x16_Cmd(uint8_t wert, LCD_2X16_t* LCD_2X16);
-void P_LCD_2x16_Cursor(LCD_2X16_t* LCD_2X16, uint8_t x, uint8_t y);
-void P_LCD_2x16_Data(uint8_t wert, LCD_2X16_t* LCD_2X16);
+void P_LCD_2x16_InitIO(LCD_t* LCD);
+LCD_t* P_LCD_2x16_Legacy(LCD_2X16_t* LCD_2X16);
+void P_LCD_2x16_PinLo(TLCD_NAME_t lcd_pin, LCD_t* LCD);
+void P_LCD_2x16_PinHi(TLCD_NAME_t lcd_pin, LCD_t* LCD);
+void P_LCD_2x16_Delay(uint32_t us);
+void P_LCD_2x16_Wait(LCD_t* LCD, uint32_t Pause);
+uint8_t P_LCD_2x16_ReadBusy(LCD_t* LCD);
+void P_LCD_2x16_DataMode(GPIOMode_TypeDef Mode, LCD_t* LCD);
+void P_LCD_2x16_InitSequenz(LCD_t* LCD);
+void P_LCD_2x16_EnableHi(uint8_t Enable, LCD_t* LCD);
+void P_LCD_2x16_EnableLo(uint8_t Enable, LCD_t* LCD);
+void P_LCD_2x16_Clk(LCD_t* LCD);
+void P_LCD_2x16_Cmd(uint8_t wert, LCD_t* LCD);
+uint8_t P_LCD_2x16_Address(LCD_t* LCD, uint8_t x, uint8_t y);
+void P_LCD_2x16_Cursor(LCD_t* LCD, uint8_t x, uint8_t y);
+void P_LCD_2x16_Data(uint8_t wert, LCD_t* LCD);
+void P_LCD_2x16_FillBuffer(char Buffer[TLCD_MAXY][TLCD_MAXX]);
+void P_LCD_2x16_GlyphUpload(LCD_t* LCD);
+void P_LCD_2x16_Nibble(uint8_t wert, LCD_t* LCD);
+void P_LCD_2x16_Byte(uint8_t wert, LCD_t* LCD);
+void P_LCD_2x16_InitMasks(LCD_t* LCD);
+void P_LCD_2x16_Write(uint8_t wert, uint8_t rs, LCD_t* LCD);
+void P_LCD_2x16_Put(uint16_t Entry);
+uint8_t P_LCD_2x16_QueueStep(void);
+void P_LCD_2x16_QueuePoll(void);
+void P_LCD_2x16_WavePin(uint16_t Step, TLCD_NAME_t lcd_pin, uint8_t Level, LCD_t* LCD);
+void P_LCD_2x16_WaveEnable(uint16_t Step, uint8_t Level, LCD_t* LCD);
+uint16_t P_LCD_2x16_WaveByte(uint16_t Step, uint8_t wert, uint8_t rs, LCD_t* LCD);
 
 //TIM4:
 uint8_t FIND_PINSOURCE(uint32_t Pin);
@@ -34,6 +59,161 @@ uint32_t FIND_EXTI_HANDLER(uint32_t Pin);
 //DAC:
 uint32_t FIND_DAC_CHANNEL(GPIO_TypeDef* Port, uint32_t Pin);
 
+//DWT:
+void WAIT_CYCLES(uint32_t Cycles);
+
+//Despachador:
+void P_SCHED_Release(uint32_t Now);
+void P_SCHED_Arm(void);
+
+//Timers por software:
+void P_TIMER_Insert(TIMER_t* Timer);
+void P_TIMER_Unlink(TIMER_t* Timer);
+
+//NVIC:
+void P_IRQ_Enable(IRQn_Type IRQ, uint8_t Default);
+uint32_t P_TIM_Cycles(TIM_TypeDef* TIMx);
+
+//Formato:
+uint8_t P_FORMAT_Number(char* Buffer, int32_t Value, uint8_t Decimals, uint8_t Width, char Pad);
+
+/*------------------------------------------------------------------------------
+VARIABLES INTERNAS:
+------------------------------------------------------------------------------*/
+//LCD - Display de las funciones *_LCD_2x16, armado por INIT_LCD_2x16 con su tabla de pines:
+static LCD_t LCD_Legacy;
+
+//LCD - Cuadro a mostrar, comun a todos los displays (cada LCD_t tiene su Glass):
+static char LCD_Frame[TLCD_MAXY][TLCD_MAXX];
+
+//LCD - Cache de glyphs de la CGRAM, reemplazo LRU (los usados en el cuadro actual no se pisan):
+static const uint8_t* LCD_GlyphData[TLCD_GLYPHS];
+static uint32_t LCD_GlyphStamp[TLCD_GLYPHS];
+static uint32_t LCD_GlyphClock = 0;
+static uint32_t LCD_GlyphFrame = 0;
+static uint8_t LCD_GlyphVersion[TLCD_GLYPHS];
+
+//LCD - Barra horizontal: 1 a 4 columnas encendidas (5 = TLCD_CHAR_FULL):
+static const uint8_t LCD_BarGlyph[4][8] = {
+		{ 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10 },
+		{ 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18 },
+		{ 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C },
+		{ 0x1E, 0x1E, 0x1E, 0x1E, 0x1E, 0x1E, 0x1E, 0x1E } };
+
+//LCD - Digitos dobles tipo 7 segmentos, mitades compartidas entre digitos:
+static const uint8_t LCD_BigGlyph[9][8] = {
+		{ 0x1F, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11 },  // a b f
+		{ 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01 },  // b / c
+		{ 0x1F, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x1F },  // a b g
+		{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x1F },  // b f g / c d e
+		{ 0x1F, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F },  // a f g
+		{ 0x1F, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01 },  // a b
+		{ 0x1F, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x1F },  // a b f g
+		{ 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F },  // d e
+		{ 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x1F } };// c d
+static const uint8_t LCD_BigTop[10]    = { 0, 1, 2, 2, 3, 4, 4, 5, 6, 6 };
+static const uint8_t LCD_BigBottom[10] = { 3, 1, 7, 8, 1, 8, 3, 1, 3, 8 };
+static const uint8_t LCD_BigMinus[8]   = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F };  // g
+
+//LCD - Pines de datos en el orden de las tablas de nibble: D4..D7 y luego D0..D3:
+static const TLCD_NAME_t LCD_DataPins[8] = { TLCD_D4, TLCD_D5, TLCD_D6, TLCD_D7, TLCD_D0, TLCD_D1, TLCD_D2, TLCD_D3 };
+
+//LCD - Escrituras a registros GPIO hechas por el driver (TLCD_BENCH):
+#if TLCD_BENCH
+static uint32_t LCD_BusOps = 0;
+#define TLCD_BUS_OP(n) (LCD_BusOps += (n))
+#else
+#define TLCD_BUS_OP(n) ((void) 0)
+#endif
+
+//LCD - Cola de comandos/datos despachada por el TIM7 (bit 8 = RS, bits 9-10 = E/E2):
+#define TLCD_QUEUE_RS 0x100
+#define TLCD_QUEUE_EN_SHIFT 9
+static uint16_t LCD_Queue[TLCD_QUEUE_LEN];
+static volatile uint8_t LCD_QueueHead = 0;
+static volatile uint8_t LCD_QueueTail = 0;
+static volatile uint8_t LCD_QueueBusy = 0;
+static uint8_t LCD_QueueOn = 0;
+static uint8_t LCD_QueuePhase = 0;
+static uint16_t LCD_QueueEntry;
+static LCD_t* LCD_QueueLCD;
+static void (*LCD_QueueIdle)(void);
+
+//LCD - Forma de onda BSRR por puerto para el modo DMA (TIM8 CC1..CC3 -> DMA2 Stream2..4):
+#define TLCD_DMA_STEPS_BYTE (6 + (TLCD_EXEC_US + TLCD_DMA_STEP_US - 1) / TLCD_DMA_STEP_US)
+#define TLCD_DMA_STEPS      ((TLCD_MAXX + 1) * TLCD_DMA_STEPS_BYTE)
+static uint32_t LCD_Wave[TLCD_DMA_PORTS][TLCD_DMA_STEPS];
+static LCD_t* LCD_WaveLCD;
+static GPIO_TypeDef* LCD_WavePort[TLCD_DMA_PORTS];
+static uint8_t LCD_WaveIndex[TLCD_ANZ];
+static uint8_t LCD_WavePorts = 0;
+static DMA_Stream_TypeDef* const LCD_WaveStream[TLCD_DMA_PORTS] = { DMA2_Stream2, DMA2_Stream3, DMA2_Stream4 };
+static const uint32_t LCD_WaveFlags[TLCD_DMA_PORTS] = {
+		DMA_FLAG_TCIF2 | DMA_FLAG_HTIF2 | DMA_FLAG_TEIF2 | DMA_FLAG_DMEIF2 | DMA_FLAG_FEIF2,
+		DMA_FLAG_TCIF3 | DMA_FLAG_HTIF3 | DMA_FLAG_TEIF3 | DMA_FLAG_DMEIF3 | DMA_FLAG_FEIF3,
+		DMA_FLAG_TCIF4 | DMA_FLAG_HTIF4 | DMA_FLAG_TEIF4 | DMA_FLAG_DMEIF4 | DMA_FLAG_FEIF4 };
+
+//ADC - Adquisicion continua por DMA2 (ADC1 -> Stream0 canal 0, ADC3 -> Stream1 canal 2,
+//los streams 2 a 4 son del LCD):
+#define ADC_DMA_ANZ 2
+static ADC_TypeDef* const ADC_DmaADC[ADC_DMA_ANZ] = { ADC1, ADC3 };
+static DMA_Stream_TypeDef* const ADC_DmaStream[ADC_DMA_ANZ] = { DMA2_Stream0, DMA2_Stream1 };
+static const uint32_t ADC_DmaChannel[ADC_DMA_ANZ] = { DMA_Channel_0, DMA_Channel_2 };
+static const IRQn_Type ADC_DmaIRQ[ADC_DMA_ANZ] = { DMA2_Stream0_IRQn, DMA2_Stream1_IRQn };
+static uint16_t* ADC_DmaBuffer[ADC_DMA_ANZ];
+static uint16_t ADC_DmaLength[ADC_DMA_ANZ];
+static uint8_t ADC_DmaHalves[ADC_DMA_ANZ];
+
+//ADC - Entradas y frecuencia de cada adquisicion, para reanudarla tras una captura:
+static ADC_SCAN_t ADC_DmaEntry[ADC_DMA_ANZ];
+static ADC_SCAN_t* ADC_DmaTable[ADC_DMA_ANZ];
+static uint8_t ADC_DmaAnz[ADC_DMA_ANZ];
+static uint32_t ADC_DmaRate[ADC_DMA_ANZ];
+
+//ADC - Valores del barrido de INIT_ADC_SCAN (ADC1 y luego ADC3):
+static volatile uint16_t* ADC_ScanSamples;
+
+//ADC - Captura intercalada en curso (INIT_ADC_CAPTURE, usa el stream de ADC1):
+static volatile uint8_t ADC_Capture = 0;
+static uint8_t ADC_CaptureADCs;
+static uint16_t* ADC_CaptureBuffer;
+static uint16_t ADC_CaptureLength;
+static void (*ADC_CaptureDone)(uint16_t*, uint16_t);
+static void (*ADC_DmaCallback[ADC_DMA_ANZ])(uint16_t*, uint16_t);
+
+//Despachador de tareas - Tabla ordenada por prioridad y ticks desde INIT_SCHED:
+static SCHED_TASK_t* SCHED_Tasks;
+static uint8_t SCHED_TaskAnz = 0;
+static volatile uint32_t SCHED_Ticks = 0;
+
+//Despachador de tareas - Modo sin ticks: TIM2 libre a 1 MHz y CC1 en la proxima liberacion:
+static uint8_t SCHED_Tickless = 0;
+static PROBE_t SCHED_Probe;
+
+//Trabajo diferido - Funciones pendientes de ejecutar en el PendSV:
+static void (* volatile DEFER_Work[DEFER_MAX])(void);
+
+//Colas SPSC y seqlocks - Barrera de memoria que tambien ordena al compilador (el __DMB del
+//CMSIS no tiene "memory" y el memcpy podria moverse de un lado a otro de la barrera).
+//La simulacion en PC (host/) la define antes, sin assembler de ARM:
+#ifndef P_DMB
+#define P_DMB() __ASM volatile ("dmb" ::: "memory")
+#endif
+
+//Timers por software - Rueda jerarquica: el nivel L tiene ranuras de 2^(bits*L) ticks:
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_SPAN  (1UL << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS))
+static TIMER_t* TIMER_Wheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+static uint32_t TIMER_Now = 0;
+
+//Mediciones - Lazo de latencia (INIT_PROBE_LOOP): linea del EXTI y comparacion del TIM9:
+static uint32_t PROBE_LoopLine = 0;
+static volatile uint32_t* PROBE_LoopCCR;
+
+//NVIC - Mapa de prioridades de INIT_IRQ_PRIO (las interrupciones que no figuran usan su valor por defecto):
+static const IRQ_PRIO_t* IRQ_PrioTable = NULL;
+static uint8_t IRQ_PrioAnz = 0;
+
 /*****************************************************************************
 INIT_DI:
 
@@ -108,7 +288,9 @@ void INIT_DO(GPIO_TypeDef* Port, uint32_t Pin)
 DELAY
 
 	* @author	Catedra UTN-BHI TDII
-	* @brief	Crea un retardo con un bucle.
+	* @brief	Crea un retardo con un bucle. Su duracion depende de la
+				optimizacion y del reloj: queda por compatibilidad, para
+				tiempos exactos usar DELAY_US/DELAY_NS.
 	* @returns	void
 	* @param
 		- n		Cantidad de veces digitales equivalente a segundos.
@@ -122,6 +304,429 @@ void DELAY(volatile uint32_t n)
 
 
 
+/*****************************************************************************
+INIT_DWT
+
+	* @author	A. Riedinger.
+	* @brief	Habilita el contador de ciclos del DWT (CYCCNT) del Cortex-M4.
+				Los DELAY_US/DELAY_NS lo llaman solos si hace falta.
+	* @returns	void
+	* @ej
+		- INIT_DWT();
+******************************************************************************/
+void INIT_DWT(void)
+{
+	SystemCoreClockUpdate();
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+
+
+/*****************************************************************************
+DELAY_US
+
+	* @author	A. Riedinger.
+	* @brief	Retardo en microsegundos contando ciclos de CPU con el DWT. La
+				duracion no depende de la optimizacion, los wait states de la
+				flash ni el PLL: se calibra con SystemCoreClock.
+	* @returns	void
+	* @param
+		- us	Duracion del retardo en microsegundos.
+	* @ej
+		- DELAY_US(40);
+******************************************************************************/
+void DELAY_US(uint32_t us)
+{
+	uint32_t CyclesUs;
+
+	if (!(DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk))
+		INIT_DWT();
+
+	CyclesUs = SystemCoreClock / 1000000;
+
+	//De a un segundo para no desbordar los 32 bits de CYCCNT:
+	while (us >= 1000000) {
+		WAIT_CYCLES(SystemCoreClock);
+		us -= 1000000;
+	}
+	WAIT_CYCLES(us * CyclesUs);
+}
+
+
+
+/*****************************************************************************
+DELAY_NS
+
+	* @author	A. Riedinger.
+	* @brief	Retardo en nanosegundos con el DWT, redondeado hacia arriba al
+				ciclo de CPU siguiente (5,6 ns a 180 MHz).
+	* @returns	void
+	* @param
+		- ns	Duracion del retardo en nanosegundos (hasta 4,29 seg).
+	* @ej
+		- DELAY_NS(450);
+******************************************************************************/
+void DELAY_NS(uint32_t ns)
+{
+	if (!(DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk))
+		INIT_DWT();
+
+	//En 64 bits: ns x ciclos por useg pasa de 32 bits arriba de ~23 mseg a 180 MHz:
+	WAIT_CYCLES(((uint64_t) ns * (SystemCoreClock / 1000000) + 999) / 1000);
+}
+
+
+
+/*****************************************************************************
+BENCH_RESET
+
+	* @author	A. Riedinger.
+	* @brief	Borra las estadisticas de una medicion de tiempos.
+	* @returns	void
+	* @param
+		- Bench		Medicion tipo BENCH_t.
+	* @ej
+		- BENCH_RESET(&BenchFrame);
+******************************************************************************/
+void BENCH_RESET(BENCH_t* Bench)
+{
+	Bench->Count = 0;
+	Bench->Min = 0xFFFFFFFF;
+	Bench->Max = 0;
+	Bench->Sum = 0;
+	Bench->BusOps = 0;
+	Bench->BusMax = 0;
+}
+
+
+
+/*****************************************************************************
+BENCH_START
+
+	* @author	A. Riedinger.
+	* @brief	Comienza una medicion: guarda el CYCCNT del DWT y la cuenta de
+				escrituras al bus del LCD. La 1ra vez borra las estadisticas.
+	* @returns	void
+	* @param
+		- Bench		Medicion tipo BENCH_t (global o static, arranca en 0).
+	* @ej
+		- BENCH_START(&BenchFrame);
+******************************************************************************/
+void BENCH_START(BENCH_t* Bench)
+{
+	if (!(DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk))
+		INIT_DWT();
+
+	if (Bench->Count == 0 && Bench->Min == 0)
+		BENCH_RESET(Bench);
+
+	Bench->BusStart = BUS_OPS_LCD_2x16();
+	Bench->Start = DWT->CYCCNT;
+}
+
+
+
+/*****************************************************************************
+BENCH_STOP
+
+	* @author	A. Riedinger.
+	* @brief	Termina una medicion y acumula minimo, maximo y suma en ciclos de
+				CPU, y las escrituras al bus del LCD de la medicion (TLCD_BENCH).
+	* @returns
+		- Cycles	Ciclos de CPU de esta medicion.
+	* @param
+		- Bench		Medicion tipo BENCH_t iniciada con BENCH_START.
+	* @ej
+		- BENCH_STOP(&BenchFrame);
+******************************************************************************/
+uint32_t BENCH_STOP(BENCH_t* Bench)
+{
+	uint32_t Cycles = DWT->CYCCNT - Bench->Start;
+
+	Bench->BusOps = BUS_OPS_LCD_2x16() - Bench->BusStart;
+	if (Bench->BusOps > Bench->BusMax)
+		Bench->BusMax = Bench->BusOps;
+
+	if (Cycles < Bench->Min)
+		Bench->Min = Cycles;
+	if (Cycles > Bench->Max)
+		Bench->Max = Cycles;
+	Bench->Sum += Cycles;
+	Bench->Count++;
+
+	return Cycles;
+}
+
+
+
+/*****************************************************************************
+BENCH_MEAN
+
+	* @author	A. Riedinger.
+	* @brief	Promedio de las mediciones acumuladas, en ciclos de CPU. Para
+				pasar a microsegundos: Cycles / (SystemCoreClock / 1000000).
+	* @returns
+		- Cycles	Promedio en ciclos (0 si no hay mediciones).
+	* @param
+		- Bench		Medicion tipo BENCH_t.
+	* @ej
+		- Mean = BENCH_MEAN(&BenchFrame);
+******************************************************************************/
+uint32_t BENCH_MEAN(BENCH_t* Bench)
+{
+	if (Bench->Count == 0)
+		return 0;
+
+	return (uint32_t) (Bench->Sum / Bench->Count);
+}
+
+
+
+/*****************************************************************************
+PROBE_RELEASE
+
+	* @author	A. Riedinger.
+	* @brief	Marca el instante en que una tarea queda lista para ejecutarse,
+				para medir la demora hasta su PROBE_ENTER. Lo llama el
+				despachador (TICK_SCHED); en interrupciones no hace falta.
+	* @returns	void
+	* @param
+		- Probe		Estadisticas tipo PROBE_t.
+	* @ej
+		- PROBE_RELEASE(&Probe);
+******************************************************************************/
+void PROBE_RELEASE(PROBE_t* Probe)
+{
+	Probe->Release = DWT->CYCCNT;
+	Probe->Released = 1;
+}
+
+
+
+/*****************************************************************************
+PROBE_ENTER
+
+	* @author	A. Riedinger.
+	* @brief	Comienzo de una tarea o interrupcion instrumentada. Acumula el
+				tiempo entre inicios (jitter = IntervalMax - IntervalMin) y la
+				demora desde PROBE_RELEASE (LatencyMin/LatencyMax).
+	* @returns	void
+	* @param
+		- Probe		Estadisticas tipo PROBE_t (global o static, arranca en 0).
+	* @ej
+		- PROBE_ENTER(&ProbeTIM3); //Primera linea del handler.
+******************************************************************************/
+void PROBE_ENTER(PROBE_t* Probe)
+{
+	uint32_t Now;
+
+	BENCH_START(&Probe->Exec);
+	Now = Probe->Exec.Start;
+
+	//Primera ejecucion: todavia no hay intervalo entre inicios:
+	if (Probe->Exec.Count == 0) {
+		Probe->IntervalMin = 0xFFFFFFFF;
+		Probe->IntervalMax = 0;
+		Probe->LatencyMin = 0xFFFFFFFF;
+		Probe->LatencyMax = 0;
+	}
+	else {
+		if (Now - Probe->Last < Probe->IntervalMin)
+			Probe->IntervalMin = Now - Probe->Last;
+		if (Now - Probe->Last > Probe->IntervalMax)
+			Probe->IntervalMax = Now - Probe->Last;
+	}
+	Probe->Last = Now;
+
+	if (Probe->Released) {
+		Probe->Released = 0;
+		if (Now - Probe->Release < Probe->LatencyMin)
+			Probe->LatencyMin = Now - Probe->Release;
+		if (Now - Probe->Release > Probe->LatencyMax)
+			Probe->LatencyMax = Now - Probe->Release;
+	}
+}
+
+
+
+/*****************************************************************************
+PROBE_EXIT
+
+	* @author	A. Riedinger.
+	* @brief	Fin de una tarea o interrupcion instrumentada. Acumula el tiempo
+				de ejecucion en Exec (Min, Max y BENCH_MEAN) y cuenta un overrun
+				si duro mas que PROBE_PERIOD.
+	* @returns
+		- Cycles	Ciclos de CPU de esta ejecucion.
+	* @param
+		- Probe		Estadisticas tipo PROBE_t iniciada con PROBE_ENTER.
+	* @ej
+		- PROBE_EXIT(&ProbeTIM3); //Ultima linea del handler.
+******************************************************************************/
+uint32_t PROBE_EXIT(PROBE_t* Probe)
+{
+	uint32_t Cycles = BENCH_STOP(&Probe->Exec);
+
+	if (Probe->PROBE_PERIOD != 0 && Cycles > Probe->PROBE_PERIOD)
+		Probe->Overruns++;
+
+	return Cycles;
+}
+
+
+
+/*****************************************************************************
+PROBE_TIMER
+
+	* @author	A. Riedinger.
+	* @brief	Marca como liberacion de una interrupcion de timer el instante
+				del evento que la disparo (comparacion o captura), calculado
+				hacia atras con lo que conto el timer desde entonces. Con el
+				PROBE_ENTER siguiente, LatencyMax es la peor demora de entrada
+				a la interrupcion (resolucion: un paso del timer).
+	* @returns	void
+	* @param
+		- Probe		Estadisticas tipo PROBE_t de la interrupcion.
+		- TIMx		Timer que interrumpio.
+		- Event		Cuenta del timer en el evento (CCRx, 0 para el update).
+	* @ej
+		- PROBE_TIMER(&ProbeTIM3, TIM3, TIM3->CCR1); //Antes de PROBE_ENTER.
+******************************************************************************/
+void PROBE_TIMER(PROBE_t* Probe, TIM_TypeDef* TIMx, uint32_t Event)
+{
+	uint32_t Now = DWT->CYCCNT;
+	uint32_t Count = TIMx->CNT;
+	uint32_t Ticks;
+
+	//Si el timer dio la vuelta despues del evento se suma el periodo:
+	if (Count >= Event)
+		Ticks = Count - Event;
+	else
+		Ticks = Count + (TIMx->ARR - Event) + 1;
+
+	Probe->Release = Now - Ticks * P_TIM_Cycles(TIMx);
+	Probe->Released = 1;
+}
+
+
+
+/*****************************************************************************
+INIT_PROBE_LOOP
+
+	* @author	A. Riedinger.
+	* @brief	Lazo para medir la latencia de entrada de un EXTI sin hardware
+				externo: el TIM9 cambia el pin por comparacion (el instante
+				queda en su CCRx) y la misma linea del EXTI interrumpe en cada
+				flanco ascendente, uno cada 2 x 65536 x PROBE_LOOP_DIV ciclos
+				del timer. El handler del EXTI llama a PROBE_LOOP. Usa el TIM9
+				porque ningun otro INIT_* lo toca (el TIM8 es del modo DMA del
+				LCD, INIT_LCD_DMA).
+	* @returns
+		- 1		Lazo funcionando.
+		- 0		El pin no es un canal del TIM9 (PA2, PA3, PE5, PE6).
+	* @param
+		- Port		Puerto del pin (libre, queda como salida del TIM9).
+		- Pin		Pin. Su linea no debe usarse para otro EXTI.
+	* @ej
+		- INIT_PROBE_LOOP(GPIOE, GPIO_Pin_5); //TIM9_CH1, EXTI9_5.
+******************************************************************************/
+uint8_t INIT_PROBE_LOOP(GPIO_TypeDef* Port, uint16_t Pin)
+{
+	GPIO_InitTypeDef GPIO_InitStructure;
+	TIM_OCInitTypeDef OC_InitStructure;
+	uint8_t Channel;
+
+	//Canal del TIM9 en el pin (1 o 2):
+	if ((Port == GPIOA && Pin == GPIO_Pin_2) || (Port == GPIOE && Pin == GPIO_Pin_5))
+		Channel = 1;
+	else if ((Port == GPIOA && Pin == GPIO_Pin_3) || (Port == GPIOE && Pin == GPIO_Pin_6))
+		Channel = 2;
+	else
+		return 0;
+
+	RCC_AHB1PeriphClockCmd(FIND_CLOCK(Port), ENABLE);
+	RCC_APB2PeriphClockCmd(RCC_APB2Periph_TIM9 | RCC_APB2Periph_SYSCFG, ENABLE);
+
+	//El EXTI lee el pin tambien en modo alternativo, no hace falta un cable:
+	GPIO_InitStructure.GPIO_Pin = Pin;
+	GPIO_InitStructure.GPIO_Mode = GPIO_Mode_AF;
+	GPIO_InitStructure.GPIO_OType = GPIO_OType_PP;
+	GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
+	GPIO_InitStructure.GPIO_PuPd = GPIO_PuPd_NOPULL;
+	GPIO_Init(Port, &GPIO_InitStructure);
+	GPIO_PinAFConfig(Port, FIND_PINSOURCE(Pin), GPIO_AF_TIM9);
+
+	//TIM9 libre de 16 bits, el pin cambia cuando la cuenta pasa por 0:
+	TIM_TimeBaseStructure.TIM_Prescaler = PROBE_LOOP_DIV - 1;
+	TIM_TimeBaseStructure.TIM_Period = 0xFFFF;
+	TIM_TimeBaseStructure.TIM_ClockDivision = 0;
+	TIM_TimeBaseStructure.TIM_CounterMode = TIM_CounterMode_Up;
+	TIM_TimeBaseStructure.TIM_RepetitionCounter = 0;
+	TIM_TimeBaseInit(TIM9, &TIM_TimeBaseStructure);
+
+	TIM_OCStructInit(&OC_InitStructure);
+	OC_InitStructure.TIM_OCMode = TIM_OCMode_Toggle;
+	OC_InitStructure.TIM_OutputState = TIM_OutputState_Enable;
+	OC_InitStructure.TIM_Pulse = 0;
+
+	if (Channel == 1) {
+		TIM_OC1Init(TIM9, &OC_InitStructure);
+		PROBE_LoopCCR = &TIM9->CCR1;
+	}
+	else {
+		TIM_OC2Init(TIM9, &OC_InitStructure);
+		PROBE_LoopCCR = &TIM9->CCR2;
+	}
+
+	//Antes de habilitar el EXTI, el handler ya debe reconocer la linea:
+	PROBE_LoopLine = FIND_EXTI_LINE(Pin);
+
+	SYSCFG_EXTILineConfig(FIND_EXTI_PORT_SOURCE(Port), FIND_EXTI_PIN_SOURCE(Pin));
+	EXTI_InitStructure.EXTI_Line = PROBE_LoopLine;
+	EXTI_InitStructure.EXTI_Mode = EXTI_Mode_Interrupt;
+	EXTI_InitStructure.EXTI_Trigger = EXTI_Trigger_Rising;
+	EXTI_InitStructure.EXTI_LineCmd = ENABLE;
+	EXTI_Init(&EXTI_InitStructure);
+	P_IRQ_Enable(FIND_EXTI_HANDLER(Pin), 3);
+
+	TIM_Cmd(TIM9, ENABLE);
+
+	return 1;
+}
+
+
+
+/*****************************************************************************
+PROBE_LOOP
+
+	* @author	A. Riedinger.
+	* @brief	Primera linea del handler del EXTI del lazo: si la interrupcion
+				vino del pin de INIT_PROBE_LOOP, marca como liberacion el
+				instante de la comparacion del TIM9 y borra el pendiente. Con
+				el PROBE_ENTER siguiente, LatencyMax es la peor demora de
+				entrada al handler (resolucion: PROBE_LOOP_DIV ciclos).
+	* @returns
+		- 1		Interrupcion del lazo.
+		- 0		Interrupcion de otra linea (o lazo sin iniciar).
+	* @param
+		- Probe		Estadisticas tipo PROBE_t del handler.
+	* @ej
+		- PROBE_LOOP(&ProbeEXTI); //Antes de PROBE_ENTER.
+******************************************************************************/
+uint8_t PROBE_LOOP(PROBE_t* Probe)
+{
+	if (PROBE_LoopLine == 0 || EXTI_GetITStatus(PROBE_LoopLine) == RESET)
+		return 0;
+
+	PROBE_TIMER(Probe, TIM9, *PROBE_LoopCCR);
+	EXTI_ClearITPendingBit(PROBE_LoopLine);
+	return 1;
+}
+
+
+
 /*****************************************************************************
 READ_DI
 
@@ -138,7 +743,7 @@ READ_DI
 ******************************************************************************/
 int READ_DI(GPIO_TypeDef* Port, uint16_t Pin)
 {
-	DELAY(Delay_Debouncing);
+	DELAY_US(Delay_Debouncing);
 
 	if(GPIO_ReadInputDataBit(Port, Pin))
 		return 1;
@@ -157,14 +762,14 @@ LED_ON
 	* @param
 		- Port		Puerto del LED a prender. Ej: GPIOX.
 		- Pin		Pin del LED. Ej: GPIO_Pin_X
-		- ON_DELAY	Tiempo que el LED estará encendido.
+		- ON_DELAY	Tiempo que el LED estará encendido en microsegundos.
 	* @ej
 		- LED_ON(GPIOX, GPIO_Pin_X, 100e3);
 ******************************************************************************/
 void LED_ON(GPIO_TypeDef* Port, uint16_t LED, int ON_Delay)
 {
 	GPIO_SetBits(Port, LED);
-	DELAY(ON_Delay);
+	DELAY_US(ON_Delay);
 	GPIO_ResetBits(Port, LED);
 }
 
@@ -262,161 +867,2095 @@ int32_t READ_ADC(GPIO_TypeDef* Port, uint16_t Pin)
 {
     uint32_t ADC_DATA;
 
+    //El pin ya lo valido INIT_ADC: los de GPIOF son de ADC3 y el resto de ADC1,
+    //sin recorrer la tabla de FIND_ADC_TYPE en cada lectura:
     ADC_TypeDef* ADCX;
-    ADCX = FIND_ADC_TYPE(Port, Pin);
+    ADCX = (Port == GPIOF) ? ADC3 : ADC1;
 
     ADC_ClearFlag(ADCX, ADC_FLAG_JEOC);
     ADC_SoftwareStartInjectedConv(ADCX);
     while (ADC_GetFlagStatus(ADCX, ADC_FLAG_JEOC) == RESET);
 
-    ADC_DATA = ADC_GetInjectedConversionValue(ADCX, ADC_InjectedChannel_1);
-    return ADC_DATA;
+    ADC_DATA = ADC_GetInjectedConversionValue(ADCX, ADC_InjectedChannel_1);
+    return ADC_DATA;
+}
+
+
+
+/*****************************************************************************
+INIT_ADC_DMA
+
+	* @author	A. Riedinger.
+	* @brief	Inicializa una entrada analogica en conversion continua: el
+				grupo regular del ADC convierte sin parar y el DMA2 copia cada
+				muestra a un buffer circular, sin intervencion de la CPU.
+				Con Rate = 0 convierte a la maxima velocidad (~45 kmuestras/seg
+				con 480 ciclos de muestreo y ADCCLK = PCLK2/4); si no, cada
+				conversion la dispara el CC1 del TIM5 en instantes exactos, sin
+				jitter del software. Un solo canal por ADC (ADC1 o ADC3).
+	* @returns
+		- 1			Adquisicion en marcha.
+		- 0			El pin no es una entrada de ADC1/ADC3.
+	* @param
+		- Port		Puerto de la entrada. Ej: GPIOX.
+		- Pin		Pin de la entrada. Ej: GPIO_Pin_X
+		- Buffer	Buffer circular de muestras (global o static).
+		- Length	Cantidad de muestras del buffer (par).
+		- Rate		Muestras por segundo (0 = continuo, hasta la mitad del reloj
+					del TIM5). El TIM5 es uno solo: ADC1 y ADC3 con disparo
+					comparten la ultima Rate pedida.
+		- Callback	Funcion llamada desde la interrupcion del DMA con cada mitad
+					del buffer recien completada (mientras el DMA llena la otra),
+					o NULL para solo leer con READ_ADC_DMA.
+	* @ej
+		- INIT_ADC_DMA(GPIOC, GPIO_Pin_0, Samples, 64, 1000, NULL);
+******************************************************************************/
+uint8_t INIT_ADC_DMA(GPIO_TypeDef* Port, uint16_t Pin, uint16_t* Buffer, uint16_t Length,
+		uint32_t Rate, void (*Callback)(uint16_t*, uint16_t))
+{
+	ADC_SCAN_t Entry = { Port, Pin, ADC_SampleTime_480Cycles };
+	uint8_t Index;
+
+	Entry.ADCX = FIND_ADC_TYPE(Port, Pin);
+	Entry.Channel = FIND_CHANNEL(Port, Pin);
+	Index = P_ADC_Index(Entry.ADCX);
+	if (Index == ADC_DMA_ANZ)
+		return 0;
+
+	//La entrada queda guardada, una captura intercalada la vuelve a arrancar:
+	ADC_DmaEntry[Index] = Entry;
+	P_ADC_Start(Entry.ADCX, &ADC_DmaEntry[Index], 1, Buffer, Length, 1, Rate, Callback);
+	return 1;
+}
+
+
+
+/*****************************************************************************
+READ_ADC_DMA
+
+	* @author	A. Riedinger.
+	* @brief	Devuelve la ultima muestra copiada por el DMA (INIT_ADC_DMA):
+				una lectura de memoria, sin esperar ninguna conversion.
+	* @returns
+		- ADC_DATA	Valor DIGITAL de la ultima conversion (0 si el pin no tiene
+					adquisicion por DMA o si es de ADC1 y hay una captura
+					intercalada en curso).
+	* @param
+		- Port		Puerto de la entrada. Ej: GPIOX.
+		- Pin		Pin de la entrada. Ej: GPIO_Pin_X
+	* @ej
+		- TempDig = READ_ADC_DMA(GPIOC, GPIO_Pin_0);
+******************************************************************************/
+int32_t READ_ADC_DMA(GPIO_TypeDef* Port, uint16_t Pin)
+{
+	uint8_t Index = P_ADC_Index(FIND_ADC_TYPE(Port, Pin));
+	uint16_t Next;
+
+	if (Index == ADC_DMA_ANZ || ADC_DmaBuffer[Index] == NULL || (Index == 0 && ADC_Capture))
+		return 0;
+
+	//NDTR cuenta lo que falta para dar la vuelta: la ultima escrita es la anterior:
+	Next = ADC_DmaLength[Index] - DMA_GetCurrDataCounter(ADC_DmaStream[Index]);
+	if (Next == 0)
+		Next = ADC_DmaLength[Index];
+
+	return ADC_DmaBuffer[Index][Next - 1];
+}
+
+
+
+/*****************************************************************************
+INIT_ADC_SCAN
+
+	* @author	A. Riedinger.
+	* @brief	Inicializa de una vez un conjunto de entradas analogicas de
+				ADC1 y ADC3: cada ADC barre sus canales (en el orden de la
+				tabla, con el tiempo de muestreo de cada uno) y el DMA2 deja
+				un valor por canal en Samples, sin intervencion de la CPU.
+				El ADC y el canal de cada pin se buscan solo aca.
+				Samples queda con los canales de ADC1 primero y los de ADC3
+				despues; el lugar de cada entrada queda en su Index
+				(READ_ADC_SCAN lo resuelve).
+	* @returns
+		- 1			Barrido en marcha.
+		- 0			Un pin no es entrada de ADC1/ADC3 o un ADC tiene mas de 16.
+	* @param
+		- Table		Tabla de entradas, TADC_TABLE(Table) completa los dos
+					parametros. Tiene que seguir existiendo.
+		- Samples	Un valor por entrada de la tabla (global o static).
+		- Rate		Barridos por segundo, disparados por el TIM5 (0 = continuo).
+		- Callback	Funcion llamada desde la interrupcion del DMA al completar
+					el barrido de cada ADC, con su parte de Samples, o NULL.
+	* @ej
+		- INIT_ADC_SCAN(TADC_TABLE(Inputs), InputSamples, 100, NULL);
+******************************************************************************/
+uint8_t INIT_ADC_SCAN(ADC_SCAN_t* Table, uint8_t Anz, uint16_t* Samples, uint32_t Rate,
+		void (*Callback)(uint16_t*, uint16_t))
+{
+	uint8_t Count[ADC_DMA_ANZ] = { 0 };
+	uint16_t Base;
+	uint8_t i, Index;
+
+	//Se valida toda la tabla antes de escribir en ella:
+	for (i = 0; i < Anz; i++) {
+		Index = P_ADC_Index(FIND_ADC_TYPE(Table[i].ADC_PORT, Table[i].ADC_PIN));
+		if (Index == ADC_DMA_ANZ || Count[Index] == 16)
+			return 0;
+		Count[Index]++;
+	}
+
+	for (i = 0; i < Anz; i++) {
+		Table[i].ADCX = FIND_ADC_TYPE(Table[i].ADC_PORT, Table[i].ADC_PIN);
+		Table[i].Channel = FIND_CHANNEL(Table[i].ADC_PORT, Table[i].ADC_PIN);
+	}
+
+	//Lugar de cada entrada en Samples: por ADC y, dentro de cada uno, en orden de tabla:
+	for (Index = 0, Base = 0; Index < ADC_DMA_ANZ; Base += Count[Index++]) {
+		Count[Index] = 0;
+		for (i = 0; i < Anz; i++)
+			if (Table[i].ADCX == ADC_DmaADC[Index])
+				Table[i].Index = Base + Count[Index]++;
+	}
+
+	for (Index = 0, Base = 0; Index < ADC_DMA_ANZ; Base += Count[Index++])
+		if (Count[Index])
+			P_ADC_Start(ADC_DmaADC[Index], Table, Anz, Samples + Base, Count[Index], 0, Rate, Callback);
+
+	ADC_ScanSamples = Samples;
+	return 1;
+}
+
+
+
+/*****************************************************************************
+READ_ADC_SCAN
+
+	* @author	A. Riedinger.
+	* @brief	Ultimo valor de una entrada del barrido (INIT_ADC_SCAN): una
+				lectura de memoria.
+	* @returns
+		- ADC_DATA	Valor DIGITAL de la ultima conversion de la entrada (0 antes
+					de INIT_ADC_SCAN).
+	* @param
+		- Entry		Entrada de la tabla del barrido.
+	* @ej
+		- Value = READ_ADC_SCAN(&Inputs[3]);
+******************************************************************************/
+int32_t READ_ADC_SCAN(ADC_SCAN_t* Entry)
+{
+	if (ADC_ScanSamples == NULL)
+		return 0;
+
+	return ADC_ScanSamples[Entry->Index];
+}
+
+
+
+/*****************************************************************************
+INIT_ADC_CAPTURE
+
+	* @author	A. Riedinger.
+	* @brief	Captura rapida de una entrada con 2 o 3 ADCs intercalados sobre
+				el mismo canal: cada ADC muestrea desfasado del anterior
+				(ADC_TwoSamplingDelay) y el DMA2 lee los pares del registro
+				comun (CDR) hasta llenar Buffer, en orden cronologico. Con
+				ADCCLK = 22,5 MHz y 3 ciclos de muestreo: ~4,5 Mmuestras/seg
+				con 3 ADCs y ~2,8 con 2, contra ~1,5 de un solo ADC.
+				Usa el stream del ADC1: lo que INIT_ADC_DMA/INIT_ADC_SCAN
+				tuvieran en marcha en los ADCs de la captura se detiene y, al
+				completarse el buffer, se vuelve a iniciar con la misma
+				configuracion (antes de llamar a Done). Con 2 ADCs el ADC3
+				sigue convirtiendo.
+	* @returns
+		- 1			Captura en marcha (BUSY_ADC_CAPTURE hasta que termine).
+		- 0			El pin no es entrada de los tres ADCs (PA0..PA3,
+					PC0..PC3), ADCs no es 2 o 3, Length es impar o ya hay
+					una captura en curso.
+	* @param
+		- Port		Puerto de la entrada. Ej: GPIOX.
+		- Pin		Pin de la entrada. Ej: GPIO_Pin_X
+		- ADCs		Cantidad de ADCs intercalados (2 o 3).
+		- Buffer	Destino de las muestras (global o static).
+		- Length	Cantidad de muestras (par).
+		- Done		Funcion llamada desde la interrupcion del DMA con la captura
+					completa, o NULL.
+	* @ej
+		- INIT_ADC_CAPTURE(GPIOC, GPIO_Pin_0, 3, Capture, 1024, NULL);
+******************************************************************************/
+uint8_t INIT_ADC_CAPTURE(GPIO_TypeDef* Port, uint16_t Pin, uint8_t ADCs, uint16_t* Buffer, uint16_t Length,
+		void (*Done)(uint16_t*, uint16_t))
+{
+	ADC_TypeDef* const ADCX[3] = { ADC1, ADC2, ADC3 };
+	GPIO_InitTypeDef GPIO_InitStructure;
+	ADC_InitTypeDef ADC_InitStructure;
+	ADC_CommonInitTypeDef ADC_CommonInitStructure;
+	DMA_InitTypeDef DMA_InitStructure;
+	uint8_t Channel = FIND_CHANNEL(Port, Pin);
+	uint8_t i;
+
+	//Solo los canales 0..3 (PA0..PA3) y 10..13 (PC0..PC3) llegan a los tres ADCs:
+	if (FIND_ADC_TYPE(Port, Pin) != ADC1 ||
+		!((Port == GPIOA && Channel <= ADC_Channel_3) ||
+		  (Port == GPIOC && Channel >= ADC_Channel_10 && Channel <= ADC_Channel_13)))
+		return 0;
+	if ((ADCs != 2 && ADCs != 3) || (Length & 1) || ADC_Capture)
+		return 0;
+
+	//Entrada analogica:
+	RCC_AHB1PeriphClockCmd(FIND_CLOCK(Port), ENABLE);
+	GPIO_StructInit(&GPIO_InitStructure);
+	GPIO_InitStructure.GPIO_Pin = Pin;
+	GPIO_InitStructure.GPIO_Mode = GPIO_Mode_AN;
+	GPIO_InitStructure.GPIO_PuPd = GPIO_PuPd_NOPULL;
+	GPIO_Init(Port, &GPIO_InitStructure);
+
+	RCC_APB2PeriphClockCmd(RCC_APB2Periph_ADC1 | RCC_APB2Periph_ADC2 | RCC_APB2Periph_ADC3, ENABLE);
+	RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_DMA2, ENABLE);
+
+	//Se detienen los ADCs de la captura (su adquisicion queda guardada en ADC_Dma*):
+	ADC_MultiModeDMARequestAfterLastTransferCmd(DISABLE);
+	for (i = 0; i < ADCs; i++) {
+		ADC_DMACmd(ADCX[i], DISABLE);
+		ADC_Cmd(ADCX[i], DISABLE);
+	}
+
+	ADC_CaptureADCs = ADCs;
+	ADC_CaptureBuffer = Buffer;
+	ADC_CaptureLength = Length;
+	ADC_CaptureDone = Done;
+
+	//DMA: CDR (dos muestras por palabra) -> Buffer, una sola pasada:
+	DMA_Cmd(ADC_DmaStream[0], DISABLE);
+	while (DMA_GetCmdStatus(ADC_DmaStream[0]) != DISABLE);
+	DMA_DeInit(ADC_DmaStream[0]);
+	DMA_StructInit(&DMA_InitStructure);
+	DMA_InitStructure.DMA_Channel = ADC_DmaChannel[0];
+	DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t) &ADC->CDR;
+	DMA_InitStructure.DMA_Memory0BaseAddr = (uint32_t) Buffer;
+	DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralToMemory;
+	DMA_InitStructure.DMA_BufferSize = Length / 2;
+	DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+	DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+	DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Word;
+	DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Word;
+	DMA_InitStructure.DMA_Mode = DMA_Mode_Normal;
+	DMA_InitStructure.DMA_Priority = DMA_Priority_VeryHigh;
+	DMA_InitStructure.DMA_FIFOMode = DMA_FIFOMode_Disable;
+	DMA_Init(ADC_DmaStream[0], &DMA_InitStructure);
+
+	//El fin de la transferencia detiene los ADCs, haya o no Done:
+	DMA_ClearITPendingBit(ADC_DmaStream[0], DMA_IT_TCIF0 | DMA_IT_HTIF0);
+	DMA_ITConfig(ADC_DmaStream[0], DMA_IT_HT, DISABLE);
+	DMA_ITConfig(ADC_DmaStream[0], DMA_IT_TC, ENABLE);
+	P_IRQ_Enable(ADC_DmaIRQ[0], 5);
+	DMA_Cmd(ADC_DmaStream[0], ENABLE);
+
+	//Modo intercalado: 15 ciclos por conversion repartidos entre los ADCs:
+	ADC_CommonStructInit(&ADC_CommonInitStructure);
+	ADC_CommonInitStructure.ADC_Mode = (ADCs == 3) ? ADC_TripleMode_Interl : ADC_DualMode_Interl;
+	ADC_CommonInitStructure.ADC_Prescaler = ADC_Prescaler_Div4; // max 36 MHz segun datasheet
+	ADC_CommonInitStructure.ADC_DMAAccessMode = ADC_DMAAccessMode_2;
+	ADC_CommonInitStructure.ADC_TwoSamplingDelay = (ADCs == 3) ? ADC_TwoSamplingDelay_5Cycles : ADC_TwoSamplingDelay_8Cycles;
+	ADC_CommonInit(&ADC_CommonInitStructure);
+
+	ADC_StructInit(&ADC_InitStructure);
+	ADC_InitStructure.ADC_Resolution = ADC_Resolution_12b;
+	ADC_InitStructure.ADC_ScanConvMode = DISABLE;
+	ADC_InitStructure.ADC_ContinuousConvMode = ENABLE;
+	ADC_InitStructure.ADC_ExternalTrigConvEdge = ADC_ExternalTrigConvEdge_None;
+	ADC_InitStructure.ADC_DataAlign = ADC_DataAlign_Right;
+	ADC_InitStructure.ADC_NbrOfConversion = 1;
+	for (i = 0; i < ADCs; i++) {
+		ADC_Init(ADCX[i], &ADC_InitStructure);
+		ADC_RegularChannelConfig(ADCX[i], Channel, 1, ADC_SampleTime_3Cycles);
+	}
+
+	ADC_MultiModeDMARequestAfterLastTransferCmd(ENABLE);
+	for (i = 0; i < ADCs; i++)
+		ADC_Cmd(ADCX[i], ENABLE);
+
+	//El ADC1 (maestro) arranca a los demas:
+	ADC_Capture = 1;
+	ADC_SoftwareStartConv(ADC1);
+
+	return 1;
+}
+
+
+
+/*****************************************************************************
+BUSY_ADC_CAPTURE
+
+	* @author	A. Riedinger.
+	* @brief	Indica si hay una captura intercalada en curso.
+	* @returns
+		- 1		Captura en curso.
+		- 0		Buffer completo (o sin captura).
+	* @ej
+		- while (BUSY_ADC_CAPTURE());
+******************************************************************************/
+uint8_t BUSY_ADC_CAPTURE(void)
+{
+	return ADC_Capture;
+}
+
+
+
+/*****************************************************************************
+DMA2_Stream0_IRQHandler / DMA2_Stream1_IRQHandler
+
+	* @author	A. Riedinger.
+	* @brief	Mitad y fin del buffer circular de ADC1 / ADC3 (INIT_ADC_DMA),
+				o fin de la captura intercalada (INIT_ADC_CAPTURE).
+******************************************************************************/
+void DMA2_Stream0_IRQHandler(void)
+{
+	P_ADC_DmaIRQ(0, DMA_IT_HTIF0, DMA_IT_TCIF0);
+}
+
+void DMA2_Stream1_IRQHandler(void)
+{
+	P_ADC_DmaIRQ(1, DMA_IT_HTIF1, DMA_IT_TCIF1);
+}
+
+
+
+/*****************************************************************************
+INIT_DECIM
+
+	* @author	A. Riedinger.
+	* @brief	Reinicia un filtro de sobremuestreo y decimacion CIC (con
+				DECIM_ORDER = 1 es un boxcar: suma DECIM_RATIO muestras y
+				entrega una). La ganancia es DECIM_RATIO^DECIM_ORDER y la salida
+				se corre DECIM_SHIFT bits: con muestras de 12 bits quedan
+				12 + DECIM_ORDER * log2(DECIM_RATIO) - DECIM_SHIFT bits (hasta 32).
+				Con ruido blanco cada x4 de DECIM_RATIO suma un bit efectivo.
+	* @returns	void
+	* @param
+		- Filter	Filtro con DECIM_ORDER, DECIM_RATIO y DECIM_SHIFT completos.
+	* @ej
+		- INIT_DECIM(&LM35Filter);
+******************************************************************************/
+void INIT_DECIM(DECIM_t* Filter)
+{
+	uint8_t k;
+
+	if (Filter->DECIM_ORDER > DECIM_MAX_ORDER)
+		Filter->DECIM_ORDER = DECIM_MAX_ORDER;
+
+	for (k = 0; k < DECIM_MAX_ORDER; k++) {
+		Filter->Integ[k] = 0;
+		Filter->Comb[k] = 0;
+	}
+	Filter->Count = 0;
+	Filter->Out = 0;
+	Filter->Outputs = 0;
+}
+
+
+
+/*****************************************************************************
+DECIM_PUT
+
+	* @author	A. Riedinger.
+	* @brief	Pasa una muestra por el filtro CIC: los integradores corren con
+				cada muestra y los peines una vez cada DECIM_RATIO, en enteros
+				de 32 bits (el desborde de los integradores se cancela en los
+				peines). Costo fijo por muestra, sin multiplicaciones.
+	* @returns
+		- 1			Hay una salida nueva en Filter->Out.
+		- 0			Todavia no se completo el bloque de DECIM_RATIO muestras.
+	* @param
+		- Filter	Filtro iniciado con INIT_DECIM.
+		- Sample	Muestra del ADC.
+	* @ej
+		- for (i = 0; i < Count; i++) DECIM_PUT(&LM35Filter, Samples[i]);
+******************************************************************************/
+uint8_t DECIM_PUT(DECIM_t* Filter, uint32_t Sample)
+{
+	uint32_t Value = Sample, Last;
+	uint8_t k;
+
+	for (k = 0; k < Filter->DECIM_ORDER; k++) {
+		Filter->Integ[k] += Value;
+		Value = Filter->Integ[k];
+	}
+
+	if (++Filter->Count < Filter->DECIM_RATIO)
+		return 0;
+	Filter->Count = 0;
+
+	for (k = 0; k < Filter->DECIM_ORDER; k++) {
+		Last = Filter->Comb[k];
+		Filter->Comb[k] = Value;
+		Value -= Last;
+	}
+
+	Filter->Out = Value >> Filter->DECIM_SHIFT;
+	Filter->Outputs++;
+	return 1;
+}
+
+
+
+/*****************************************************************************
+DAC_FUNC
+
+	* @author	A. Riedinger.
+	* @brief	Convierte un valor leido por el ADC a su equivalente analogico.
+	* @returns
+		- return	Devuelve el valor ANALOGICO de la lectura en el ADCX.
+	* @param
+		- ADC_DATA	Valor DIGITAL leido en el ADC. Ej: a = READ_ADC(ADCX);
+		- MAX_AN 	Valor ANALOGICO maximo que puede tomar la variable.
+	* @ej
+		- DAC_FUNC(ValActualADC_CuentasDigitales, ValorMaximoAnalogico);
+******************************************************************************/
+int DAC_FUNC(uint32_t ADC_DATA, int MAX_AN)
+{
+	return (float) ADC_DATA * MAX_AN / MaxDigCount;
+}
+
+
+
+/*****************************************************************************
+FORMAT_INT
+
+	* @author	A. Riedinger.
+	* @brief	Convierte un entero a texto alineado a derecha, sin sprintf ni
+				memoria dinamica.
+	* @returns
+		- Length	Cantidad de caracteres escritos (sin el 0 final).
+	* @param
+		- Buffer	Destino, de al menos FORMAT_MAX_LEN + 1 caracteres.
+		- Value		Valor a convertir.
+		- Width		Ancho minimo del campo (0 = sin relleno, max FORMAT_MAX_LEN).
+		- Pad		Caracter de relleno. Ej: ' ' o '0' (el '0' va tras el signo).
+	* @ej
+		- FORMAT_INT(Buffer, Seg, 2, '0'); //7 -> "07"
+******************************************************************************/
+uint8_t FORMAT_INT(char* Buffer, int32_t Value, uint8_t Width, char Pad)
+{
+	return P_FORMAT_Number(Buffer, Value, 0, Width, Pad);
+}
+
+
+
+/*****************************************************************************
+FORMAT_FIXED
+
+	* @author	A. Riedinger.
+	* @brief	Convierte un valor en punto fijo a texto con coma decimal, sin
+				usar float. Value esta expresado en unidades de 10^-Decimals.
+	* @returns
+		- Length	Cantidad de caracteres escritos (sin el 0 final).
+	* @param
+		- Buffer	Destino, de al menos FORMAT_MAX_LEN + 1 caracteres.
+		- Value		Valor escalado. Ej: 253 con Decimals = 1 es 25.3
+		- Decimals	Cantidad de decimales (0 ... 9).
+		- Width		Ancho minimo del campo (0 = sin relleno, max FORMAT_MAX_LEN).
+		- Pad		Caracter de relleno. Ej: ' ' o '0'.
+	* @ej
+		- FORMAT_FIXED(Buffer, 253, 1, 0, ' '); //"25.3"
+******************************************************************************/
+uint8_t FORMAT_FIXED(char* Buffer, int32_t Value, uint8_t Decimals, uint8_t Width, char Pad)
+{
+	return P_FORMAT_Number(Buffer, Value, Decimals, Width, Pad);
+}
+
+
+
+/*****************************************************************************
+INIT_LCD
+
+	* @author	A. Riedinger.
+	* @brief	Inicializa los pines y el controlador de un display de
+				cualquier geometria (16x2, 20x4, 40x2, 40x4...).
+	* @returns	1 si la geometria entra en TLCD_MAXX x TLCD_MAXY, 0 si hubo
+				que recortarla (el display se inicializa igual, con las
+				columnas/filas limitadas al maximo).
+	* @param
+		- LCD		Display tipo LCD_t: tabla de pines, columnas, filas y bus. Ej:
+					LCD_2X16_t LCD_2X16[] = {
+ 	 	 	 	 	// Name  , PORT,    PIN     ,          CLOCK     , Init
+  	  	  	  	  	{TLCD_RS ,GPIOC,GPIO_Pin_10 ,RCC_AHB1Periph_GPIOC,Bit_RESET},
+  	  	  	  	  	{TLCD_E  ,GPIOC,GPIO_Pin_11 ,RCC_AHB1Periph_GPIOC,Bit_RESET},
+  	  	  	  	  	{TLCD_D4 ,GPIOC,GPIO_Pin_12 ,RCC_AHB1Periph_GPIOC,Bit_RESET},
+  	  	  	  	  	{TLCD_D5 ,GPIOD,GPIO_Pin_2  ,RCC_AHB1Periph_GPIOD,Bit_RESET},
+  	  	  	  	  	{TLCD_D6 ,GPIOF,GPIO_Pin_9  ,RCC_AHB1Periph_GPIOF,Bit_RESET},
+  	  	  	  	  	{TLCD_D7 ,GPIOF,GPIO_Pin_7  ,RCC_AHB1Periph_GPIOF,Bit_RESET},};
+					LCD_t LCD = { TLCD_PIN_TABLE(LCD_2X16), 16, 2, TLCD_BUS_4BIT };
+					Pines opcionales de la tabla: TLCD_RW (las pausas de comandos
+					pasan a esperar el busy flag), TLCD_D0..D3 (necesarios para
+					TLCD_BUS_8BIT, sin ellos se usa el bus de 4 bits) y TLCD_E2
+					(segundo controlador de un 40x4, filas 2 y 3; un 40x2 tiene
+					un solo controlador y no lo usa). Los buffers se dimensionan
+					en compilacion con TLCD_MAXX/TLCD_MAXY (16x2 por defecto).
+	* @ej
+		- INIT_LCD(&LCD);
+******************************************************************************/
+uint8_t INIT_LCD(LCD_t* LCD)
+{
+	  uint8_t Slot, Fit = 1;
+
+	  //La geometria no puede superar los buffers (Glass, frame y forma de onda):
+	  if (LCD->TLCD_COLS > TLCD_MAXX) {
+		  LCD->TLCD_COLS = TLCD_MAXX;
+		  Fit = 0;
+	  }
+	  if (LCD->TLCD_ROWS > TLCD_MAXY) {
+		  LCD->TLCD_ROWS = TLCD_MAXY;
+		  Fit = 0;
+	  }
+	  //Inicialización de los pines del LCD:
+	  P_LCD_2x16_InitIO(LCD);
+	  // kleine Pause
+	  P_LCD_2x16_Delay(TLCD_INIT_PAUSE);
+	  // Init Sequenz starten (en los dos controladores si hay TLCD_E2)
+	  LCD->Enable = LCD->EnableAll;
+	  P_LCD_2x16_InitSequenz(LCD);
+	  // LCD-Settings einstellen
+	  P_LCD_2x16_Cmd(TLCD_CMD_INIT_DISPLAY | (LCD->TLCD_BUS == TLCD_BUS_8BIT ? TLCD_CMD_8BIT : 0), LCD);
+	  P_LCD_2x16_Cmd(TLCD_CMD_ENTRY_MODE, LCD);
+	  // Display einschalten
+	  P_LCD_2x16_Cmd(TLCD_CMD_DISP_M1, LCD);
+	  // Display l�schen
+	  P_LCD_2x16_Cmd(TLCD_CMD_CLEAR, LCD);
+	  // kleine Pause (o hasta que el busy flag se libere)
+	  P_LCD_2x16_Wait(LCD, TLCD_PAUSE);
+	  //El display arranca en blanco, al igual que su copia en RAM:
+	  P_LCD_2x16_FillBuffer(LCD->Glass);
+	  P_LCD_2x16_FillBuffer(LCD_Frame);
+	  //La CGRAM arranca con contenido indefinido, se recargan todos los glyphs:
+	  for (Slot = 0; Slot < TLCD_GLYPHS; Slot++)
+		  LCD->GlyphVersion[Slot] = 0;
+
+	  return Fit;
+}
+
+
+
+/*****************************************************************************
+INIT_LCD_2x16
+
+	* @author	A. Riedinger.
+	* @brief	Inicializa un display 16x2 con bus de 4 bits a partir de su
+				tabla de pines, como antes de INIT_LCD: el driver arma el
+				LCD_t internamente y las demas funciones *_LCD_2x16 lo buscan
+				por la tabla. Para otra geometria, RW, el bus de 8 bits o mas
+				de un display, usar INIT_LCD y las funciones *_LCD.
+	* @returns	void
+	* @param
+		- LCD_2x16	Arreglo tipo LCD_2X16_t con los pines del LCD, en el orden
+					de TLCD_NAME_t (TLCD_LEGACY_ANZ entradas). Ej:
+					LCD_2X16_t LCD_2X16[] = {
+ 	 	 	 	 	// Name  , PORT,    PIN     ,          CLOCK     , Init
+  	  	  	  	  	{TLCD_RS ,GPIOC,GPIO_Pin_10 ,RCC_AHB1Periph_GPIOC,Bit_RESET},
+  	  	  	  	  	{TLCD_E  ,GPIOC,GPIO_Pin_11 ,RCC_AHB1Periph_GPIOC,Bit_RESET},
+  	  	  	  	  	{TLCD_D4 ,GPIOC,GPIO_Pin_12 ,RCC_AHB1Periph_GPIOC,Bit_RESET},
+  	  	  	  	  	{TLCD_D5 ,GPIOD,GPIO_Pin_2  ,RCC_AHB1Periph_GPIOD,Bit_RESET},
+  	  	  	  	  	{TLCD_D6 ,GPIOF,GPIO_Pin_9  ,RCC_AHB1Periph_GPIOF,Bit_RESET},
+  	  	  	  	  	{TLCD_D7 ,GPIOF,GPIO_Pin_7  ,RCC_AHB1Periph_GPIOF,Bit_RESET},};
+	* @ej
+		- INIT_LCD_2x16(LCD_2X16);
+******************************************************************************/
+void INIT_LCD_2x16(LCD_2X16_t* LCD_2X16)
+{
+	//Display interno con la geometria de siempre: 16x2, bus de 4 bits:
+	LCD_Legacy.TLCD_PINS = LCD_2X16;
+	LCD_Legacy.TLCD_PIN_ANZ = TLCD_LEGACY_ANZ;
+	LCD_Legacy.TLCD_COLS = 16;
+	LCD_Legacy.TLCD_ROWS = 2;
+	LCD_Legacy.TLCD_BUS = TLCD_BUS_4BIT;
+	INIT_LCD(&LCD_Legacy);
+}
+
+
+
+/*****************************************************************************
+CLEAR_LCD
+
+	* @author	A. Riedinger.
+	* @brief	Refresca la pantalla del LCD.
+	* @returns	void
+	* @param
+		- LCD		Display tipo LCD_t (ver INIT_LCD).
+	* @ej
+		- CLEAR_LCD(&LCD);
+******************************************************************************/
+void CLEAR_LCD(LCD_t* LCD)
+{
+  // Display l�schen (todos los controladores)
+  LCD->Enable = LCD->EnableAll;
+  P_LCD_2x16_Cmd(TLCD_CMD_CLEAR, LCD);
+  // kleine Pause (con la cola activa la espera la hace el TIM7)
+  if (!LCD_QueueOn || LCD != LCD_QueueLCD)
+    P_LCD_2x16_Wait(LCD, TLCD_PAUSE);
+  //Copia en RAM del display:
+  P_LCD_2x16_FillBuffer(LCD->Glass);
+}
+
+
+
+/*****************************************************************************
+CLEAR_LCD_2x16
+
+	* @author	A. Riedinger.
+	* @brief	CLEAR_LCD para el display de INIT_LCD_2x16.
+	* @returns	void
+	* @param
+		- LCD_2x16	Tabla de pines pasada a INIT_LCD_2x16 (con otra tabla
+					no hace nada).
+	* @ej
+		- CLEAR_LCD_2x16(LCD_2X16);
+******************************************************************************/
+void CLEAR_LCD_2x16(LCD_2X16_t* LCD_2X16)
+{
+	LCD_t* LCD = P_LCD_2x16_Legacy(LCD_2X16);
+
+	if (LCD != NULL)
+		CLEAR_LCD(LCD);
+}
+
+
+
+/*****************************************************************************
+PRINT_LCD
+
+	* @author	A. Riedinger.
+	* @brief	Imprime una string en el LCD.
+	* @returns	void
+	* @param
+		- LCD		Display tipo LCD_t (ver INIT_LCD).
+  	  	- x			Indicador de columna. Ej: 0 ... TLCD_COLS - 1.
+  	  	- y 		Indicador de fila. Ej: 0 ... TLCD_ROWS - 1.
+  	  	- ptr		Puntero a la string a imprimir.
+
+	* @ej
+		- PRINT_LCD(&LCD, 0, 0, STR);
+******************************************************************************/
+void PRINT_LCD(LCD_t* LCD, uint8_t x, uint8_t y, char *ptr)
+{
+  if(x>=LCD->TLCD_COLS) x=0;
+  if(y>=LCD->TLCD_ROWS) y=0;
+
+  // Cursor setzen
+  P_LCD_2x16_Cursor(LCD,x,y);
+  // kompletten String ausgeben
+  while (*ptr != 0) {
+    P_LCD_2x16_Data(*ptr, LCD);
+    //Se mantiene actualizada la copia en RAM de lo visible:
+    if (x < LCD->TLCD_COLS)
+      LCD->Glass[y][x++] = *ptr;
+    ptr++;
+  }
+}
+
+
+
+/*****************************************************************************
+PRINT_LCD_2x16
+
+	* @author	A. Riedinger.
+	* @brief	PRINT_LCD para el display de INIT_LCD_2x16.
+	* @returns	void
+	* @param
+		- LCD_2x16	Tabla de pines pasada a INIT_LCD_2x16 (con otra tabla
+					no hace nada).
+  	  	- x			Indicador de columna. Ej: 0 ... 15.
+  	  	- y 		Indicador de fila. Ej: 0 ... 1.
+  	  	- ptr		Puntero a la string a imprimir.
+	* @ej
+		- PRINT_LCD_2x16(LCD_2X16, 0, 0, STR);
+******************************************************************************/
+void PRINT_LCD_2x16(LCD_2X16_t* LCD_2X16, uint8_t x, uint8_t y, char *ptr)
+{
+	LCD_t* LCD = P_LCD_2x16_Legacy(LCD_2X16);
+
+	if (LCD != NULL)
+		PRINT_LCD(LCD, x, y, ptr);
+}
+
+
+
+/*****************************************************************************
+CLEAR_FRAME_LCD_2x16
+
+	* @author	A. Riedinger.
+	* @brief	Borra el cuadro en RAM a mostrar en el LCD. No escribe en el
+				display, solo prepara el proximo REFRESH_LCD.
+	* @returns	void
+	* @ej
+		- CLEAR_FRAME_LCD_2x16();
+******************************************************************************/
+void CLEAR_FRAME_LCD_2x16(void)
+{
+	P_LCD_2x16_FillBuffer(LCD_Frame);
+	//Los glyphs usados desde aca en adelante pertenecen al nuevo cuadro:
+	LCD_GlyphFrame = LCD_GlyphClock;
+}
+
+
+
+/*****************************************************************************
+PRINT_FRAME_LCD_2x16
+
+	* @author	A. Riedinger.
+	* @brief	Escribe una string en el cuadro en RAM a mostrar en el LCD. Los
+				caracteres que exceden la fila se descartan.
+	* @returns	void
+	* @param
+  	  	- x			Indicador de columna. Ej: 0 ... 15.
+  	  	- y 		Indicador de fila. Ej: 0 .. 1.
+  	  	- ptr		Puntero a la string a escribir.
+	* @ej
+		- PRINT_FRAME_LCD_2x16(0, 0, STR);
+******************************************************************************/
+void PRINT_FRAME_LCD_2x16(uint8_t x, uint8_t y, char *ptr)
+{
+	if (y >= TLCD_MAXY)
+		return;
+
+	while (*ptr != 0 && x < TLCD_MAXX)
+		LCD_Frame[y][x++] = *ptr++;
+}
+
+
+
+/*****************************************************************************
+PRINT_FRAME_INT_LCD_2x16
+
+	* @author	A. Riedinger.
+	* @brief	Escribe un entero en el cuadro en RAM del LCD (ver FORMAT_INT).
+	* @returns	void
+	* @param
+  	  	- x			Indicador de columna. Ej: 0 ... 15.
+  	  	- y 		Indicador de fila. Ej: 0 .. 1.
+		- Value		Valor a escribir.
+		- Width		Ancho minimo del campo.
+		- Pad		Caracter de relleno. Ej: ' ' o '0'.
+	* @ej
+		- PRINT_FRAME_INT_LCD_2x16(5, 1, Seg, 2, '0');
+******************************************************************************/
+void PRINT_FRAME_INT_LCD_2x16(uint8_t x, uint8_t y, int32_t Value, uint8_t Width, char Pad)
+{
+	char Buffer[FORMAT_MAX_LEN + 1];
+
+	P_FORMAT_Number(Buffer, Value, 0, Width, Pad);
+	PRINT_FRAME_LCD_2x16(x, y, Buffer);
+}
+
+
+
+/*****************************************************************************
+PRINT_FRAME_FIXED_LCD_2x16
+
+	* @author	A. Riedinger.
+	* @brief	Escribe un valor en punto fijo en el cuadro en RAM del LCD (ver
+				FORMAT_FIXED).
+	* @returns	void
+	* @param
+  	  	- x			Indicador de columna. Ej: 0 ... 15.
+  	  	- y 		Indicador de fila. Ej: 0 .. 1.
+		- Value		Valor escalado en unidades de 10^-Decimals.
+		- Decimals	Cantidad de decimales.
+		- Width		Ancho minimo del campo.
+		- Pad		Caracter de relleno. Ej: ' ' o '0'.
+	* @ej
+		- PRINT_FRAME_FIXED_LCD_2x16(8, 0, TempDeciDegrees, 1, 0, ' ');
+******************************************************************************/
+void PRINT_FRAME_FIXED_LCD_2x16(uint8_t x, uint8_t y, int32_t Value, uint8_t Decimals, uint8_t Width, char Pad)
+{
+	char Buffer[FORMAT_MAX_LEN + 1];
+
+	P_FORMAT_Number(Buffer, Value, Decimals, Width, Pad);
+	PRINT_FRAME_LCD_2x16(x, y, Buffer);
+}
+
+
+
+/*****************************************************************************
+GLYPH_FRAME_LCD_2x16
+
+	* @author	A. Riedinger.
+	* @brief	Reserva un caracter de la CGRAM para un glyph del cuadro en RAM.
+				Si el glyph ya esta cargado se reutiliza; si no, se pisa el
+				menos usado recientemente que no aparezca en el cuadro actual.
+				La CGRAM solo se escribe en el proximo REFRESH_LCD_2x16 de cada
+				display y solo si el glyph cambio. El glyph se identifica por
+				su direccion, debe ser const/static.
+	* @returns
+		- Code		Codigo a escribir en el cuadro (TLCD_GLYPH_BASE ... +7).
+		- 0			Los 8 glyphs ya estan en uso en este cuadro.
+	* @param
+		- Glyph		8 filas de 5 bits (bit 4 = columna izquierda).
+	* @ej
+		- static const uint8_t Grado[8] = { 0x0C, 0x12, 0x12, 0x0C, 0, 0, 0, 0 };
+		- Str[0] = GLYPH_FRAME_LCD_2x16(Grado);
+******************************************************************************/
+uint8_t GLYPH_FRAME_LCD_2x16(const uint8_t* Glyph)
+{
+	uint8_t Slot, Victim = TLCD_GLYPHS;
+
+	for (Slot = 0; Slot < TLCD_GLYPHS; Slot++)
+		if (LCD_GlyphData[Slot] == Glyph) {
+			LCD_GlyphStamp[Slot] = ++LCD_GlyphClock;
+			return TLCD_GLYPH_BASE + Slot;
+		}
+
+	//Reemplazo: el de uso mas viejo fuera del cuadro actual (los libres tienen marca 0):
+	for (Slot = 0; Slot < TLCD_GLYPHS; Slot++)
+		if (LCD_GlyphStamp[Slot] <= LCD_GlyphFrame &&
+			(Victim == TLCD_GLYPHS || LCD_GlyphStamp[Slot] < LCD_GlyphStamp[Victim]))
+			Victim = Slot;
+
+	if (Victim == TLCD_GLYPHS)
+		return 0;
+
+	LCD_GlyphData[Victim] = Glyph;
+	LCD_GlyphStamp[Victim] = ++LCD_GlyphClock;
+	//Cada display compara esta version con la que tiene cargada (0 = ninguna):
+	if (++LCD_GlyphVersion[Victim] == 0)
+		LCD_GlyphVersion[Victim] = 1;
+	return TLCD_GLYPH_BASE + Victim;
+}
+
+
+
+/*****************************************************************************
+BAR_FRAME_LCD_2x16
+
+	* @author	A. Riedinger.
+	* @brief	Dibuja una barra horizontal en el cuadro en RAM, con resolucion
+				de una columna de pixel (5 por caracter). Usa un solo glyph.
+	* @returns	void
+	* @param
+  	  	- x			Columna de inicio. Ej: 0 ... 15.
+  	  	- y 		Indicador de fila. Ej: 0 .. 1.
+		- Width		Largo de la barra en caracteres.
+		- Value		Valor a representar (se recorta a Max).
+		- Max		Valor que corresponde a la barra llena.
+	* @ej
+		- BAR_FRAME_LCD_2x16(6, 0, 10, TempDeciDegrees, MAXTempDegrees * 10);
+******************************************************************************/
+void BAR_FRAME_LCD_2x16(uint8_t x, uint8_t y, uint8_t Width, uint32_t Value, uint32_t Max)
+{
+	uint32_t Columns;
+	uint8_t Code;
+
+	if (y >= TLCD_MAXY || Max == 0)
+		return;
+	if (Value > Max)
+		Value = Max;
+
+	//Columnas de pixel encendidas, redondeado (Value * Width * 5 debe entrar en 32 bits):
+	Columns = (Value * Width * 5 + Max / 2) / Max;
+
+	for (; Width > 0 && x < TLCD_MAXX; Width--, x++)
+	{
+		if (Columns >= 5) {
+			LCD_Frame[y][x] = TLCD_CHAR_FULL;
+			Columns -= 5;
+		} else if (Columns > 0) {
+			//Sin glyph libre se redondea al caracter de ROM mas cercano:
+			Code = GLYPH_FRAME_LCD_2x16(LCD_BarGlyph[Columns - 1]);
+			LCD_Frame[y][x] = Code ? Code : (Columns >= 3 ? TLCD_CHAR_FULL : ' ');
+			Columns = 0;
+		} else
+			LCD_Frame[y][x] = ' ';
+	}
+}
+
+
+
+/*****************************************************************************
+BIG_FRAME_LCD_2x16
+
+	* @author	A. Riedinger.
+	* @brief	Escribe un numero con digitos de doble altura (filas 0 y 1) en
+				el cuadro en RAM. Cada digito ocupa un caracter de ancho y usa
+				hasta dos glyphs, compartidos entre digitos iguales. El signo
+				de un valor negativo ocupa una columna mas, con un glyph.
+	* @returns
+		- Width		Cantidad de columnas ocupadas.
+	* @param
+  	  	- x			Columna de inicio. Ej: 0 ... 15.
+		- Value		Valor a escribir, con signo.
+	* @ej
+		- x = BIG_FRAME_LCD_2x16(0, TempDeciDegrees / 10);
+******************************************************************************/
+uint8_t BIG_FRAME_LCD_2x16(uint8_t x, int32_t Value)
+{
+	char Buffer[FORMAT_MAX_LEN + 1];
+	uint8_t Index, Digit, Top, Bottom;
+	uint8_t Length;
+
+	Length = P_FORMAT_Number(Buffer, Value, 0, 0, ' ');
+
+	for (Index = 0; Index < Length && x + Index < TLCD_MAXX; Index++)
+	{
+		//Signo: solo el segmento g, en la fila de arriba (sin glyph, un '-' comun abajo):
+		if (Buffer[Index] == '-') {
+			Top = GLYPH_FRAME_LCD_2x16(LCD_BigMinus);
+			LCD_Frame[0][x + Index] = Top ? Top : ' ';
+			LCD_Frame[1][x + Index] = Top ? ' ' : '-';
+			continue;
+		}
+
+		//Cualquier otro caracter que no sea un digito no puede indexar las tablas:
+		if (Buffer[Index] < '0' || Buffer[Index] > '9') {
+			LCD_Frame[0][x + Index] = ' ';
+			LCD_Frame[1][x + Index] = ' ';
+			continue;
+		}
+
+		Digit = Buffer[Index] - '0';
+		Top = GLYPH_FRAME_LCD_2x16(LCD_BigGlyph[LCD_BigTop[Digit]]);
+		Bottom = GLYPH_FRAME_LCD_2x16(LCD_BigGlyph[LCD_BigBottom[Digit]]);
+
+		//Sin glyphs libres queda el digito comun en la fila de abajo:
+		LCD_Frame[0][x + Index] = (Top && Bottom) ? Top : ' ';
+		LCD_Frame[1][x + Index] = (Top && Bottom) ? Bottom : Buffer[Index];
+	}
+
+	return Index;
+}
+
+
+
+/*****************************************************************************
+REFRESH_LCD
+
+	* @author	A. Riedinger.
+	* @brief	Vuelca el cuadro en RAM al LCD enviando solo los caracteres que
+				cambiaron respecto de lo que ya esta en el display. El cursor
+				se reposiciona solo al saltar celdas sin cambios, y no se envia
+				TLCD_CMD_CLEAR (ni su pausa). El display muestra la esquina
+				superior izquierda del cuadro (TLCD_COLS x TLCD_ROWS); varios
+				displays pueden refrescarse desde el mismo cuadro.
+	* @returns	void
+	* @param
+		- LCD		Display tipo LCD_t (ver INIT_LCD).
+	* @ej
+		- CLEAR_FRAME_LCD_2x16();
+		- PRINT_FRAME_LCD_2x16(0, 0, "T:");
+		- REFRESH_LCD(&LCD);
+******************************************************************************/
+void REFRESH_LCD(LCD_t* LCD)
+{
+	uint8_t x, y;
+	uint8_t Cursor;
+
+	//Glyphs nuevos del cuadro a la CGRAM (deja el cursor en la CGRAM, el
+	//primer caracter de cada fila siempre vuelve a posicionarlo):
+	P_LCD_2x16_GlyphUpload(LCD);
+
+	for (y = 0; y < LCD->TLCD_ROWS; y++)
+	{
+		//Posicion invalida para forzar el primer comando de cursor de la fila:
+		Cursor = TLCD_MAXX;
+
+		for (x = 0; x < LCD->TLCD_COLS; x++)
+		{
+			if (LCD_Frame[y][x] == LCD->Glass[y][x])
+				continue;
+
+			//El display autoincrementa el cursor, solo se mueve al saltar celdas:
+			if (Cursor != x)
+				P_LCD_2x16_Cursor(LCD, x, y);
+
+			P_LCD_2x16_Data(LCD_Frame[y][x], LCD);
+			LCD->Glass[y][x] = LCD_Frame[y][x];
+			Cursor = x + 1;
+		}
+	}
+}
+
+
+
+/*****************************************************************************
+REFRESH_LCD_2x16
+
+	* @author	A. Riedinger.
+	* @brief	REFRESH_LCD para el display de INIT_LCD_2x16.
+	* @returns	void
+	* @param
+		- LCD_2x16	Tabla de pines pasada a INIT_LCD_2x16 (con otra tabla
+					no hace nada).
+	* @ej
+		- REFRESH_LCD_2x16(LCD_2X16);
+******************************************************************************/
+void REFRESH_LCD_2x16(LCD_2X16_t* LCD_2X16)
+{
+	LCD_t* LCD = P_LCD_2x16_Legacy(LCD_2X16);
+
+	if (LCD != NULL)
+		REFRESH_LCD(LCD);
+}
+
+
+
+/*****************************************************************************
+INIT_LCD_QUEUE
+
+	* @author	A. Riedinger.
+	* @brief	Pasa el LCD a modo no bloqueante: los comandos y datos se
+				encolan y el TIM7 los saca de a una fase de nibble por
+				interrupcion, respetando los tiempos de E y de ejecucion sin
+				esperas activas. Llamar luego de INIT_LCD. Hay una sola
+				cola: los demas displays siguen escribiendo en forma bloqueante.
+	* @returns	void
+	* @param
+		- LCD		Display tipo LCD_t (ver INIT_LCD).
+		- Idle		Funcion llamada (desde la interrupcion) cuando la cola
+					queda vacia. Puede ser NULL.
+	* @ej
+		- INIT_LCD_QUEUE(&LCD, NULL);
+******************************************************************************/
+void INIT_LCD_QUEUE(LCD_t* LCD, void (*Idle)(void))
+{
+	TIM_TimeBaseInitTypeDef TIM_BaseStructure;
+
+	FLUSH_LCD_2x16();
+	LCD_QueueLCD = LCD;
+	LCD_QueueIdle = Idle;
+	LCD_QueueHead = 0;
+	LCD_QueueTail = 0;
+	LCD_QueueBusy = 0;
+	LCD_QueuePhase = 0;
+
+	/* TIM7 clock enable */
+	RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM7, ENABLE);
+
+	//Base de tiempo de 1 useg, el periodo se recarga en cada fase:
+	SystemCoreClockUpdate();
+	TIM_BaseStructure.TIM_Period = TLCD_PHASE_US - 1;
+	TIM_BaseStructure.TIM_Prescaler = (uint16_t) ((SystemCoreClock / 2) / 1000000) - 1;
+	TIM_BaseStructure.TIM_ClockDivision = 0;
+	TIM_BaseStructure.TIM_CounterMode = TIM_CounterMode_Up;
+	TIM_BaseStructure.TIM_RepetitionCounter = 0;
+	TIM_TimeBaseInit(TIM7, &TIM_BaseStructure);
+	TIM_ARRPreloadConfig(TIM7, DISABLE);
+	TIM_ClearFlag(TIM7, TIM_FLAG_Update);
+	TIM_ITConfig(TIM7, TIM_IT_Update, ENABLE);
+
+	/* Enable the TIM7 gloabal Interrupt */
+	P_IRQ_Enable(TIM7_IRQn, 1);
+
+	LCD_QueueOn = 1;
+}
+
+
+
+/*****************************************************************************
+INIT_LCD_2x16_QUEUE
+
+	* @author	A. Riedinger.
+	* @brief	INIT_LCD_QUEUE para el display de INIT_LCD_2x16.
+	* @returns	void
+	* @param
+		- LCD_2x16	Tabla de pines pasada a INIT_LCD_2x16 (con otra tabla
+					no hace nada).
+		- Idle		Funcion llamada (desde la interrupcion) cuando la cola
+					queda vacia. Puede ser NULL.
+	* @ej
+		- INIT_LCD_2x16_QUEUE(LCD_2X16, NULL);
+******************************************************************************/
+void INIT_LCD_2x16_QUEUE(LCD_2X16_t* LCD_2X16, void (*Idle)(void))
+{
+	LCD_t* LCD = P_LCD_2x16_Legacy(LCD_2X16);
+
+	if (LCD != NULL)
+		INIT_LCD_QUEUE(LCD, Idle);
+}
+
+
+
+/*****************************************************************************
+FLUSH_LCD_2x16
+
+	* @author	A. Riedinger.
+	* @brief	Espera a que la cola del LCD se vacie. Puede llamarse desde
+				cualquier contexto, incluso una interrupcion que bloquee al TIM7.
+	* @returns	void
+	* @ej
+		- FLUSH_LCD_2x16();
+******************************************************************************/
+void FLUSH_LCD_2x16(void)
+{
+	while (LCD_QueueBusy)
+		P_LCD_2x16_QueuePoll();
+}
+
+
+
+/*****************************************************************************
+TIM7_IRQHandler
+
+	* @author	A. Riedinger.
+	* @brief	Despacho de la cola del LCD, una fase por interrupcion.
+******************************************************************************/
+void TIM7_IRQHandler(void)
+{
+	P_LCD_2x16_QueuePoll();
+}
+
+
+
+/*****************************************************************************
+INIT_LCD_DMA
+
+	* @author	A. Riedinger.
+	* @brief	Prepara el modo de escritura por DMA: el TIM8 marca el paso y
+				los streams 2, 3 y 4 del DMA2 (canales CC1, CC2 y CC3 del TIM8)
+				escriben una secuencia de palabras BSRR precalculada en hasta
+				tres puertos GPIO, sin intervencion de la CPU.
+	* @returns
+		- 1		Modo DMA disponible.
+		- 0		Los pines del LCD ocupan mas de TLCD_DMA_PORTS puertos.
+	* @param
+		- LCD		Display tipo LCD_t (ver INIT_LCD). El modo DMA atiende
+					un solo display a la vez.
+	* @ej
+		- INIT_LCD_DMA(&LCD);
+******************************************************************************/
+uint8_t INIT_LCD_DMA(LCD_t* LCD)
+{
+	TIM_TimeBaseInitTypeDef TIM_BaseStructure;
+	TIM_OCInitTypeDef TIM_OCStructure;
+	TLCD_NAME_t lcd_pin;
+	uint8_t Index;
+
+	//Puertos distintos usados por los pines conectados del LCD:
+	LCD_WaveLCD = NULL;
+	LCD_WavePorts = 0;
+	for (lcd_pin = 0; lcd_pin < TLCD_ANZ; lcd_pin++)
+	{
+		if (LCD->Port[lcd_pin] == NULL)
+			continue;
+
+		for (Index = 0; Index < LCD_WavePorts; Index++)
+			if (LCD_WavePort[Index] == LCD->Port[lcd_pin])
+				break;
+
+		if (Index == LCD_WavePorts) {
+			if (LCD_WavePorts == TLCD_DMA_PORTS)
+				return 0;
+			LCD_WavePort[LCD_WavePorts++] = LCD->Port[lcd_pin];
+		}
+		LCD_WaveIndex[lcd_pin] = Index;
+	}
+	LCD_WaveLCD = LCD;
+
+	RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_DMA2, ENABLE);
+	RCC_APB2PeriphClockCmd(RCC_APB2Periph_TIM8, ENABLE);
+
+	//TIM8 a 1 MHz con periodo de un paso de la forma de onda (APB2 x2 = SystemCoreClock):
+	SystemCoreClockUpdate();
+	TIM_Cmd(TIM8, DISABLE);
+	TIM_BaseStructure.TIM_Period = TLCD_DMA_STEP_US - 1;
+	TIM_BaseStructure.TIM_Prescaler = (uint16_t) (SystemCoreClock / 1000000) - 1;
+	TIM_BaseStructure.TIM_ClockDivision = 0;
+	TIM_BaseStructure.TIM_CounterMode = TIM_CounterMode_Up;
+	TIM_BaseStructure.TIM_RepetitionCounter = 0;
+	TIM_TimeBaseInit(TIM8, &TIM_BaseStructure);
+
+	//Los tres canales comparan en 0, un pedido de DMA por puerto en cada paso:
+	TIM_OCStructInit(&TIM_OCStructure);
+	TIM_OCStructure.TIM_OCMode = TIM_OCMode_Timing;
+	TIM_OCStructure.TIM_Pulse = 0;
+	TIM_OC1Init(TIM8, &TIM_OCStructure);
+	TIM_OC2Init(TIM8, &TIM_OCStructure);
+	TIM_OC3Init(TIM8, &TIM_OCStructure);
+	TIM_DMACmd(TIM8, TIM_DMA_CC1 | TIM_DMA_CC2 | TIM_DMA_CC3, ENABLE);
+
+	return 1;
+}
+
+
+
+/*****************************************************************************
+INIT_LCD_2x16_DMA
+
+	* @author	A. Riedinger.
+	* @brief	INIT_LCD_DMA para el display de INIT_LCD_2x16.
+	* @returns
+		- 1		Modo DMA disponible.
+		- 0		Tabla sin INIT_LCD_2x16 o pines en mas de TLCD_DMA_PORTS puertos.
+	* @param
+		- LCD_2x16	Tabla de pines pasada a INIT_LCD_2x16 (con otra tabla
+					no hace nada).
+	* @ej
+		- INIT_LCD_2x16_DMA(LCD_2X16);
+******************************************************************************/
+uint8_t INIT_LCD_2x16_DMA(LCD_2X16_t* LCD_2X16)
+{
+	LCD_t* LCD = P_LCD_2x16_Legacy(LCD_2X16);
+
+	if (LCD == NULL)
+		return 0;
+	return INIT_LCD_DMA(LCD);
+}
+
+
+
+/*****************************************************************************
+PRINT_LCD_DMA
+
+	* @author	A. Riedinger.
+	* @brief	Imprime una string en el LCD por DMA. Arma la secuencia completa
+				de palabras BSRR (RS, nibbles y flancos de E, mas las esperas
+				de ejecucion) y la dispara; retorna sin esperar. No mezclar con
+				la cola de INIT_LCD_QUEUE mientras BUSY_LCD_2x16_DMA.
+	* @returns
+		- 1		Transferencia iniciada.
+		- 0		DMA ocupado, cola del LCD ocupada o modo no inicializado
+				para este display.
+	* @param
+		- LCD		Display tipo LCD_t (el de INIT_LCD_DMA).
+  	  	- x			Indicador de columna. Ej: 0 ... TLCD_COLS - 1.
+  	  	- y 		Indicador de fila. Ej: 0 ... TLCD_ROWS - 1.
+  	  	- ptr		Puntero a la string a imprimir (se recorta al fin de fila).
+	* @ej
+		- PRINT_LCD_DMA(&LCD, 0, 0, STR);
+******************************************************************************/
+uint8_t PRINT_LCD_DMA(LCD_t* LCD, uint8_t x, uint8_t y, char *ptr)
+{
+	DMA_InitTypeDef DMA_InitStructure;
+	uint16_t Step;
+	uint8_t Index;
+
+	if (LCD != LCD_WaveLCD || BUSY_LCD_2x16_DMA() || LCD_QueueBusy)
+		return 0;
+
+	if(x>=LCD->TLCD_COLS) x=0;
+	if(y>=LCD->TLCD_ROWS) y=0;
+
+	//Forma de onda: comando de cursor y luego los caracteres de la fila:
+	Step = P_LCD_2x16_WaveByte(0, 0x80 | P_LCD_2x16_Address(LCD, x, y), 0, LCD);
+	while (*ptr != 0 && x < LCD->TLCD_COLS) {
+		Step = P_LCD_2x16_WaveByte(Step, *ptr, 1, LCD);
+		LCD->Glass[y][x++] = *ptr++;
+	}
+
+	//Se rearma el TIM8 y un stream por puerto con la misma cantidad de pasos:
+	TIM_Cmd(TIM8, DISABLE);
+	TIM_SetCounter(TIM8, 0);
+
+	DMA_StructInit(&DMA_InitStructure);
+	DMA_InitStructure.DMA_Channel = DMA_Channel_7;
+	DMA_InitStructure.DMA_DIR = DMA_DIR_MemoryToPeripheral;
+	DMA_InitStructure.DMA_BufferSize = Step;
+	DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+	DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+	DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Word;
+	DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Word;
+	DMA_InitStructure.DMA_Mode = DMA_Mode_Normal;
+	DMA_InitStructure.DMA_Priority = DMA_Priority_High;
+	DMA_InitStructure.DMA_FIFOMode = DMA_FIFOMode_Disable;
+
+	for (Index = 0; Index < TLCD_DMA_PORTS; Index++)
+	{
+		DMA_Cmd(LCD_WaveStream[Index], DISABLE);
+		DMA_ClearFlag(LCD_WaveStream[Index], LCD_WaveFlags[Index]);
+		//Sin puerto asignado el stream no se habilita:
+		if (Index >= LCD_WavePorts)
+			continue;
+		//BSRRL y BSRRH juntos forman el registro BSRR de 32 bits:
+		DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t) &LCD_WavePort[Index]->BSRRL;
+		DMA_InitStructure.DMA_Memory0BaseAddr = (uint32_t) LCD_Wave[Index];
+		DMA_Init(LCD_WaveStream[Index], &DMA_InitStructure);
+		DMA_Cmd(LCD_WaveStream[Index], ENABLE);
+	}
+
+	TIM_Cmd(TIM8, ENABLE);
+	return 1;
+}
+
+
+
+/*****************************************************************************
+PRINT_LCD_2x16_DMA
+
+	* @author	A. Riedinger.
+	* @brief	PRINT_LCD_DMA para el display de INIT_LCD_2x16.
+	* @returns
+		- 1		Transferencia iniciada.
+		- 0		Tabla sin INIT_LCD_2x16_DMA, DMA ocupado o cola del LCD ocupada.
+	* @param
+		- LCD_2x16	Tabla de pines pasada a INIT_LCD_2x16 (con otra tabla
+					no hace nada).
+  	  	- x			Indicador de columna. Ej: 0 ... 15.
+  	  	- y 		Indicador de fila. Ej: 0 ... 1.
+  	  	- ptr		Puntero a la string a imprimir (se recorta al fin de fila).
+	* @ej
+		- PRINT_LCD_2x16_DMA(LCD_2X16, 0, 0, STR);
+******************************************************************************/
+uint8_t PRINT_LCD_2x16_DMA(LCD_2X16_t* LCD_2X16, uint8_t x, uint8_t y, char *ptr)
+{
+	LCD_t* LCD = P_LCD_2x16_Legacy(LCD_2X16);
+
+	if (LCD == NULL)
+		return 0;
+	return PRINT_LCD_DMA(LCD, x, y, ptr);
+}
+
+
+
+/*****************************************************************************
+BUSY_LCD_2x16_DMA
+
+	* @author	A. Riedinger.
+	* @brief	Indica si hay una escritura por DMA en curso.
+	* @returns
+		- 1		Transferencia en curso.
+		- 0		DMA libre.
+	* @ej
+		- while (BUSY_LCD_2x16_DMA());
+******************************************************************************/
+uint8_t BUSY_LCD_2x16_DMA(void)
+{
+	uint8_t Index;
+
+	for (Index = 0; Index < LCD_WavePorts; Index++)
+		if (DMA_GetCmdStatus(LCD_WaveStream[Index]) == ENABLE)
+			return 1;
+
+	return 0;
+}
+
+
+
+/*****************************************************************************
+BUS_OPS_LCD_2x16
+
+	* @author	A. Riedinger.
+	* @brief	Cantidad de escrituras a registros GPIO (BSRR/MODER) hechas por
+				el driver del LCD desde el arranque, en modo bloqueante y desde
+				la cola. Las de la forma de onda DMA no usan la CPU y no se
+				cuentan. Requiere TLCD_BENCH en 1, si no devuelve 0.
+	* @returns
+		- BusOps	Escrituras acumuladas (da la vuelta a los 2^32).
+	* @ej
+		- Ops = BUS_OPS_LCD_2x16();
+******************************************************************************/
+uint32_t BUS_OPS_LCD_2x16(void)
+{
+#if TLCD_BENCH
+	return LCD_BusOps;
+#else
+	return 0;
+#endif
+}
+
+
+
+/*****************************************************************************
+INIT_SYSTICK
+
+	* @author	A. Riedinger.
+	* @brief	Inicializa la Interrupcion por tiempo definido por el usuario.
+	* @returns	void
+	* @param
+		- seg	Tiempo en segundos a los que se realizara la interrupcion.
+
+	* @ej
+		- INIT_SYSTICK(1/1000); //Interrupcion cada 1 mseg.
+******************************************************************************/
+void INIT_SYSTICK(float div)
+{
+	SysTick_Config(SystemCoreClock * div);
+	RCC_ClocksTypeDef Clocks_Values;
+	RCC_GetClocksFreq(&Clocks_Values);
+}
+
+
+
+/*****************************************************************************
+INIT_SCHED
+
+	* @author	A. Riedinger.
+	* @brief	Inicializa el despachador de tareas periodicas con una tabla
+				estatica. La tabla se reordena por prioridad (0 = la mas alta).
+				Cada tarea se libera por primera vez en el tick
+				TASK_PERIOD + TASK_PHASE y luego cada TASK_PERIOD ticks. Los
+				ticks los da TICK_SCHED, o son microsegundos si luego se llama
+				a INIT_SCHED_TICKLESS.
+	* @returns	void
+	* @param
+		- Tasks		Tabla de tareas tipo SCHED_TASK_t.
+		- TaskAnz	Cantidad de tareas de la tabla.
+	* @ej
+		- INIT_SCHED(TSCHED_TABLE(Tasks));
+******************************************************************************/
+void INIT_SCHED(SCHED_TASK_t* Tasks, uint8_t TaskAnz)
+{
+	SCHED_TASK_t Task;
+	uint8_t i, j;
+
+	//Ordenamiento por insercion, estable para tareas de igual prioridad:
+	for (i = 1; i < TaskAnz; i++) {
+		Task = Tasks[i];
+		for (j = i; j > 0 && Tasks[j - 1].TASK_PRIO > Task.TASK_PRIO; j--)
+			Tasks[j] = Tasks[j - 1];
+		Tasks[j] = Task;
+	}
+
+	for (i = 0; i < TaskAnz; i++) {
+		Tasks[i].Next = Tasks[i].TASK_PERIOD + Tasks[i].TASK_PHASE;
+		Tasks[i].Released = 0;
+		Tasks[i].Done = 0;
+		Tasks[i].Probe = (PROBE_t) { 0 };
+	}
+
+	SCHED_Ticks = 0;
+	SCHED_Tickless = 0;
+	SCHED_Tasks = Tasks;
+	SCHED_TaskAnz = TaskAnz;
+}
+
+
+/*****************************************************************************
+INIT_SCHED_TICKLESS
+
+	* @author	A. Riedinger.
+	* @brief	Pasa el despachador a modo sin ticks: el TIM2 (32 bits) cuenta
+				libre a 1 MHz como reloj monotonico y su canal CC1 se programa
+				en la proxima liberacion, asi solo hay interrupcion cuando una
+				tarea vence. Periodos y fases de la tabla quedan en useg (hasta
+				35 minutos). No hace falta el SysTick ni TICK_SCHED.
+	* @returns	void
+	* @ej
+		- INIT_SCHED(TSCHED_TABLE(Tasks));
+		- INIT_SCHED_TICKLESS();
+******************************************************************************/
+void INIT_SCHED_TICKLESS(void)
+{
+	TIM_TimeBaseInitTypeDef TIM_BaseStructure;
+	uint8_t i;
+
+	/* TIM2 clock enable */
+	RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM2, ENABLE);
+
+	//Base de tiempo de 1 useg, cuenta completa de 32 bits:
+	SystemCoreClockUpdate();
+	TIM_Cmd(TIM2, DISABLE);
+	TIM_BaseStructure.TIM_Period = 0xFFFFFFFF;
+	TIM_BaseStructure.TIM_Prescaler = (uint16_t) ((SystemCoreClock / 2) / 1000000) - 1;
+	TIM_BaseStructure.TIM_ClockDivision = 0;
+	TIM_BaseStructure.TIM_CounterMode = TIM_CounterMode_Up;
+	TIM_BaseStructure.TIM_RepetitionCounter = 0;
+	TIM_TimeBaseInit(TIM2, &TIM_BaseStructure);
+	TIM_SetCounter(TIM2, 0);
+
+	//Primeras liberaciones contadas desde ahora, en useg:
+	for (i = 0; i < SCHED_TaskAnz; i++)
+		SCHED_Tasks[i].Next = SCHED_Tasks[i].TASK_PERIOD + SCHED_Tasks[i].TASK_PHASE;
+	SCHED_Tickless = 1;
+
+	TIM_ClearITPendingBit(TIM2, TIM_IT_CC1);
+	TIM_ITConfig(TIM2, TIM_IT_CC1, ENABLE);
+	TIM_Cmd(TIM2, ENABLE);
+	P_SCHED_Arm();
+
+	/* Enable the TIM2 gloabal Interrupt */
+	P_IRQ_Enable(TIM2_IRQn, 2);
+}
+
+
+
+/*****************************************************************************
+NOW_SCHED
+
+	* @author	A. Riedinger.
+	* @brief	Tiempo del despachador: useg del TIM2 en modo sin ticks (da la
+				vuelta cada 71 minutos) o ticks de TICK_SCHED.
+	* @returns
+		- Now		Tiempo actual.
+	* @ej
+		- Start = NOW_SCHED();
+******************************************************************************/
+uint32_t NOW_SCHED(void)
+{
+	if (SCHED_Tickless)
+		return TIM2->CNT;
+
+	return SCHED_Ticks;
+}
+
+
+
+/*****************************************************************************
+TIM2_IRQHandler
+
+	* @author	A. Riedinger.
+	* @brief	Despachador sin ticks: libera las tareas vencidas y programa el
+				CC1 en la proxima liberacion. Tiempos en SCHED_Probe.
+******************************************************************************/
+void TIM2_IRQHandler(void)
+{
+	if (TIM_GetITStatus(TIM2, TIM_IT_CC1) != RESET) {
+		TIM_ClearITPendingBit(TIM2, TIM_IT_CC1);
+		PROBE_TIMER(&SCHED_Probe, TIM2, TIM2->CCR1);
+		PROBE_ENTER(&SCHED_Probe);
+		P_SCHED_Arm();
+		PROBE_EXIT(&SCHED_Probe);
+	}
+}
+
+
+
+
+/*****************************************************************************
+TICK_SCHED
+
+	* @author	A. Riedinger.
+	* @brief	Avanza un tick del despachador y libera las tareas cuyo periodo
+				se cumplio. Lo llama SysTick_Handler (stm32f4xx_it.c, sin
+				Use_RTOS) tras INIT_SYSTICK. Las liberaciones se acumulan: si el
+				bucle principal se atrasa, RUN_SCHED ejecuta las que faltan.
+	* @returns	void
+	* @ej
+		- TICK_SCHED(); //En SysTick_Handler.
+******************************************************************************/
+void TICK_SCHED(void)
+{
+	P_SCHED_Release(++SCHED_Ticks);
+}
+
+
+
+/*****************************************************************************
+RUN_SCHED
+
+	* @author	A. Riedinger.
+	* @brief	Ejecuta todas las tareas liberadas, una liberacion por vez y
+				siempre la de mayor prioridad primero (una tarea liberada
+				mientras corre otra de menor prioridad pasa adelante). Se llama
+				desde el bucle principal, fuera de interrupciones. Cada
+				ejecucion se mide en el PROBE_t de la tarea.
+	* @returns
+		- Runs		Cantidad de ejecuciones realizadas.
+	* @ej
+		- RUN_SCHED();
+******************************************************************************/
+uint32_t RUN_SCHED(void)
+{
+	uint32_t Runs = 0;
+	uint8_t i = 0;
+
+	while (i < SCHED_TaskAnz) {
+		//Released solo lo escribe TICK_SCHED y Done solo RUN_SCHED, sin secciones criticas:
+		if (SCHED_Tasks[i].Released != SCHED_Tasks[i].Done) {
+			PROBE_ENTER(&SCHED_Tasks[i].Probe);
+			SCHED_Tasks[i].TASK_FUNC();
+			PROBE_EXIT(&SCHED_Tasks[i].Probe);
+			//Recien al terminar, una liberacion durante la ejecucion es overrun:
+			SCHED_Tasks[i].Done++;
+			Runs++;
+			i = 0;
+		}
+		else
+			i++;
+	}
+
+	return Runs;
+}
+
+
+
+/*****************************************************************************
+PENDING_SCHED
+
+	* @author	A. Riedinger.
+	* @brief	Indica si hay tareas liberadas sin ejecutar. Antes de dormir
+				con __WFI se consulta con las interrupciones deshabilitadas.
+	* @returns
+		- 1			Hay tareas pendientes.
+		- 0			No hay tareas pendientes.
+	* @ej
+		- if (!PENDING_SCHED()) __WFI();
+******************************************************************************/
+uint8_t PENDING_SCHED(void)
+{
+	uint8_t i;
+
+	for (i = 0; i < SCHED_TaskAnz; i++)
+		if (SCHED_Tasks[i].Released != SCHED_Tasks[i].Done)
+			return 1;
+
+	return 0;
+}
+
+
+
+/*****************************************************************************
+INIT_DEFER
+
+	* @author	A. Riedinger.
+	* @brief	Prepara el trabajo diferido: el PendSV queda con la prioridad
+				mas baja, asi lo encolado con DEFER corre despues de todas las
+				interrupciones y antes de volver al bucle principal.
+	* @returns	void
+	* @ej
+		- INIT_DEFER();
+******************************************************************************/
+void INIT_DEFER(void)
+{
+	uint8_t i;
+
+	for (i = 0; i < DEFER_MAX; i++)
+		DEFER_Work[i] = NULL;
+
+	NVIC_SetPriority(PendSV_IRQn, (1 << __NVIC_PRIO_BITS) - 1);
+}
+
+
+
+/*****************************************************************************
+DEFER
+
+	* @author	A. Riedinger.
+	* @brief	Encola una funcion para ejecutarla en el PendSV (mitad inferior
+				de una interrupcion). Si ya estaba pendiente no se repite. Puede
+				llamarse desde cualquier interrupcion.
+	* @returns
+		- 1			Funcion encolada o ya pendiente.
+		- 0			Cola llena (DEFER_MAX funciones pendientes).
+	* @param
+		- Work		Funcion a ejecutar.
+	* @ej
+		- DEFER(DRAW_LCD);
+******************************************************************************/
+uint8_t DEFER(void (*Work)(void))
+{
+	uint32_t Primask = __get_PRIMASK();
+	uint8_t i, Free = DEFER_MAX;
+
+	//Interrupciones de cualquier prioridad pueden encolar a la vez:
+	__disable_irq();
+	for (i = 0; i < DEFER_MAX; i++) {
+		if (DEFER_Work[i] == Work)
+			break;
+		if (DEFER_Work[i] == NULL && Free == DEFER_MAX)
+			Free = i;
+	}
+	if (i == DEFER_MAX && Free != DEFER_MAX)
+		DEFER_Work[i = Free] = Work;
+	__set_PRIMASK(Primask);
+
+	if (i == DEFER_MAX)
+		return 0;
+
+	SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+	return 1;
+}
+
+
+
+/*****************************************************************************
+RUN_DEFER
+
+	* @author	A. Riedinger.
+	* @brief	Ejecuta las funciones encoladas con DEFER, en orden de cola. Se
+				llama desde PendSV_Handler (stm32f4xx_it.c, o cmsis_os.c con
+				Use_RTOS).
+	* @returns	void
+	* @ej
+		- RUN_DEFER(); //En PendSV_Handler.
+******************************************************************************/
+void RUN_DEFER(void)
+{
+	void (*Work)(void);
+	uint8_t i;
+
+	for (i = 0; i < DEFER_MAX; i++) {
+		//Se libera el lugar antes de ejecutar: puede volver a encolarse mientras corre:
+		__disable_irq();
+		Work = DEFER_Work[i];
+		DEFER_Work[i] = NULL;
+		__enable_irq();
+
+		if (Work != NULL)
+			Work();
+	}
+}
+
+
+
+/*****************************************************************************
+INIT_SPSC
+
+	* @author	A. Riedinger.
+	* @brief	Inicializa una cola de un productor y un consumidor (por ejemplo
+				una interrupcion y una tarea). Cada indice lo escribe un solo
+				lado, asi no hace falta deshabilitar interrupciones.
+	* @returns	void
+	* @param
+		- Queue		Cola a inicializar.
+		- Buffer	Arreglo de elementos, TSPSC_BUFFER(Buffer) completa los
+					tres ultimos parametros. La cantidad debe ser potencia de 2.
+	* @ej
+		- INIT_SPSC(&KeyQueue, TSPSC_BUFFER(KeyBuffer));
+******************************************************************************/
+void INIT_SPSC(SPSC_t* Queue, void* Buffer, uint16_t Size, uint16_t Item)
+{
+	Queue->SPSC_BUF = Buffer;
+	Queue->SPSC_SIZE = Size;
+	Queue->SPSC_ITEM = Item;
+	Queue->Head = 0;
+	Queue->Tail = 0;
+	Queue->Lost = 0;
+}
+
+
+
+/*****************************************************************************
+PUT_SPSC
+
+	* @author	A. Riedinger.
+	* @brief	Agrega un elemento a la cola. Solo la llama el productor.
+	* @returns
+		- 1			Elemento agregado.
+		- 0			Cola llena, el elemento se descarta y se cuenta en Lost.
+	* @param
+		- Queue		Cola.
+		- Item		Elemento a copiar (SPSC_ITEM bytes).
+	* @ej
+		- PUT_SPSC(&KeyQueue, &Key);
+******************************************************************************/
+uint8_t PUT_SPSC(SPSC_t* Queue, const void* Item)
+{
+	uint32_t Head = Queue->Head;
+
+	//Los indices corren libres, la diferencia es la ocupacion:
+	if (Head - Queue->Tail >= Queue->SPSC_SIZE) {
+		Queue->Lost++;
+		return 0;
+	}
+
+	memcpy((uint8_t*) Queue->SPSC_BUF + (Head & (Queue->SPSC_SIZE - 1)) * Queue->SPSC_ITEM,
+			Item, Queue->SPSC_ITEM);
+
+	//El dato tiene que estar escrito antes de que el consumidor vea el indice:
+	P_DMB();
+	Queue->Head = Head + 1;
+	return 1;
+}
+
+
+
+/*****************************************************************************
+GET_SPSC
+
+	* @author	A. Riedinger.
+	* @brief	Saca el elemento mas viejo de la cola. Solo la llama el consumidor.
+	* @returns
+		- 1			Elemento copiado en Item.
+		- 0			Cola vacia.
+	* @param
+		- Queue		Cola.
+		- Item		Destino del elemento (SPSC_ITEM bytes).
+	* @ej
+		- while (GET_SPSC(&KeyQueue, &Key)) { ... }
+******************************************************************************/
+uint8_t GET_SPSC(SPSC_t* Queue, void* Item)
+{
+	uint32_t Tail = Queue->Tail;
+
+	if (Queue->Head == Tail)
+		return 0;
+
+	//El indice se lee antes que el dato que protege:
+	P_DMB();
+	memcpy(Item, (const uint8_t*) Queue->SPSC_BUF + (Tail & (Queue->SPSC_SIZE - 1)) * Queue->SPSC_ITEM,
+			Queue->SPSC_ITEM);
+
+	//El lugar se libera recien despues de copiar el dato:
+	P_DMB();
+	Queue->Tail = Tail + 1;
+	return 1;
+}
+
+
+
+/*****************************************************************************
+COUNT_SPSC
+
+	* @author	A. Riedinger.
+	* @brief	Cantidad de elementos en la cola. Desde cualquiera de los dos
+				lados es una cota: el otro puede agregar o sacar mientras tanto.
+	* @returns	Elementos en la cola.
+	* @param
+		- Queue		Cola.
+	* @ej
+		- if (COUNT_SPSC(&KeyQueue)) { ... }
+******************************************************************************/
+uint16_t COUNT_SPSC(SPSC_t* Queue)
+{
+	return Queue->Head - Queue->Tail;
+}
+
+
+
+/*****************************************************************************
+WRITE_SEQLOCK
+
+	* @author	A. Riedinger.
+	* @brief	Publica una copia de un estado compartido protegido por un
+				seqlock. Un solo escritor por seqlock (una tarea o una
+				interrupcion); el contador queda impar mientras se copia.
+	* @returns	void
+	* @param
+		- Lock		Seqlock del estado.
+		- Shared	Estado compartido (destino).
+		- Local		Estado del escritor (origen).
+		- Size		Tamano del estado [bytes].
+	* @ej
+		- WRITE_SEQLOCK(&KeysLock, &Keys, &KeysLocal, sizeof(Keys));
+******************************************************************************/
+void WRITE_SEQLOCK(SEQLOCK_t* Lock, void* Shared, const void* Local, uint16_t Size)
+{
+	Lock->Seq++;
+	P_DMB();
+	memcpy(Shared, Local, Size);
+	P_DMB();
+	Lock->Seq++;
+}
+
+
+
+/*****************************************************************************
+READ_SEQLOCK
+
+	* @author	A. Riedinger.
+	* @brief	Copia un estado protegido por un seqlock, sin bloquear al
+				escritor. Si el escritor lo estaba modificando la copia no es
+				valida: un lector de menor prioridad que el escritor puede
+				reintentar, uno de mayor prioridad (una interrupcion que corto
+				al escritor) no, y se queda con la copia anterior.
+	* @returns
+		- 1			Copia consistente en Local.
+		- 0			Copia invalida, el escritor estaba a mitad de camino.
+	* @param
+		- Lock		Seqlock del estado.
+		- Local		Copia del lector (destino).
+		- Shared	Estado compartido (origen).
+		- Size		Tamano del estado [bytes].
+	* @ej
+		- while (!READ_SEQLOCK(&ViewLock, &View, &ViewShared, sizeof(View)));
+******************************************************************************/
+uint8_t READ_SEQLOCK(SEQLOCK_t* Lock, void* Local, const void* Shared, uint16_t Size)
+{
+	uint32_t Seq = Lock->Seq;
+
+	if (Seq & 1)
+		return 0;
+
+	P_DMB();
+	memcpy(Local, Shared, Size);
+	P_DMB();
+
+	return Lock->Seq == Seq;
+}
+
+
+
+/*****************************************************************************
+INIT_TIMERS
+
+	* @author	A. Riedinger.
+	* @brief	Vacia la rueda de timers por software y pone su cuenta en cero.
+				Los timers corren con TICK_TIMERS, llamada una vez por tick
+				(por ejemplo desde una tarea del despachador).
+	* @returns	void
+	* @ej
+		- INIT_TIMERS();
+******************************************************************************/
+void INIT_TIMERS(void)
+{
+	uint8_t Level, Slot;
+
+	for (Level = 0; Level < TIMER_WHEEL_LEVELS; Level++)
+		for (Slot = 0; Slot < TIMER_WHEEL_SLOTS; Slot++)
+			TIMER_Wheel[Level][Slot] = NULL;
+
+	TIMER_Now = 0;
 }
 
 
 
 /*****************************************************************************
-DAC_FUNC
+START_TIMER
 
 	* @author	A. Riedinger.
-	* @brief	Convierte un valor leido por el ADC a su equivalente analogico.
-	* @returns
-		- return	Devuelve el valor ANALOGICO de la lectura en el ADCX.
+	* @brief	Arranca (o rearranca) un timer por software, en O(1). Vence a
+				los Delay ticks y, si TIMER_PERIOD no es 0, se repite cada
+				TIMER_PERIOD ticks. Los timers los provee quien llama, no hay
+				limite de cantidad.
+	* @returns	void
 	* @param
-		- ADC_DATA	Valor DIGITAL leido en el ADC. Ej: a = READ_ADC(ADCX);
-		- MAX_AN 	Valor ANALOGICO maximo que puede tomar la variable.
+		- Timer		Timer con TIMER_FUNC, TIMER_ARG y TIMER_PERIOD completos
+					(TIMER_PERIOD tambien se limita al alcance de la rueda).
+		- Delay		Ticks hasta el primer vencimiento (0 = en el proximo tick,
+					tambien desde la funcion de un timer; se limita al
+					alcance de la rueda).
 	* @ej
-		- DAC_FUNC(ValActualADC_CuentasDigitales, ValorMaximoAnalogico);
+		- START_TIMER(&TimerTemp, 205);
 ******************************************************************************/
-int DAC_FUNC(uint32_t ADC_DATA, int MAX_AN)
+void START_TIMER(TIMER_t* Timer, uint32_t Delay)
 {
-	return (float) ADC_DATA * MAX_AN / MaxDigCount;
+	uint32_t Primask = __get_PRIMASK();
+
+	//Mas alla del alcance la ranura del ultimo nivel da la vuelta y venceria antes:
+	if (Delay >= TIMER_WHEEL_SPAN)
+		Delay = TIMER_WHEEL_SPAN - 1;
+	if (Timer->TIMER_PERIOD >= TIMER_WHEEL_SPAN)
+		Timer->TIMER_PERIOD = TIMER_WHEEL_SPAN - 1;
+
+	__disable_irq();
+	P_TIMER_Unlink(Timer);
+	Timer->Expires = TIMER_Now + Delay;
+	P_TIMER_Insert(Timer);
+	__set_PRIMASK(Primask);
 }
 
 
 
 /*****************************************************************************
-INIT_LCD_2x16
+STOP_TIMER
 
 	* @author	A. Riedinger.
-	* @brief	Inicializa los pines del display.
+	* @brief	Detiene un timer, en O(1). Se puede llamar desde su propia
+				funcion para cortar un timer periodico.
 	* @returns	void
 	* @param
-		- LCD_2x16	Arreglo tipo LCD_2X16_t con los pines del LCD. Ej:
-					LCD_2X16_t LCD_2X16[] = {
- 	 	 	 	 	// Name  , PORT,    PIN     ,          CLOCK     , Init
-  	  	  	  	  	{TLCD_RS ,GPIOC,GPIO_Pin_10 ,RCC_AHB1Periph_GPIOC,Bit_RESET},
-  	  	  	  	  	{TLCD_E  ,GPIOC,GPIO_Pin_11 ,RCC_AHB1Periph_GPIOC,Bit_RESET},
-  	  	  	  	  	{TLCD_D4 ,GPIOC,GPIO_Pin_12 ,RCC_AHB1Periph_GPIOC,Bit_RESET},
-  	  	  	  	  	{TLCD_D5 ,GPIOD,GPIO_Pin_2  ,RCC_AHB1Periph_GPIOD,Bit_RESET},
-  	  	  	  	  	{TLCD_D6 ,GPIOF,GPIO_Pin_9  ,RCC_AHB1Periph_GPIOF,Bit_RESET},
-  	  	  	  	  	{TLCD_D7 ,GPIOF,GPIO_Pin_7  ,RCC_AHB1Periph_GPIOF,Bit_RESET},};
+		- Timer		Timer a detener (si no estaba corriendo no hace nada).
 	* @ej
-		- INIT_LCD_2x16(LCD_2X16);
+		- STOP_TIMER(&TimerTemp);
 ******************************************************************************/
-void INIT_LCD_2x16(LCD_2X16_t* LCD_2X16)
+void STOP_TIMER(TIMER_t* Timer)
 {
-	  //Inicialización de los pines del LCD:
-	  P_LCD_2x16_InitIO(LCD_2X16);
-	  // kleine Pause
-	  P_LCD_2x16_Delay(TLCD_INIT_PAUSE);
-	  // Init Sequenz starten
-	  P_LCD_2x16_InitSequenz(LCD_2X16);
-	  // LCD-Settings einstellen
-	  P_LCD_2x16_Cmd(TLCD_CMD_INIT_DISPLAY, LCD_2X16);
-	  P_LCD_2x16_Cmd(TLCD_CMD_ENTRY_MODE, LCD_2X16);
-	  // Display einschalten
-	  P_LCD_2x16_Cmd(TLCD_CMD_DISP_M1, LCD_2X16);
-	  // Display l�schen
-	  P_LCD_2x16_Cmd(TLCD_CMD_CLEAR, LCD_2X16);
-	  // kleine Pause
-	  P_LCD_2x16_Delay(TLCD_PAUSE);
+	uint32_t Primask = __get_PRIMASK();
+
+	__disable_irq();
+	P_TIMER_Unlink(Timer);
+	__set_PRIMASK(Primask);
 }
 
 
 
 /*****************************************************************************
-CLEAR_LCD_2x16
+ACTIVE_TIMER
 
 	* @author	A. Riedinger.
-	* @brief	Refresca la pantalla del LCD.
-	* @returns	void
+	* @brief	Indica si un timer esta corriendo.
+	* @returns
+		- 1			Timer en la rueda.
+		- 0			Timer detenido o one-shot ya vencido.
 	* @param
-		- LCD_2x16	Arreglo tipo LCD_2X16_t con los pines del LCD. Ej:
-					LCD_2X16_t LCD_2X16[] = {
- 	 	 	 	 	// Name  , PORT,    PIN     ,          CLOCK     , Init
-  	  	  	  	  	{TLCD_RS ,GPIOC,GPIO_Pin_10 ,RCC_AHB1Periph_GPIOC,Bit_RESET},
-  	  	  	  	  	{TLCD_E  ,GPIOC,GPIO_Pin_11 ,RCC_AHB1Periph_GPIOC,Bit_RESET},
-  	  	  	  	  	{TLCD_D4 ,GPIOC,GPIO_Pin_12 ,RCC_AHB1Periph_GPIOC,Bit_RESET},
-  	  	  	  	  	{TLCD_D5 ,GPIOD,GPIO_Pin_2  ,RCC_AHB1Periph_GPIOD,Bit_RESET},
-  	  	  	  	  	{TLCD_D6 ,GPIOF,GPIO_Pin_9  ,RCC_AHB1Periph_GPIOF,Bit_RESET},
-  	  	  	  	  	{TLCD_D7 ,GPIOF,GPIO_Pin_7  ,RCC_AHB1Periph_GPIOF,Bit_RESET},};
+		- Timer		Timer a consultar.
 	* @ej
-		- UB_LCD_2x16_Clear(LCD_2X16);
+		- if (!ACTIVE_TIMER(&TimerTemp)) START_TIMER(&TimerTemp, 10);
 ******************************************************************************/
-void CLEAR_LCD_2x16(LCD_2X16_t* LCD_2X16)
+uint8_t ACTIVE_TIMER(TIMER_t* Timer)
 {
-  // Display l�schen
-  P_LCD_2x16_Cmd(TLCD_CMD_CLEAR, LCD_2X16);
-  // kleine Pause
-  P_LCD_2x16_Delay(TLCD_PAUSE);
+	return Timer->Prev != NULL;
 }
 
 
 
 /*****************************************************************************
-PRINT_LCD_2x16
+TICK_TIMERS
 
 	* @author	A. Riedinger.
-	* @brief	Imprime una string en el LCD.
+	* @brief	Avanza la rueda un tick y ejecuta las funciones de los timers
+				vencidos. Los timers de los niveles altos bajan de nivel
+				(cascada) cuando el nivel de abajo da la vuelta, asi cada
+				timer se mueve a lo sumo TIMER_WHEEL_LEVELS veces.
+				Las funciones corren en el contexto de quien llama, con las
+				interrupciones habilitadas. Lo que arrancan (aun con Delay 0)
+				vence en un tick posterior, nunca en el que se esta atendiendo.
 	* @returns	void
-	* @param
-		- LCD_2x16	Arreglo tipo LCD_2X16_t con los pines del LCD. Ej:
-					LCD_2X16_t LCD_2X16[] = {
- 	 	 	 	 	// Name  , PORT,    PIN     ,          CLOCK     , Init
-  	  	  	  	  	{TLCD_RS ,GPIOC,GPIO_Pin_10 ,RCC_AHB1Periph_GPIOC,Bit_RESET},
-  	  	  	  	  	{TLCD_E  ,GPIOC,GPIO_Pin_11 ,RCC_AHB1Periph_GPIOC,Bit_RESET},
-  	  	  	  	  	{TLCD_D4 ,GPIOC,GPIO_Pin_12 ,RCC_AHB1Periph_GPIOC,Bit_RESET},
-  	  	  	  	  	{TLCD_D5 ,GPIOD,GPIO_Pin_2  ,RCC_AHB1Periph_GPIOD,Bit_RESET},
-  	  	  	  	  	{TLCD_D6 ,GPIOF,GPIO_Pin_9  ,RCC_AHB1Periph_GPIOF,Bit_RESET},
-  	  	  	  	  	{TLCD_D7 ,GPIOF,GPIO_Pin_7  ,RCC_AHB1Periph_GPIOF,Bit_RESET},};
-  	  	- x			Indicador de fila. Ej: 0 ... 1.
-  	  	- y 		Indicador de columna. Ej: 0 .. 16.
-  	  	- ptr		Puntero a la string a imprimir.
-
 	* @ej
-		- PRINT_LCD_2x16(LCD_2X16, 0, 0, STR);
+		- TICK_TIMERS(); //Tarea del despachador con el periodo del tick.
 ******************************************************************************/
-void PRINT_LCD_2x16(LCD_2X16_t* LCD_2X16, uint8_t x, uint8_t y, char *ptr)
+void TICK_TIMERS(void)
 {
-  // Cursor setzen
-  P_LCD_2x16_Cursor(LCD_2X16,x,y);
-  // kompletten String ausgeben
-  while (*ptr != 0) {
-    P_LCD_2x16_Data(*ptr, LCD_2X16);
-    ptr++;
-  }
+	uint32_t Primask = __get_PRIMASK();
+	uint8_t Level, Slot;
+	TIMER_t* Timer;
+	TIMER_t* Due;
+
+	__disable_irq();
+
+	//Al dar la vuelta un nivel se reparten las ranuras que tocan de los de arriba:
+	for (Level = 1; Level < TIMER_WHEEL_LEVELS; Level++) {
+		if (TIMER_Now & ((1UL << (TIMER_WHEEL_BITS * Level)) - 1))
+			break;
+
+		Slot = (TIMER_Now >> (TIMER_WHEEL_BITS * Level)) & (TIMER_WHEEL_SLOTS - 1);
+		while ((Timer = TIMER_Wheel[Level][Slot]) != NULL) {
+			P_TIMER_Unlink(Timer);
+			P_TIMER_Insert(Timer);
+		}
+	}
+
+	//Vencidos: la ranura sale de la rueda y la cuenta pasa al tick siguiente, asi lo
+	//que se engancha desde aca (periodos, Delay 0 o atrasados) no vuelve a esta vuelta:
+	Slot = TIMER_Now & (TIMER_WHEEL_SLOTS - 1);
+	TIMER_Now++;
+	Due = TIMER_Wheel[0][Slot];
+	TIMER_Wheel[0][Slot] = NULL;
+	if (Due != NULL)
+		Due->Prev = &Due;
+
+	//De a uno, una funcion puede detener o arrancar cualquier timer:
+	while ((Timer = Due) != NULL) {
+		P_TIMER_Unlink(Timer);
+		if (Timer->TIMER_PERIOD) {
+			Timer->Expires += Timer->TIMER_PERIOD;
+			P_TIMER_Insert(Timer);
+		}
+		__set_PRIMASK(Primask);
+
+		Timer->TIMER_FUNC(Timer->TIMER_ARG);
+
+		__disable_irq();
+	}
+
+	__set_PRIMASK(Primask);
 }
 
 
 
 /*****************************************************************************
-INIT_SYSTICK
+INIT_IRQ_PRIO
 
 	* @author	A. Riedinger.
-	* @brief	Inicializa la Interrupcion por tiempo definido por el usuario.
+	* @brief	Aplica el mapa de prioridades del NVIC, una sola vez al arrancar
+				y antes de los INIT_* que habilitan interrupciones. Usa 4 bits
+				de prioridad de desalojo y ninguno de subprioridad (0 = la mas
+				alta). Los INIT_* toman su prioridad de la tabla y, si no
+				figura, la que tenian por defecto. PendSV y SysTick quedan en
+				15 y 14 (INIT_DEFER y el kernel de cmsis_os.c).
 	* @returns	void
 	* @param
-		- seg	Tiempo en segundos a los que se realizara la interrupcion.
-
+		- Table		Tabla de interrupciones y prioridades, TIRQ_TABLE(Table)
+					completa los dos parametros. Tiene que seguir existiendo.
 	* @ej
-		- INIT_SYSTICK(1/1000); //Interrupcion cada 1 mseg.
+		- INIT_IRQ_PRIO(TIRQ_TABLE(IrqPrio));
 ******************************************************************************/
-void INIT_SYSTICK(float div)
+void INIT_IRQ_PRIO(const IRQ_PRIO_t* Table, uint8_t Anz)
 {
-	SysTick_Config(SystemCoreClock * div);
-	RCC_ClocksTypeDef Clocks_Values;
-	RCC_GetClocksFreq(&Clocks_Values);
+	uint8_t i;
+
+	NVIC_PriorityGroupConfig(NVIC_PriorityGroup_4);
+
+	IRQ_PrioTable = Table;
+	IRQ_PrioAnz = Anz;
+	for (i = 0; i < Anz; i++)
+		NVIC_SetPriority(Table[i].IRQ_NUM, Table[i].IRQ_PRIO);
 }
 
 
@@ -687,17 +3226,11 @@ INIT_TIM3
 ******************************************************************************/
 void INIT_TIM3()
 {
-	NVIC_InitTypeDef NVIC_InitStructure;
-
 	/* TIM3 clock enable */
 	RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM3, ENABLE);
 
 	/* Enable the TIM3 gloabal Interrupt */
-	NVIC_InitStructure.NVIC_IRQChannel = TIM3_IRQn;
-	NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 0;
-	NVIC_InitStructure.NVIC_IRQChannelSubPriority = 1;
-	NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
-	NVIC_Init(&NVIC_InitStructure);
+	P_IRQ_Enable(TIM3_IRQn, 0);
 }
 
 
@@ -759,7 +3292,6 @@ INIT_EXTINT
 void INIT_EXTINT(GPIO_TypeDef* Port, uint16_t Pin)
 {
 	GPIO_InitTypeDef GPIO_InitStructure;
-	NVIC_InitTypeDef NVIC_InitStructure;
 
 	/* Enable GPIO clock */
 	uint32_t Clock;
@@ -784,13 +3316,8 @@ void INIT_EXTINT(GPIO_TypeDef* Port, uint16_t Pin)
 	EXTI_InitStructure.EXTI_LineCmd = ENABLE;
 	EXTI_Init(&EXTI_InitStructure);
 
-	/* Enable and set EXTI Line0 Interrupt to the lowest priority */
-	NVIC_PriorityGroupConfig(NVIC_PriorityGroup_2);
-	NVIC_InitStructure.NVIC_IRQChannel = FIND_EXTI_HANDLER(Pin);
-	NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 0x03;
-	NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0x03;
-	NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
-	NVIC_Init(&NVIC_InitStructure);
+	/* Enable EXTI Line Interrupt (prioridad de INIT_IRQ_PRIO) */
+	P_IRQ_Enable(FIND_EXTI_HANDLER(Pin), 3);
 }
 
 /*****************************************************************************
@@ -805,8 +3332,10 @@ INIT_DAC_CONT
 	* @ej
 		- INIT_DAC_CONT(GPIOX, GPIO_Pin_X); //Inicialización del Pin PXXX como DAC.
 ******************************************************************************/
-INIT_DAC_CONT(GPIO_TypeDef* Port, uint16_t Pin)
+void INIT_DAC_CONT(GPIO_TypeDef* Port, uint16_t Pin)
 {
+	GPIO_InitTypeDef GPIO_InitStructure;
+
 	/* Enable GPIO clock */
 	uint32_t Clock;
 	Clock = FIND_CLOCK(Port);
@@ -849,12 +3378,12 @@ void DAC_CONT(GPIO_TypeDef* Port, uint16_t Pin, int32_t MiliVolts)
 {
 	uint16_t Data;
 
-	Data = (MiliVolts * MaDigCount) / MaxMiliVoltRef;
+	Data = (MiliVolts * MaxDigCount) / MaxMiliVoltRef;
 
 	if(FIND_DAC_CHANNEL(Port,Pin) == DAC_Channel_1)
-		DAC_SetChannel1Data(DAC_Align_12b_R, MiliVolts);
+		DAC_SetChannel1Data(DAC_Align_12b_R, Data);
 	else
-		DAC_SetChannel2Data(DAC_Align_12b_R, MiliVolts);
+		DAC_SetChannel2Data(DAC_Align_12b_R, Data);
 }
 /*------------------------------------------------------------------------------
  FUNCIONES INTERNAS:
@@ -934,134 +3463,685 @@ uint8_t FIND_CHANNEL(GPIO_TypeDef* Port, uint32_t Pin)
 	return Channel;
 }
 
+uint8_t P_ADC_Index(ADC_TypeDef* ADCX)
+{
+	uint8_t Index;
+
+	for (Index = 0; Index < ADC_DMA_ANZ; Index++)
+		if (ADC_DmaADC[Index] == ADCX)
+			break;
+
+	return Index;
+}
+
+//Streams del DMA2 y grupo regular de un ADC con las entradas de la tabla que le tocan,
+//en el orden de la tabla. Halves = 1 avisa cada mitad del buffer, 0 cada barrido completo:
+void P_ADC_Start(ADC_TypeDef* ADCX, ADC_SCAN_t* Table, uint8_t Anz, uint16_t* Buffer, uint16_t Length,
+		uint8_t Halves, uint32_t Rate, void (*Callback)(uint16_t*, uint16_t))
+{
+	GPIO_InitTypeDef GPIO_InitStructure;
+	ADC_InitTypeDef ADC_InitStructure;
+	ADC_CommonInitTypeDef ADC_CommonInitStructure;
+	DMA_InitTypeDef DMA_InitStructure;
+	uint8_t Index = P_ADC_Index(ADCX);
+	uint8_t i, Ranks = 0;
+
+	ADC_DmaBuffer[Index] = Buffer;
+	ADC_DmaLength[Index] = Length;
+	ADC_DmaHalves[Index] = Halves;
+	ADC_DmaCallback[Index] = Callback;
+	ADC_DmaTable[Index] = Table;
+	ADC_DmaAnz[Index] = Anz;
+
+	//El TIM5 es uno solo: las adquisiciones con disparo quedan con la ultima Rate:
+	ADC_DmaRate[Index] = Rate;
+	for (i = 0; i < ADC_DMA_ANZ && Rate != 0; i++)
+		if (ADC_DmaRate[i] != 0)
+			ADC_DmaRate[i] = Rate;
+
+	//Entradas analogicas:
+	GPIO_StructInit(&GPIO_InitStructure);
+	GPIO_InitStructure.GPIO_Mode = GPIO_Mode_AN;
+	GPIO_InitStructure.GPIO_PuPd = GPIO_PuPd_NOPULL;
+	for (i = 0; i < Anz; i++) {
+		if (Table[i].ADCX != ADCX)
+			continue;
+		RCC_AHB1PeriphClockCmd(FIND_CLOCK(Table[i].ADC_PORT), ENABLE);
+		GPIO_InitStructure.GPIO_Pin = Table[i].ADC_PIN;
+		GPIO_Init(Table[i].ADC_PORT, &GPIO_InitStructure);
+		Ranks++;
+	}
+
+	RCC_APB2PeriphClockCmd(FIND_RCC_APB(ADCX), ENABLE);
+	RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_DMA2, ENABLE);
+
+	//DMA: registro de datos del ADC -> buffer, circular:
+	DMA_Cmd(ADC_DmaStream[Index], DISABLE);
+	while (DMA_GetCmdStatus(ADC_DmaStream[Index]) != DISABLE);
+	DMA_DeInit(ADC_DmaStream[Index]);
+	DMA_StructInit(&DMA_InitStructure);
+	DMA_InitStructure.DMA_Channel = ADC_DmaChannel[Index];
+	DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t) &ADCX->DR;
+	DMA_InitStructure.DMA_Memory0BaseAddr = (uint32_t) Buffer;
+	DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralToMemory;
+	DMA_InitStructure.DMA_BufferSize = Length;
+	DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+	DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+	DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;
+	DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_HalfWord;
+	DMA_InitStructure.DMA_Mode = DMA_Mode_Circular;
+	DMA_InitStructure.DMA_Priority = DMA_Priority_High;
+	DMA_InitStructure.DMA_FIFOMode = DMA_FIFOMode_Disable;
+	DMA_Init(ADC_DmaStream[Index], &DMA_InitStructure);
+
+	//Mitad y buffer completo (o solo barrido completo), si hay a quien avisar:
+	if (Callback != NULL) {
+		DMA_ITConfig(ADC_DmaStream[Index], Halves ? (DMA_IT_HT | DMA_IT_TC) : DMA_IT_TC, ENABLE);
+		P_IRQ_Enable(ADC_DmaIRQ[Index], 5);
+	}
+	DMA_Cmd(ADC_DmaStream[Index], ENABLE);
+
+	//ADC Common Init:
+	ADC_CommonStructInit(&ADC_CommonInitStructure);
+	ADC_CommonInitStructure.ADC_Mode = ADC_Mode_Independent;
+	ADC_CommonInitStructure.ADC_Prescaler = ADC_Prescaler_Div4; // max 36 MHz segun datasheet
+	ADC_CommonInitStructure.ADC_DMAAccessMode = ADC_DMAAccessMode_Disabled;
+	ADC_CommonInitStructure.ADC_TwoSamplingDelay = ADC_TwoSamplingDelay_5Cycles;
+	ADC_CommonInit(&ADC_CommonInitStructure);
+
+	//Grupo regular (barrido si hay mas de un canal), continuo o disparado por el TIM5:
+	ADC_StructInit(&ADC_InitStructure);
+	ADC_InitStructure.ADC_Resolution = ADC_Resolution_12b;
+	ADC_InitStructure.ADC_ScanConvMode = (Ranks > 1) ? ENABLE : DISABLE;
+	if (Rate == 0) {
+		ADC_InitStructure.ADC_ContinuousConvMode = ENABLE;
+		ADC_InitStructure.ADC_ExternalTrigConvEdge = ADC_ExternalTrigConvEdge_None;
+	}
+	else {
+		ADC_InitStructure.ADC_ContinuousConvMode = DISABLE;
+		ADC_InitStructure.ADC_ExternalTrigConv = ADC_ExternalTrigConv_T5_CC1;
+		ADC_InitStructure.ADC_ExternalTrigConvEdge = ADC_ExternalTrigConvEdge_Rising;
+	}
+	ADC_InitStructure.ADC_DataAlign = ADC_DataAlign_Right;
+	ADC_InitStructure.ADC_NbrOfConversion = Ranks;
+	ADC_Init(ADCX, &ADC_InitStructure);
+
+	//Secuencia en el orden de la tabla, con el tiempo de muestreo de cada canal:
+	Ranks = 0;
+	for (i = 0; i < Anz; i++)
+		if (Table[i].ADCX == ADCX)
+			ADC_RegularChannelConfig(ADCX, Table[i].Channel, ++Ranks, Table[i].ADC_SAMPLE_TIME);
+
+	//Pedido de DMA en cada conversion, tambien despues de la ultima del buffer:
+	ADC_DMARequestAfterLastTransferCmd(ADCX, ENABLE);
+	ADC_DMACmd(ADCX, ENABLE);
+
+	ADC_Cmd(ADCX, ENABLE);
+	if (Rate == 0)
+		ADC_SoftwareStartConv(ADCX);
+	else
+		P_ADC_Trigger(Rate);
+}
+
+//Aviso de la mitad del buffer recien llenada (el DMA sigue con la otra) o del barrido completo:
+void P_ADC_DmaIRQ(uint8_t Index, uint32_t HalfFlag, uint32_t FullFlag)
+{
+	uint16_t Half = ADC_DmaLength[Index] / 2;
+
+	//Captura intercalada en el stream del ADC1: solo avisa el buffer lleno:
+	if (Index == 0 && ADC_Capture) {
+		if (DMA_GetITStatus(ADC_DmaStream[0], FullFlag) != RESET) {
+			DMA_ClearITPendingBit(ADC_DmaStream[0], FullFlag);
+			P_ADC_CaptureStop();
+			if (ADC_CaptureDone != NULL)
+				ADC_CaptureDone(ADC_CaptureBuffer, ADC_CaptureLength);
+		}
+		return;
+	}
+
+	if (DMA_GetITStatus(ADC_DmaStream[Index], HalfFlag) != RESET) {
+		DMA_ClearITPendingBit(ADC_DmaStream[Index], HalfFlag);
+		if (ADC_DmaCallback[Index] != NULL)
+			ADC_DmaCallback[Index](ADC_DmaBuffer[Index], Half);
+	}
+	if (DMA_GetITStatus(ADC_DmaStream[Index], FullFlag) != RESET) {
+		DMA_ClearITPendingBit(ADC_DmaStream[Index], FullFlag);
+		//Barrido: se avisa con el buffer entero:
+		if (ADC_DmaCallback[Index] == NULL)
+			return;
+		if (ADC_DmaHalves[Index])
+			ADC_DmaCallback[Index](ADC_DmaBuffer[Index] + Half, Half);
+		else
+			ADC_DmaCallback[Index](ADC_DmaBuffer[Index], ADC_DmaLength[Index]);
+	}
+}
+
+//Fin de la captura intercalada: ADCs detenidos y vuelta a las adquisiciones que habia
+//en ADC1 (y ADC3 si participo), con la configuracion guardada por P_ADC_Start:
+void P_ADC_CaptureStop(void)
+{
+	uint8_t Index;
+
+	ADC_MultiModeDMARequestAfterLastTransferCmd(DISABLE);
+	ADC_Cmd(ADC1, DISABLE);
+	ADC_Cmd(ADC2, DISABLE);
+	if (ADC_CaptureADCs == 3)
+		ADC_Cmd(ADC3, DISABLE);
+	ADC_Capture = 0;
+
+	for (Index = 0; Index < ADC_DMA_ANZ; Index++)
+		if (ADC_DmaBuffer[Index] != NULL && (Index == 0 || ADC_CaptureADCs == 3))
+			P_ADC_Start(ADC_DmaADC[Index], ADC_DmaTable[Index], ADC_DmaAnz[Index], ADC_DmaBuffer[Index],
+					ADC_DmaLength[Index], ADC_DmaHalves[Index], ADC_DmaRate[Index], ADC_DmaCallback[Index]);
+}
+
+//Disparo del ADC: TIM5 (32 bits) en PWM, un flanco de OC1REF por periodo. El periodo
+//minimo es de 2 cuentas: una Rate mayor se limita a la mitad del reloj del TIM5:
+void P_ADC_Trigger(uint32_t Rate)
+{
+	TIM_TimeBaseInitTypeDef TIM_BaseStructure;
+	TIM_OCInitTypeDef TIM_OCInitStructure;
+	uint32_t Clock;
+
+	/* TIM5 clock enable */
+	RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM5, ENABLE);
+
+	SystemCoreClockUpdate();
+	Clock = SystemCoreClock / 2;
+	if (Rate > Clock / 2)
+		Rate = Clock / 2;
+
+	TIM_Cmd(TIM5, DISABLE);
+	TIM_BaseStructure.TIM_Period = Clock / Rate - 1;
+	TIM_BaseStructure.TIM_Prescaler = 0;
+	TIM_BaseStructure.TIM_ClockDivision = 0;
+	TIM_BaseStructure.TIM_CounterMode = TIM_CounterMode_Up;
+	TIM_BaseStructure.TIM_RepetitionCounter = 0;
+	TIM_TimeBaseInit(TIM5, &TIM_BaseStructure);
+
+	TIM_OCStructInit(&TIM_OCInitStructure);
+	TIM_OCInitStructure.TIM_OCMode = TIM_OCMode_PWM1;
+	TIM_OCInitStructure.TIM_OutputState = TIM_OutputState_Enable;
+	TIM_OCInitStructure.TIM_Pulse = (TIM_BaseStructure.TIM_Period + 1) / 2;
+	TIM_OCInitStructure.TIM_OCPolarity = TIM_OCPolarity_High;
+	TIM_OC1Init(TIM5, &TIM_OCInitStructure);
+
+	TIM_SetCounter(TIM5, 0);
+	TIM_Cmd(TIM5, ENABLE);
+}
+
 //LCD:
-void P_LCD_2x16_InitIO(LCD_2X16_t* LCD_2X16)
+//Display interno de la tabla de INIT_LCD_2x16, NULL si es otra tabla:
+LCD_t* P_LCD_2x16_Legacy(LCD_2X16_t* LCD_2X16)
+{
+	if (LCD_2X16 == NULL || LCD_Legacy.TLCD_PINS != LCD_2X16)
+		return NULL;
+	return &LCD_Legacy;
+}
+
+void P_LCD_2x16_InitIO(LCD_t* LCD)
 {
 	GPIO_InitTypeDef GPIO_InitStructure;
+	LCD_2X16_t* Entry;
 	TLCD_NAME_t lcd_pin;
+	uint8_t Index;
 
+	//Pines por nombre, los que no figuran en la tabla quedan sin conectar:
 	for (lcd_pin = 0; lcd_pin < TLCD_ANZ; lcd_pin++)
+		LCD->Port[lcd_pin] = NULL;
+
+	for (Index = 0; Index < LCD->TLCD_PIN_ANZ; Index++)
 	{
+		Entry = &LCD->TLCD_PINS[Index];
+		LCD->Port[Entry->TLCD_NAME] = Entry->TLCD_PORT;
+		LCD->Pin[Entry->TLCD_NAME] = Entry->TLCD_PIN;
+
 		//Habilitacion del Clock para cada PIN:
-		RCC_AHB1PeriphClockCmd(LCD_2X16[lcd_pin].TLCD_CLK, ENABLE);
+		RCC_AHB1PeriphClockCmd(Entry->TLCD_CLK, ENABLE);
 
 		//Configuracion como salidas digitales:
-		GPIO_InitStructure.GPIO_Pin = LCD_2X16[lcd_pin].TLCD_PIN;
+		GPIO_InitStructure.GPIO_Pin = Entry->TLCD_PIN;
 		GPIO_InitStructure.GPIO_Mode = GPIO_Mode_OUT;
 		GPIO_InitStructure.GPIO_OType = GPIO_OType_PP;
 		GPIO_InitStructure.GPIO_PuPd = GPIO_PuPd_UP;
 		GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
-		GPIO_Init(LCD_2X16[lcd_pin].TLCD_PORT, &GPIO_InitStructure);
+		GPIO_Init(Entry->TLCD_PORT, &GPIO_InitStructure);
 
 		//Default Wert einstellen
-		if(LCD_2X16[lcd_pin].TLCD_INIT == Bit_RESET)
-			P_LCD_2x16_PinLo(lcd_pin, LCD_2X16);
+		if(Entry->TLCD_INIT == Bit_RESET)
+			P_LCD_2x16_PinLo(Entry->TLCD_NAME, LCD);
 		else
-			P_LCD_2x16_PinHi(lcd_pin, LCD_2X16);
+			P_LCD_2x16_PinHi(Entry->TLCD_NAME, LCD);
+	}
+
+	//El bus de 8 bits necesita D0..D3, si falta alguno se usa el de 4 bits:
+	if (LCD->TLCD_BUS != TLCD_BUS_8BIT ||
+		LCD->Port[TLCD_D0] == NULL || LCD->Port[TLCD_D1] == NULL ||
+		LCD->Port[TLCD_D2] == NULL || LCD->Port[TLCD_D3] == NULL)
+		LCD->TLCD_BUS = TLCD_BUS_4BIT;
+
+	//Con TLCD_E2 hay dos controladores (40x4):
+	LCD->EnableAll = (LCD->Port[TLCD_E2] != NULL) ? 0x03 : 0x01;
+	LCD->Enable = LCD->EnableAll;
+
+	//Lectura del busy flag solo con RW (se apaga sola si el display no responde):
+	LCD->BusyFlagOn = (LCD->Port[TLCD_RW] != NULL);
+
+	//Tablas de mascaras para escribir los nibbles:
+	P_LCD_2x16_InitMasks(LCD);
+}
+
+void P_LCD_2x16_InitMasks(LCD_t* LCD)
+{
+	TLCD_NAME_t lcd_pin;
+	uint32_t Pin;
+	uint8_t Group, Bit, Index, wert;
+
+	//Grupo 0 = D4..D7 y, solo con bus de 8 bits, grupo 1 = D0..D3:
+	for (Group = 0; Group < 2; Group++)
+	{
+		LCD->NibblePorts[Group] = 0;
+		if (Group * 4 >= LCD->TLCD_BUS)
+			continue;
+
+		for (Bit = 0; Bit < 4; Bit++)
+		{
+			lcd_pin = LCD_DataPins[Group * 4 + Bit];
+
+			//Se agrupan los pines de datos por puerto:
+			for (Index = 0; Index < LCD->NibblePorts[Group]; Index++)
+				if (LCD->NibblePort[Group][Index] == LCD->Port[lcd_pin])
+					break;
+
+			if (Index == LCD->NibblePorts[Group]) {
+				LCD->NibblePort[Group][LCD->NibblePorts[Group]++] = LCD->Port[lcd_pin];
+				for (wert = 0; wert < 16; wert++)
+					LCD->NibbleMask[Group][Index][wert] = 0;
+			}
+
+			//Bit del nibble que corresponde al pin (D4 o D0 = bit 0 ... D7 o D3 = bit 3):
+			Pin = LCD->Pin[lcd_pin];
+			for (wert = 0; wert < 16; wert++)
+				LCD->NibbleMask[Group][Index][wert] |= (wert & (1 << Bit)) ? Pin : (Pin << 16);
+		}
 	}
 }
 
-void P_LCD_2x16_PinLo(TLCD_NAME_t lcd_pin, LCD_2X16_t* LCD_2X16)
+void P_LCD_2x16_PinLo(TLCD_NAME_t lcd_pin, LCD_t* LCD)
+{
+  LCD->Port[lcd_pin]->BSRRH = LCD->Pin[lcd_pin];
+  TLCD_BUS_OP(1);
+}
+
+void P_LCD_2x16_PinHi(TLCD_NAME_t lcd_pin, LCD_t* LCD)
+{
+  LCD->Port[lcd_pin]->BSRRL = LCD->Pin[lcd_pin];
+  TLCD_BUS_OP(1);
+}
+
+void P_LCD_2x16_Delay(uint32_t us)
 {
-  LCD_2X16[lcd_pin].TLCD_PORT->BSRRH = LCD_2X16[lcd_pin].TLCD_PIN;
+  DELAY_US(us);
 }
 
-void P_LCD_2x16_PinHi(TLCD_NAME_t lcd_pin, LCD_2X16_t* LCD_2X16)
+void P_LCD_2x16_Wait(LCD_t* LCD, uint32_t Pause)
 {
-  LCD_2X16[lcd_pin].TLCD_PORT->BSRRL = LCD_2X16[lcd_pin].TLCD_PIN;
+  uint32_t Timeout = TLCD_BUSY_TIMEOUT;
+
+  //Sin RW, con los dos controladores a la vez (no se pueden leer juntos) o si
+  //el display nunca libero el busy flag se usa la pausa fija:
+  if (!LCD->BusyFlagOn || LCD->Enable == 0x03) {
+    P_LCD_2x16_Delay(Pause);
+    return;
+  }
+
+  while (P_LCD_2x16_ReadBusy(LCD)) {
+    if (--Timeout == 0) {
+      LCD->BusyFlagOn = 0;
+      P_LCD_2x16_Delay(Pause);
+      return;
+    }
+  }
 }
 
-void P_LCD_2x16_Delay(volatile uint32_t nCount)
+uint8_t P_LCD_2x16_ReadBusy(LCD_t* LCD)
 {
-  while(nCount--)
+  uint8_t Busy;
+
+  //Lectura de la direccion/busy flag: RS=0, RW=1, un pulso de E (dos en 4 bits).
+  //Con el LCD a 5V los pines de datos deben ser tolerantes a 5V (FT).
+  P_LCD_2x16_DataMode(GPIO_Mode_IN, LCD);
+  P_LCD_2x16_PinLo(TLCD_RS, LCD);
+  P_LCD_2x16_PinHi(TLCD_RW, LCD);
+  // Hi-Nibble: DB7 = busy flag
+  P_LCD_2x16_EnableHi(LCD->Enable, LCD);
+  DELAY_NS(TLCD_CLK_PAUSE);
+  Busy = GPIO_ReadInputDataBit(LCD->Port[TLCD_D7], LCD->Pin[TLCD_D7]);
+  P_LCD_2x16_EnableLo(LCD->Enable, LCD);
+  DELAY_NS(TLCD_CLK_PAUSE);
+  // Lo-Nibble: se descarta
+  if (LCD->TLCD_BUS == TLCD_BUS_4BIT)
+    P_LCD_2x16_Clk(LCD);
+  P_LCD_2x16_PinLo(TLCD_RW, LCD);
+  P_LCD_2x16_DataMode(GPIO_Mode_OUT, LCD);
+
+  return Busy;
+}
+
+void P_LCD_2x16_DataMode(GPIOMode_TypeDef Mode, LCD_t* LCD)
+{
+  TLCD_NAME_t lcd_pin;
+  uint8_t Index, Pos;
+
+  //Solo se toca MODER, el resto de la configuracion del pin se conserva:
+  for (Index = 0; Index < LCD->TLCD_BUS; Index++)
   {
+    lcd_pin = LCD_DataPins[Index];
+    Pos = FIND_PINSOURCE(LCD->Pin[lcd_pin]) * 2;
+    LCD->Port[lcd_pin]->MODER = (LCD->Port[lcd_pin]->MODER & ~(GPIO_MODER_MODER0 << Pos)) | ((uint32_t) Mode << Pos);
   }
+  TLCD_BUS_OP(LCD->TLCD_BUS);
 }
 
-void P_LCD_2x16_InitSequenz(LCD_2X16_t* LCD_2X16)
+void P_LCD_2x16_InitSequenz(LCD_t* LCD)
 {
-  //Inicializacion de la secuencia:
-  P_LCD_2x16_PinHi(TLCD_D4, LCD_2X16);
-  P_LCD_2x16_PinHi(TLCD_D5, LCD_2X16);
-  P_LCD_2x16_PinLo(TLCD_D6, LCD_2X16);
-  P_LCD_2x16_PinLo(TLCD_D7, LCD_2X16);
+  //Inicializacion de la secuencia (0x3 en D4..D7, D0..D3 en 0):
+  if (LCD->TLCD_BUS == TLCD_BUS_8BIT)
+    P_LCD_2x16_Byte(0x30, LCD);
+  else
+    P_LCD_2x16_Nibble(0x03, LCD);
   // Erster Init Impuls
-  P_LCD_2x16_Clk(LCD_2X16);
-  P_LCD_2x16_Delay(TLCD_PAUSE);
+  P_LCD_2x16_Clk(LCD);
+  P_LCD_2x16_Delay(TLCD_INIT_PULSE);
   // Zweiter Init Impuls
-  P_LCD_2x16_Clk(LCD_2X16);
-  P_LCD_2x16_Delay(TLCD_PAUSE);
+  P_LCD_2x16_Clk(LCD);
+  P_LCD_2x16_Delay(TLCD_INIT_PULSE2);
   // Dritter Init Impuls
-  P_LCD_2x16_Clk(LCD_2X16);
-  P_LCD_2x16_Delay(TLCD_PAUSE);
-  // LCD-Modus einstellen (4Bit-Mode)
-  P_LCD_2x16_PinLo(TLCD_D4, LCD_2X16);
-  P_LCD_2x16_PinHi(TLCD_D5, LCD_2X16);
-  P_LCD_2x16_PinLo(TLCD_D6, LCD_2X16);
-  P_LCD_2x16_PinLo(TLCD_D7, LCD_2X16);
-  P_LCD_2x16_Clk(LCD_2X16);
-  P_LCD_2x16_Delay(TLCD_PAUSE);
+  P_LCD_2x16_Clk(LCD);
+  P_LCD_2x16_Delay(TLCD_INIT_PULSE2);
+  // LCD-Modus einstellen (4Bit-Mode), en 8 bits el controlador ya quedo asi
+  if (LCD->TLCD_BUS == TLCD_BUS_4BIT) {
+    P_LCD_2x16_Nibble(0x02, LCD);
+    P_LCD_2x16_Clk(LCD);
+    P_LCD_2x16_Delay(TLCD_INIT_PULSE2);
+  }
+}
+
+void P_LCD_2x16_EnableHi(uint8_t Enable, LCD_t* LCD)
+{
+  if (Enable & 0x01) P_LCD_2x16_PinHi(TLCD_E, LCD);
+  if (Enable & 0x02) P_LCD_2x16_PinHi(TLCD_E2, LCD);
 }
 
-void P_LCD_2x16_Clk(LCD_2X16_t* LCD_2X16)
+void P_LCD_2x16_EnableLo(uint8_t Enable, LCD_t* LCD)
+{
+  if (Enable & 0x01) P_LCD_2x16_PinLo(TLCD_E, LCD);
+  if (Enable & 0x02) P_LCD_2x16_PinLo(TLCD_E2, LCD);
+}
+
+void P_LCD_2x16_Clk(LCD_t* LCD)
 {
   // Pin-E auf Hi
-  P_LCD_2x16_PinHi(TLCD_E, LCD_2X16);
+  P_LCD_2x16_EnableHi(LCD->Enable, LCD);
   // kleine Pause
-  P_LCD_2x16_Delay(TLCD_CLK_PAUSE);
+  DELAY_NS(TLCD_CLK_PAUSE);
   // Pin-E auf Lo
-  P_LCD_2x16_PinLo(TLCD_E, LCD_2X16);
+  P_LCD_2x16_EnableLo(LCD->Enable, LCD);
   // kleine Pause
-  P_LCD_2x16_Delay(TLCD_CLK_PAUSE);
+  DELAY_NS(TLCD_CLK_PAUSE);
 }
 
-void P_LCD_2x16_Cmd(uint8_t wert, LCD_2X16_t* LCD_2X16)
+void P_LCD_2x16_Cmd(uint8_t wert, LCD_t* LCD)
 {
   // RS=Lo (Command)
-  P_LCD_2x16_PinLo(TLCD_RS, LCD_2X16);
-  // Hi-Nibble ausgeben
-  if((wert&0x80)!=0) P_LCD_2x16_PinHi(TLCD_D7, LCD_2X16); else P_LCD_2x16_PinLo(TLCD_D7, LCD_2X16);
-  if((wert&0x40)!=0) P_LCD_2x16_PinHi(TLCD_D6, LCD_2X16); else P_LCD_2x16_PinLo(TLCD_D6, LCD_2X16);
-  if((wert&0x20)!=0) P_LCD_2x16_PinHi(TLCD_D5, LCD_2X16); else P_LCD_2x16_PinLo(TLCD_D5, LCD_2X16);
-  if((wert&0x10)!=0) P_LCD_2x16_PinHi(TLCD_D4, LCD_2X16); else P_LCD_2x16_PinLo(TLCD_D4, LCD_2X16);
-  P_LCD_2x16_Clk(LCD_2X16);
-  // Lo-Nibble ausgeben
-  if((wert&0x08)!=0) P_LCD_2x16_PinHi(TLCD_D7, LCD_2X16); else P_LCD_2x16_PinLo(TLCD_D7, LCD_2X16);
-  if((wert&0x04)!=0) P_LCD_2x16_PinHi(TLCD_D6, LCD_2X16); else P_LCD_2x16_PinLo(TLCD_D6, LCD_2X16);
-  if((wert&0x02)!=0) P_LCD_2x16_PinHi(TLCD_D5, LCD_2X16); else P_LCD_2x16_PinLo(TLCD_D5, LCD_2X16);
-  if((wert&0x01)!=0) P_LCD_2x16_PinHi(TLCD_D4, LCD_2X16); else P_LCD_2x16_PinLo(TLCD_D4, LCD_2X16);
-  P_LCD_2x16_Clk(LCD_2X16);
+  P_LCD_2x16_Write(wert, 0, LCD);
 }
 
-void P_LCD_2x16_Cursor(LCD_2X16_t* LCD_2X16, uint8_t x, uint8_t y)
+uint8_t P_LCD_2x16_Address(LCD_t* LCD, uint8_t x, uint8_t y)
 {
-  uint8_t wert;
+  //40x4: filas 0-1 en el controlador de E y filas 2-3 en el de E2:
+  if (LCD->EnableAll == 0x03) {
+    LCD->Enable = (y < 2) ? 0x01 : 0x02;
+    return ((y & 1) << 6) | x;
+  }
 
-  if(x>=TLCD_MAXX) x=0;
-  if(y>=TLCD_MAXY) y=0;
+  //Un controlador: las filas 2 y 3 siguen a las 0 y 1 (20x4: 0x00, 0x40, 0x14, 0x54):
+  return ((y & 1) << 6) + ((y & 2) ? LCD->TLCD_COLS : 0) + x;
+}
+
+void P_LCD_2x16_Cursor(LCD_t* LCD, uint8_t x, uint8_t y)
+{
+  if(x>=LCD->TLCD_COLS) x=0;
+  if(y>=LCD->TLCD_ROWS) y=0;
 
-  wert=(y<<6);
-  wert|=x;
-  wert|=0x80;
-  P_LCD_2x16_Cmd(wert,LCD_2X16);
+  P_LCD_2x16_Cmd(0x80 | P_LCD_2x16_Address(LCD, x, y), LCD);
 }
 
-void P_LCD_2x16_Data(uint8_t wert, LCD_2X16_t* LCD_2X16)
+void P_LCD_2x16_Data(uint8_t wert, LCD_t* LCD)
 {
   // RS=Hi (Data)
-  P_LCD_2x16_PinHi(TLCD_RS, LCD_2X16);
-  // Hi-Nibble ausgeben
-  if((wert&0x80)!=0) P_LCD_2x16_PinHi(TLCD_D7, LCD_2X16); else P_LCD_2x16_PinLo(TLCD_D7, LCD_2X16);
-  if((wert&0x40)!=0) P_LCD_2x16_PinHi(TLCD_D6, LCD_2X16); else P_LCD_2x16_PinLo(TLCD_D6, LCD_2X16);
-  if((wert&0x20)!=0) P_LCD_2x16_PinHi(TLCD_D5, LCD_2X16); else P_LCD_2x16_PinLo(TLCD_D5, LCD_2X16);
-  if((wert&0x10)!=0) P_LCD_2x16_PinHi(TLCD_D4, LCD_2X16); else P_LCD_2x16_PinLo(TLCD_D4, LCD_2X16);
-  P_LCD_2x16_Clk(LCD_2X16);
-  // Lo-Nibble ausgeben
-  if((wert&0x08)!=0) P_LCD_2x16_PinHi(TLCD_D7, LCD_2X16); else P_LCD_2x16_PinLo(TLCD_D7, LCD_2X16);
-  if((wert&0x04)!=0) P_LCD_2x16_PinHi(TLCD_D6, LCD_2X16); else P_LCD_2x16_PinLo(TLCD_D6, LCD_2X16);
-  if((wert&0x02)!=0) P_LCD_2x16_PinHi(TLCD_D5, LCD_2X16); else P_LCD_2x16_PinLo(TLCD_D5, LCD_2X16);
-  if((wert&0x01)!=0) P_LCD_2x16_PinHi(TLCD_D4, LCD_2X16); else P_LCD_2x16_PinLo(TLCD_D4, LCD_2X16);
-  P_LCD_2x16_Clk(LCD_2X16);
+  P_LCD_2x16_Write(wert, 1, LCD);
+}
+
+void P_LCD_2x16_Nibble(uint8_t wert, LCD_t* LCD)
+{
+  uint8_t Index;
+
+  //Una sola escritura de BSRR (set + reset) por puerto involucrado:
+  for (Index = 0; Index < LCD->NibblePorts[0]; Index++)
+    *(__IO uint32_t*) &LCD->NibblePort[0][Index]->BSRRL = LCD->NibbleMask[0][Index][wert & 0x0F];
+  TLCD_BUS_OP(LCD->NibblePorts[0]);
+}
+
+void P_LCD_2x16_Byte(uint8_t wert, LCD_t* LCD)
+{
+  uint8_t Index;
+
+  //Bus de 8 bits: nibble alto en D4..D7 y nibble bajo en D0..D3:
+  P_LCD_2x16_Nibble(wert >> 4, LCD);
+  for (Index = 0; Index < LCD->NibblePorts[1]; Index++)
+    *(__IO uint32_t*) &LCD->NibblePort[1][Index]->BSRRL = LCD->NibbleMask[1][Index][wert & 0x0F];
+  TLCD_BUS_OP(LCD->NibblePorts[1]);
+}
+
+void P_LCD_2x16_Write(uint8_t wert, uint8_t rs, LCD_t* LCD)
+{
+  //Con la cola activa solo se encola (con los E destino), el TIM7 hace el resto:
+  if (LCD_QueueOn && LCD == LCD_QueueLCD) {
+    P_LCD_2x16_Put((rs ? (wert | TLCD_QUEUE_RS) : wert) | (LCD->Enable << TLCD_QUEUE_EN_SHIFT));
+    return;
+  }
+
+  if (rs) P_LCD_2x16_PinHi(TLCD_RS, LCD); else P_LCD_2x16_PinLo(TLCD_RS, LCD);
+  if (LCD->TLCD_BUS == TLCD_BUS_8BIT) {
+    // Byte completo, un solo pulso de E
+    P_LCD_2x16_Byte(wert, LCD);
+    P_LCD_2x16_Clk(LCD);
+  } else {
+    // Hi-Nibble ausgeben
+    P_LCD_2x16_Nibble(wert >> 4, LCD);
+    P_LCD_2x16_Clk(LCD);
+    // Lo-Nibble ausgeben
+    P_LCD_2x16_Nibble(wert, LCD);
+    P_LCD_2x16_Clk(LCD);
+  }
+  //Tiempo de ejecucion del byte (o hasta que el busy flag se libere):
+  P_LCD_2x16_Wait(LCD, TLCD_EXEC_US);
+}
+
+void P_LCD_2x16_Put(uint16_t Entry)
+{
+  uint8_t Next = (LCD_QueueHead + 1) & (TLCD_QUEUE_LEN - 1);
+  uint32_t Primask;
+
+  //Cola llena: se despacha a mano hasta liberar un lugar:
+  while (Next == LCD_QueueTail)
+    P_LCD_2x16_QueuePoll();
+
+  LCD_Queue[LCD_QueueHead] = Entry;
+
+  Primask = __get_PRIMASK();
+  __disable_irq();
+  LCD_QueueHead = Next;
+  //Si el TIM7 estaba detenido se lo arranca:
+  if (!LCD_QueueBusy) {
+    LCD_QueueBusy = 1;
+    TIM_SetCounter(TIM7, 0);
+    TIM_SetAutoreload(TIM7, TLCD_PHASE_US - 1);
+    TIM_Cmd(TIM7, ENABLE);
+  }
+  __set_PRIMASK(Primask);
+}
+
+uint8_t P_LCD_2x16_QueueStep(void)
+{
+  LCD_t* LCD = LCD_QueueLCD;
+  uint32_t Wait = TLCD_PHASE_US;
+
+  switch (LCD_QueuePhase)
+  {
+  case 0:
+    //Cola vacia: se detiene el TIM7 hasta el proximo P_LCD_2x16_Put:
+    if (LCD_QueueTail == LCD_QueueHead) {
+      TIM_Cmd(TIM7, DISABLE);
+      LCD_QueueBusy = 0;
+      return 1;
+    }
+    LCD_QueueEntry = LCD_Queue[LCD_QueueTail];
+    LCD_QueueTail = (LCD_QueueTail + 1) & (TLCD_QUEUE_LEN - 1);
+    if (LCD_QueueEntry & TLCD_QUEUE_RS) P_LCD_2x16_PinHi(TLCD_RS, LCD); else P_LCD_2x16_PinLo(TLCD_RS, LCD);
+    if (LCD->TLCD_BUS == TLCD_BUS_8BIT)
+      P_LCD_2x16_Byte(LCD_QueueEntry, LCD);
+    else
+      P_LCD_2x16_Nibble(LCD_QueueEntry >> 4, LCD);
+    break;
+  case 1:
+  case 4:
+    P_LCD_2x16_EnableHi(LCD_QueueEntry >> TLCD_QUEUE_EN_SHIFT, LCD);
+    break;
+  case 3:
+    P_LCD_2x16_Nibble(LCD_QueueEntry, LCD);
+    break;
+  case 2:
+  case 5:
+    P_LCD_2x16_EnableLo(LCD_QueueEntry >> TLCD_QUEUE_EN_SHIFT, LCD);
+    //En 4 bits, tras el primer pulso sigue el Lo-Nibble:
+    if (LCD_QueuePhase == 2 && LCD->TLCD_BUS == TLCD_BUS_4BIT)
+      break;
+    //CLEAR y HOME (comandos 0x01...0x03) demoran mucho mas que el resto:
+    if (!(LCD_QueueEntry & TLCD_QUEUE_RS) && (LCD_QueueEntry & 0xFC) == 0)
+      Wait = TLCD_PAUSE;
+    else
+      Wait = TLCD_EXEC_US;
+    //Byte terminado, la fase siguiente es la 0:
+    LCD_QueuePhase = 5;
+    break;
+  }
+
+  LCD_QueuePhase = (LCD_QueuePhase + 1) % 6;
+  TIM_SetAutoreload(TIM7, Wait - 1);
+  return 0;
+}
+
+void P_LCD_2x16_QueuePoll(void)
+{
+  uint32_t Primask;
+  uint8_t Idle = 0;
+
+  //El flag se consulta y limpia con las interrupciones deshabilitadas, asi la
+  //fase se ejecuta una sola vez aunque se llame desde TIM7 y desde un Put:
+  Primask = __get_PRIMASK();
+  __disable_irq();
+  if (TIM_GetFlagStatus(TIM7, TIM_FLAG_Update) != RESET) {
+    TIM_ClearFlag(TIM7, TIM_FLAG_Update);
+    Idle = P_LCD_2x16_QueueStep();
+  }
+  __set_PRIMASK(Primask);
+
+  if (Idle && LCD_QueueIdle != NULL)
+    LCD_QueueIdle();
+}
+
+void P_LCD_2x16_WavePin(uint16_t Step, TLCD_NAME_t lcd_pin, uint8_t Level, LCD_t* LCD)
+{
+  uint32_t Pin = LCD->Pin[lcd_pin];
+
+  //Mitad baja del BSRR pone el pin en 1, mitad alta lo pone en 0:
+  LCD_Wave[LCD_WaveIndex[lcd_pin]][Step] |= Level ? Pin : (Pin << 16);
+}
+
+void P_LCD_2x16_WaveEnable(uint16_t Step, uint8_t Level, LCD_t* LCD)
+{
+  if (LCD->Enable & 0x01) P_LCD_2x16_WavePin(Step, TLCD_E, Level, LCD);
+  if (LCD->Enable & 0x02) P_LCD_2x16_WavePin(Step, TLCD_E2, Level, LCD);
+}
+
+uint16_t P_LCD_2x16_WaveByte(uint16_t Step, uint8_t wert, uint8_t rs, LCD_t* LCD)
+{
+  uint8_t Index;
+  uint16_t i;
+  //En 8 bits sobran los 3 pasos del Lo-Nibble:
+  uint16_t Last = Step + TLCD_DMA_STEPS_BYTE - (LCD->TLCD_BUS == TLCD_BUS_8BIT ? 3 : 0);
+
+  //Pasos sin cambios por defecto (escribir 0 en el BSRR no modifica el puerto):
+  for (Index = 0; Index < TLCD_DMA_PORTS; Index++)
+    for (i = Step; i < Last; i++)
+      LCD_Wave[Index][i] = 0;
+
+  // RS y Hi-Nibble (en 8 bits el byte completo), flanco de subida y bajada de E
+  P_LCD_2x16_WavePin(Step, TLCD_RS, rs, LCD);
+  P_LCD_2x16_WavePin(Step, TLCD_D7, wert & 0x80, LCD);
+  P_LCD_2x16_WavePin(Step, TLCD_D6, wert & 0x40, LCD);
+  P_LCD_2x16_WavePin(Step, TLCD_D5, wert & 0x20, LCD);
+  P_LCD_2x16_WavePin(Step, TLCD_D4, wert & 0x10, LCD);
+  if (LCD->TLCD_BUS == TLCD_BUS_8BIT) {
+    P_LCD_2x16_WavePin(Step, TLCD_D3, wert & 0x08, LCD);
+    P_LCD_2x16_WavePin(Step, TLCD_D2, wert & 0x04, LCD);
+    P_LCD_2x16_WavePin(Step, TLCD_D1, wert & 0x02, LCD);
+    P_LCD_2x16_WavePin(Step, TLCD_D0, wert & 0x01, LCD);
+  }
+  P_LCD_2x16_WaveEnable(Step + 1, 1, LCD);
+  P_LCD_2x16_WaveEnable(Step + 2, 0, LCD);
+  // Lo-Nibble, flanco de subida y bajada de E
+  if (LCD->TLCD_BUS == TLCD_BUS_4BIT) {
+    P_LCD_2x16_WavePin(Step + 3, TLCD_D7, wert & 0x08, LCD);
+    P_LCD_2x16_WavePin(Step + 3, TLCD_D6, wert & 0x04, LCD);
+    P_LCD_2x16_WavePin(Step + 3, TLCD_D5, wert & 0x02, LCD);
+    P_LCD_2x16_WavePin(Step + 3, TLCD_D4, wert & 0x01, LCD);
+    P_LCD_2x16_WaveEnable(Step + 4, 1, LCD);
+    P_LCD_2x16_WaveEnable(Step + 5, 0, LCD);
+  }
+  // Los pasos restantes cubren el tiempo de ejecucion del byte
+
+  return Last;
+}
+
+void P_LCD_2x16_FillBuffer(char Buffer[TLCD_MAXY][TLCD_MAXX])
+{
+  uint8_t x, y;
+
+  for (y = 0; y < TLCD_MAXY; y++)
+    for (x = 0; x < TLCD_MAXX; x++)
+      Buffer[y][x] = ' ';
+}
+
+void P_LCD_2x16_GlyphUpload(LCD_t* LCD)
+{
+  uint8_t Slot, Row;
+
+  for (Slot = 0; Slot < TLCD_GLYPHS; Slot++)
+  {
+    //Solo los glyphs que cambiaron desde la ultima carga en este display:
+    if (LCD_GlyphData[Slot] == NULL || LCD->GlyphVersion[Slot] == LCD_GlyphVersion[Slot])
+      continue;
+    //Direccion del glyph en la CGRAM (de todos los controladores), las 8 filas
+    //siguen con autoincremento:
+    LCD->Enable = LCD->EnableAll;
+    P_LCD_2x16_Cmd(TLCD_CMD_CGRAM | (Slot << 3), LCD);
+    for (Row = 0; Row < 8; Row++)
+      P_LCD_2x16_Data(LCD_GlyphData[Slot][Row], LCD);
+    LCD->GlyphVersion[Slot] = LCD_GlyphVersion[Slot];
+  }
 }
 
 //Configuración del TIM4:
@@ -1112,8 +4192,6 @@ uint8_t FIND_EXTI_PIN_SOURCE(uint32_t Pin)
 		return EXTI_PinSource0;
 	else if (Pin == GPIO_Pin_1)
 		return EXTI_PinSource1;
-	else if (Pin == GPIO_Pin_1)
-		return EXTI_PinSource1;
 	else if (Pin == GPIO_Pin_2)
 		return EXTI_PinSource2;
 	else if (Pin == GPIO_Pin_3)
@@ -1140,6 +4218,8 @@ uint8_t FIND_EXTI_PIN_SOURCE(uint32_t Pin)
 		return EXTI_PinSource13;
 	else if (Pin == GPIO_Pin_14)
 		return EXTI_PinSource14;
+	else if (Pin == GPIO_Pin_15)
+		return EXTI_PinSource15;
 	else
 		return 0;
 }
@@ -1194,13 +4274,13 @@ uint32_t FIND_EXTI_HANDLER(uint32_t Pin)
 			return EXTI3_IRQn;
 	else if (Pin == GPIO_Pin_4)
 			return EXTI4_IRQn;
-	else if (Pin == GPIO_Pin_5 || Pin == GPIO_Pin_5 || Pin == GPIO_Pin_7 ||
+	else if (Pin == GPIO_Pin_5 || Pin == GPIO_Pin_6 || Pin == GPIO_Pin_7 ||
 			 Pin == GPIO_Pin_8 || Pin == GPIO_Pin_9)
 			return EXTI9_5_IRQn;
 	else if (Pin == GPIO_Pin_10 || Pin == GPIO_Pin_11 || Pin == GPIO_Pin_12 ||
 			 Pin == GPIO_Pin_13 || Pin == GPIO_Pin_14 || Pin == GPIO_Pin_15)
 			return EXTI15_10_IRQn;
-	else 	return 0;
+	else 	return 0;	//Pin invalido (WWDG_IRQn, P_IRQ_Enable no lo habilita)
 }
 
 uint32_t FIND_DAC_CHANNEL(GPIO_TypeDef* Port, uint32_t Pin)
@@ -1208,6 +4288,161 @@ uint32_t FIND_DAC_CHANNEL(GPIO_TypeDef* Port, uint32_t Pin)
 	if(Port == GPIOA && Pin == GPIO_Pin_5) return DAC_Channel_1;
 	else return 0;
 }
+
+//DWT:
+void WAIT_CYCLES(uint32_t Cycles)
+{
+	uint32_t Start = DWT->CYCCNT;
+
+	//La resta en 32 bits sin signo tolera el desborde de CYCCNT:
+	while ((DWT->CYCCNT - Start) < Cycles);
+}
+
+//Despachador:
+void P_SCHED_Release(uint32_t Now)
+{
+	uint8_t i;
+
+	for (i = 0; i < SCHED_TaskAnz; i++)
+		//Diferencia con signo, sigue funcionando al dar la vuelta el contador:
+		while ((int32_t) (Now - SCHED_Tasks[i].Next) >= 0) {
+			SCHED_Tasks[i].Next += SCHED_Tasks[i].TASK_PERIOD;
+			//La liberacion anterior todavia no termino: overrun. Si no, se
+			//marca el instante para medir la demora hasta su ejecucion:
+			if (SCHED_Tasks[i].Released != SCHED_Tasks[i].Done)
+				SCHED_Tasks[i].Probe.Overruns++;
+			else
+				PROBE_RELEASE(&SCHED_Tasks[i].Probe);
+			SCHED_Tasks[i].Released++;
+		}
+}
+
+void P_SCHED_Arm(void)
+{
+	uint32_t Next;
+	uint8_t i;
+
+	//Se libera lo vencido y se programa la proxima liberacion. El CC1 solo
+	//dispara al igualar: si el contador ya la paso, se vuelve a liberar:
+	do {
+		P_SCHED_Release(TIM2->CNT);
+		Next = TIM2->CNT + 0x7FFFFFFF;
+		for (i = 0; i < SCHED_TaskAnz; i++)
+			if ((int32_t) (SCHED_Tasks[i].Next - Next) < 0)
+				Next = SCHED_Tasks[i].Next;
+		TIM_SetCompare1(TIM2, Next);
+	} while ((int32_t) (TIM2->CNT - Next) >= 0);
+}
+
+//Formato:
+uint8_t P_FORMAT_Number(char* Buffer, int32_t Value, uint8_t Decimals, uint8_t Width, char Pad)
+{
+	char Digits[FORMAT_MAX_LEN];
+	uint32_t Magnitude;
+	uint8_t Count = 0;
+	uint8_t Length = 0;
+
+	if (Decimals > 9) Decimals = 9;
+	if (Width > FORMAT_MAX_LEN) Width = FORMAT_MAX_LEN;
+
+	//Modulo en 32 bits sin signo, asi INT32_MIN no desborda:
+	Magnitude = (Value < 0) ? 0u - (uint32_t) Value : (uint32_t) Value;
+
+	//Digitos de atras para adelante, con al menos un entero antes de la coma:
+	do {
+		Digits[Count++] = '0' + Magnitude % 10;
+		Magnitude /= 10;
+		if (Count == Decimals)
+			Digits[Count++] = '.';
+	} while (Magnitude != 0 || (Decimals && Count <= Decimals + 1));
+
+	if (Value < 0) {
+		//Con relleno de ceros el signo queda adelante: "-05":
+		if (Pad == '0')
+			while (Count + 1 < Width)
+				Digits[Count++] = '0';
+		Digits[Count++] = '-';
+	}
+
+	while (Length + Count < Width)
+		Buffer[Length++] = Pad;
+	while (Count)
+		Buffer[Length++] = Digits[--Count];
+	Buffer[Length] = 0;
+
+	return Length;
+}
+
+//Timers por software:
+//Engancha el timer en el nivel mas bajo cuyo alcance cubre lo que falta:
+void P_TIMER_Insert(TIMER_t* Timer)
+{
+	uint32_t Delta = Timer->Expires - TIMER_Now;
+	uint8_t Level = 0;
+	TIMER_t** Slot;
+
+	//Vencido (periodo menor al atraso de TICK_TIMERS): sale en el proximo tick que se atienda:
+	if ((int32_t) Delta < 0)
+		Timer->Expires = TIMER_Now;
+	else
+		while (Level < TIMER_WHEEL_LEVELS - 1 && Delta >= (1UL << (TIMER_WHEEL_BITS * (Level + 1))))
+			Level++;
+
+	Slot = &TIMER_Wheel[Level][(Timer->Expires >> (TIMER_WHEEL_BITS * Level)) & (TIMER_WHEEL_SLOTS - 1)];
+	Timer->Next = *Slot;
+	if (*Slot != NULL)
+		(*Slot)->Prev = &Timer->Next;
+	Timer->Prev = Slot;
+	*Slot = Timer;
+}
+
+//Saca el timer de su ranura sin recorrerla (Prev apunta al puntero que lo enlaza):
+void P_TIMER_Unlink(TIMER_t* Timer)
+{
+	if (Timer->Prev == NULL)
+		return;
+
+	*Timer->Prev = Timer->Next;
+	if (Timer->Next != NULL)
+		Timer->Next->Prev = Timer->Prev;
+	Timer->Prev = NULL;
+	Timer->Next = NULL;
+}
+
+//NVIC:
+//Prioridad de la tabla de INIT_IRQ_PRIO (o Default) y habilitacion. La IRQ 0 (WWDG)
+//no la usa la libreria y es la que dan los FIND_* con un pin invalido, no se habilita:
+void P_IRQ_Enable(IRQn_Type IRQ, uint8_t Default)
+{
+	uint8_t i;
+
+	if (IRQ == WWDG_IRQn)
+		return;
+
+	for (i = 0; i < IRQ_PrioAnz; i++)
+		if (IRQ_PrioTable[i].IRQ_NUM == IRQ)
+			Default = IRQ_PrioTable[i].IRQ_PRIO;
+
+	NVIC_SetPriority(IRQ, Default);
+	NVIC_EnableIRQ(IRQ);
+}
+
+//Ciclos de CPU por paso del timer: el reloj de los timers es PCLK, o 2 x PCLK si el
+//bus APB esta dividido (PPRE = 0xx sin division, 1xx divide por 2^(PPRE - 3)):
+uint32_t P_TIM_Cycles(TIM_TypeDef* TIMx)
+{
+	uint32_t Ppre;
+
+	if (TIMx == TIM1 || TIMx == TIM8 || TIMx == TIM9 || TIMx == TIM10 || TIMx == TIM11)
+		Ppre = (RCC->CFGR & RCC_CFGR_PPRE2) >> 13;
+	else
+		Ppre = (RCC->CFGR & RCC_CFGR_PPRE1) >> 10;
+
+	if (Ppre < 4)
+		return TIMx->PSC + 1;
+	return (TIMx->PSC + 1) << (Ppre - 4);
+}
+
 /*------------------------------------------------------------------------------
 NOTAS
 ------------------------------------------------------------------------------*/
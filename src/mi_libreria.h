@@ -6,23 +6,55 @@
 #include "stm32f4xx_rcc.h"
 #include "stm32f4xx_adc.h"
 #include "stdio.h"
+#include "string.h"
 #include "stm32f4xx_tim.h"
 #include "misc.h"
 #include "stm32f4xx_exti.h"
 #include "stm32f4xx_syscfg.h"
 #include "stm32f4xx_dac.h"
+#include "stm32f4xx_dma.h"
 
 
 //--------------------------------------------------------------
 // Defines
 //--------------------------------------------------------------
-#define  TLCD_INIT_PAUSE  100000  // pause beim init (>=70000)
-#define  TLCD_PAUSE        50000  // kleine Pause (>=20000)
-#define  TLCD_CLK_PAUSE     1000  // pause f�r Clock-Impuls (>=500)
-#define  TLCD_MAXX            16  // max x-Position (0...15)
-#define  TLCD_MAXY             2  // max y-Position (0...1)
-#define  Delay_Debouncing 100e3
+#define  TLCD_INIT_PAUSE   40000  // Pausa de encendido [us] (>=40000 a 2,7V)
+#define  TLCD_INIT_PULSE    4100  // Pausa tras el 1er pulso de init [us] (>=4100)
+#define  TLCD_INIT_PULSE2    150  // Pausa tras los demas pulsos de init [us] (>=100)
+#define  TLCD_PAUSE         1600  // Pausa tras CLEAR/HOME [us] (>=1520)
+#define  TLCD_CLK_PAUSE      500  // Semiperiodo del pulso de E [ns] (>=450)
+#define  TLCD_BUSY_TIMEOUT   500  // Lecturas del busy flag antes de volver a las pausas fijas
+#ifndef  TLCD_MAXX
+#define  TLCD_MAXX            16  // max x-Position de cualquier display (0...15), -DTLCD_MAXX=20/40 para otros
+#endif
+#ifndef  TLCD_MAXY
+#define  TLCD_MAXY             2  // max y-Position de cualquier display (0...1), -DTLCD_MAXY=4 para 20x4/40x4
+#endif
+#ifndef  TLCD_LEGACY_ANZ
+#define  TLCD_LEGACY_ANZ       6  // Pines de la tabla de INIT_LCD_2x16: RS, E, D4..D7 (7 si agrega TLCD_RW)
+#endif
+#define  TLCD_BUS_4BIT         4  // Bus de datos D4..D7, dos pulsos de E por byte
+#define  TLCD_BUS_8BIT         8  // Bus de datos D0..D7, un pulso de E por byte
+#define  TLCD_QUEUE_LEN      128  // Largo de la cola del LCD (potencia de 2)
+#define  TLCD_PHASE_US         2  // Duracion de cada fase de E/datos en la cola [us]
+#define  TLCD_EXEC_US         50  // Tiempo de ejecucion de un comando/dato [us] (>=37)
+#define  TLCD_DMA_STEP_US     10  // Paso de la forma de onda del modo DMA [us]
+#define  TLCD_DMA_PORTS        3  // Max. cantidad de puertos GPIO en modo DMA
+#define  TLCD_GLYPHS           8  // Caracteres programables en la CGRAM
+#define  TLCD_GLYPH_BASE       8  // Codigo del 1er glyph (8..15 = CGRAM 0..7, evita el 0)
+#define  TLCD_CHAR_FULL     0xFF  // Bloque lleno de la ROM del HD44780
+#ifndef  TLCD_BENCH
+#define  TLCD_BENCH            0  // 1 = cuenta las escrituras al bus del LCD (BUS_OPS_LCD_2x16), -DTLCD_BENCH=1
+#endif
+#define  PROBE_LOOP_DIV        8  // Divisor del TIM9 del lazo de latencia (INIT_PROBE_LOOP)
+#define  Delay_Debouncing 5000 	  // Antirrebote [us]
 #define	 BufferLength 	  20
+#define  FORMAT_MAX_LEN   16  // Ancho maximo de FORMAT_INT/FORMAT_FIXED (buffer de +1)
+#define  DEFER_MAX         8  // Funciones pendientes de DEFER a la vez
+#define  Use_RTOS          0  // 1 = kernel CMSIS-RTOS (cmsis_os.c, duenio del SysTick y del PendSV)
+#define  TIMER_WHEEL_BITS  6  // Ranuras por nivel de la rueda de timers = 2^bits
+#define  TIMER_WHEEL_LEVELS 4 // Niveles de la rueda (alcance 2^(bits*niveles) ticks)
+#define  DECIM_MAX_ORDER   3  // Etapas maximas del filtro CIC (DECIM_t)
 #define  MaxDigCount 	  4035
 #define  MaxMiliVoltRef	  3000
 
@@ -35,12 +67,14 @@ DAC_InitTypeDef 		DAC_InitStructure;
 // LCD Kommandos (siehe Datenblatt)
 //--------------------------------------------------------------
 #define  TLCD_CMD_INIT_DISPLAY  0x28   // 2 Zeilen Display, 5x7 Punkte
+#define  TLCD_CMD_8BIT          0x10   // Bit DL del INIT_DISPLAY (bus de 8 bits)
 #define  TLCD_CMD_ENTRY_MODE    0x06   // Cursor increase, Display fix
 #define  TLCD_CMD_DISP_M0       0x08   // Display=AUS, Cursor=Aus, Blinken=Aus
 #define  TLCD_CMD_DISP_M1       0x0C   // Display=EIN, Cursor=AUS, Blinken=Aus
 #define  TLCD_CMD_DISP_M2       0x0E   // Display=EIN, Cursor=EIN, Blinken=Aus
 #define  TLCD_CMD_DISP_M3       0x0F   // Display=EIN, Cursor=EIN, Blinken=EIN
 #define  TLCD_CMD_CLEAR         0x01   // loescht das Display
+#define  TLCD_CMD_CGRAM         0x40   // Direccion de la CGRAM (| glyph << 3)
 
 //--------------------------------------------------------------
 // Liste aller Pins fur das Display
@@ -53,10 +87,16 @@ typedef enum
   TLCD_D4 = 2,  // DB4-Pin
   TLCD_D5 = 3,  // DB5-Pin
   TLCD_D6 = 4,  // DB6-Pin
-  TLCD_D7 = 5   // DB7-Pin
+  TLCD_D7 = 5,  // DB7-Pin
+  TLCD_RW = 6,  // RW-Pin (opcional, habilita la lectura del busy flag)
+  TLCD_D0 = 7,  // DB0-Pin (solo TLCD_BUS_8BIT)
+  TLCD_D1 = 8,  // DB1-Pin (solo TLCD_BUS_8BIT)
+  TLCD_D2 = 9,  // DB2-Pin (solo TLCD_BUS_8BIT)
+  TLCD_D3 = 10, // DB3-Pin (solo TLCD_BUS_8BIT)
+  TLCD_E2 = 11  // E-Pin del 2do controlador (opcional, filas 2 y 3 de un 40x4)
 }TLCD_NAME_t;
 
-#define  TLCD_ANZ   6 // Anzahl von TLCD_NAME_t
+#define  TLCD_ANZ   12 // Anzahl von TLCD_NAME_t
 
 //--------------------------------------------------------------
 // Display Modes
@@ -79,6 +119,159 @@ typedef struct {
   BitAction TLCD_INIT;     // Init
 }LCD_2X16_t;
 
+//--------------------------------------------------------------
+// Display: tabla de pines, geometria y estado del driver
+// (se completan los 4 primeros campos, el resto es interno)
+//--------------------------------------------------------------
+typedef struct {
+  LCD_2X16_t* TLCD_PINS;   // Tabla de pines, en cualquier orden
+  uint8_t TLCD_PIN_ANZ;    // Cantidad de pines de la tabla
+  uint8_t TLCD_COLS;       // Columnas: 16, 20 o 40 (hasta TLCD_MAXX)
+  uint8_t TLCD_ROWS;       // Filas: 2 o 4 (hasta TLCD_MAXY; 40x4 = dos controladores, con TLCD_E2)
+  uint8_t TLCD_BUS;        // TLCD_BUS_4BIT o TLCD_BUS_8BIT
+  GPIO_TypeDef* Port[TLCD_ANZ];        // Pines por nombre (NULL = no conectado)
+  uint16_t Pin[TLCD_ANZ];
+  GPIO_TypeDef* NibblePort[2][4];      // Palabras BSRR por puerto: [0] D4..D7, [1] D0..D3
+  uint32_t NibbleMask[2][4][16];
+  uint8_t NibblePorts[2];
+  uint8_t Enable;                      // Controladores destino: bit 0 = E, bit 1 = E2
+  uint8_t EnableAll;
+  uint8_t BusyFlagOn;
+  uint8_t GlyphVersion[TLCD_GLYPHS];   // Version de cada glyph cargada en la CGRAM
+  char Glass[TLCD_MAXY][TLCD_MAXX];    // Copia de lo escrito en el display
+}LCD_t;
+
+//Tabla de pines y su cantidad, para inicializar un LCD_t:
+#define  TLCD_PIN_TABLE(Table)  (Table), (sizeof(Table) / sizeof((Table)[0]))
+
+//--------------------------------------------------------------
+// Medicion de tiempos con el DWT (BENCH_START/BENCH_STOP)
+//--------------------------------------------------------------
+typedef struct {
+  uint32_t Start;     // CYCCNT al comenzar la medicion
+  uint32_t Count;     // Cantidad de mediciones
+  uint32_t Min;       // Minimo [ciclos]
+  uint32_t Max;       // Maximo [ciclos]
+  uint64_t Sum;       // Suma para el promedio (BENCH_MEAN) [ciclos]
+  uint32_t BusStart;
+  uint32_t BusOps;    // Escrituras al bus del LCD en la ultima medicion
+  uint32_t BusMax;    // Maximo de escrituras al bus del LCD
+}BENCH_t;
+
+//--------------------------------------------------------------
+// Estadisticas de una tarea o interrupcion (PROBE_ENTER/PROBE_EXIT)
+// (se completa PROBE_PERIOD, el resto se lee con el debugger)
+//--------------------------------------------------------------
+typedef struct {
+  uint32_t PROBE_PERIOD;  // Periodo nominal [ciclos] (0 = sin control de overrun)
+  BENCH_t Exec;           // Tiempo de ejecucion [ciclos]
+  uint32_t Last;          // CYCCNT del ultimo inicio
+  uint32_t IntervalMin;   // Tiempo entre inicios [ciclos] (jitter = Max - Min)
+  uint32_t IntervalMax;
+  uint32_t Release;       // CYCCNT de la ultima PROBE_RELEASE
+  uint8_t Released;
+  uint32_t LatencyMin;    // Demora liberacion -> inicio [ciclos]
+  uint32_t LatencyMax;
+  uint32_t Overruns;      // Ejecuciones mas largas que el periodo o liberaciones perdidas
+}PROBE_t;
+
+//--------------------------------------------------------------
+// Tarea periodica del despachador (INIT_SCHED)
+// (se completan los 4 primeros campos, el resto es interno)
+//--------------------------------------------------------------
+typedef struct {
+  void (*TASK_FUNC)(void);  // Tarea
+  uint32_t TASK_PERIOD;     // Periodo [ticks]
+  uint32_t TASK_PHASE;      // Desfasaje de la 1ra liberacion [ticks]
+  uint8_t TASK_PRIO;        // Prioridad (0 = la mas alta)
+  uint32_t Next;            // Tick de la proxima liberacion
+  volatile uint32_t Released;  // Liberaciones (TICK_SCHED)
+  volatile uint32_t Done;      // Ejecuciones (RUN_SCHED)
+  PROBE_t Probe;            // Tiempos de ejecucion, jitter y overruns
+}SCHED_TASK_t;
+
+//Tabla de tareas y su cantidad, para INIT_SCHED:
+#define  TSCHED_TABLE(Table)  (Table), (sizeof(Table) / sizeof((Table)[0]))
+
+//--------------------------------------------------------------
+// Entrada de un barrido de ADC1/ADC3 (INIT_ADC_SCAN)
+// (se completan los 3 primeros campos, el resto es interno)
+//--------------------------------------------------------------
+typedef struct {
+  GPIO_TypeDef* ADC_PORT;   // Port
+  uint16_t ADC_PIN;         // Pin
+  uint8_t ADC_SAMPLE_TIME;  // Tiempo de muestreo (ADC_SampleTime_xCycles)
+  ADC_TypeDef* ADCX;        // ADC del pin
+  uint8_t Channel;          // Canal del pin
+  uint16_t Index;           // Lugar en el arreglo de valores
+}ADC_SCAN_t;
+
+//Tabla de entradas y su cantidad, para INIT_ADC_SCAN:
+#define  TADC_TABLE(Table)  (Table), (sizeof(Table) / sizeof((Table)[0]))
+
+//--------------------------------------------------------------
+// Filtro de sobremuestreo y decimacion CIC (INIT_DECIM/DECIM_PUT)
+// (se completan los 3 primeros campos, el resto es interno)
+//--------------------------------------------------------------
+typedef struct {
+  uint8_t DECIM_ORDER;      // Etapas (1 = boxcar, max DECIM_MAX_ORDER)
+  uint16_t DECIM_RATIO;     // Muestras de entrada por salida
+  uint8_t DECIM_SHIFT;      // Bits que se descartan de la suma
+  uint32_t Integ[DECIM_MAX_ORDER];
+  uint32_t Comb[DECIM_MAX_ORDER];
+  uint16_t Count;
+  volatile uint32_t Out;      // Ultima salida
+  volatile uint32_t Outputs;  // Salidas entregadas
+}DECIM_t;
+
+//--------------------------------------------------------------
+// Prioridad de una interrupcion en el mapa del NVIC (INIT_IRQ_PRIO)
+//--------------------------------------------------------------
+typedef struct {
+  IRQn_Type IRQ_NUM;  // Interrupcion (TIM3_IRQn, EXTI9_5_IRQn, ...)
+  uint8_t IRQ_PRIO;   // Prioridad de desalojo (0 = la mas alta, 0...13)
+}IRQ_PRIO_t;
+
+//Tabla de prioridades y su cantidad, para INIT_IRQ_PRIO:
+#define  TIRQ_TABLE(Table)  (Table), (sizeof(Table) / sizeof((Table)[0]))
+
+//--------------------------------------------------------------
+// Cola de un productor y un consumidor (INIT_SPSC)
+// (Head lo escribe solo el productor y Tail solo el consumidor)
+//--------------------------------------------------------------
+typedef struct {
+  void* SPSC_BUF;           // Arreglo de elementos
+  uint16_t SPSC_SIZE;       // Cantidad de elementos (potencia de 2)
+  uint16_t SPSC_ITEM;       // Tamano de un elemento [bytes]
+  volatile uint32_t Head;   // Elementos agregados (PUT_SPSC)
+  volatile uint32_t Tail;   // Elementos sacados (GET_SPSC)
+  uint32_t Lost;            // Elementos descartados por cola llena
+}SPSC_t;
+
+//Arreglo, cantidad y tamano de sus elementos, para INIT_SPSC:
+#define  TSPSC_BUFFER(Buffer)  (Buffer), (sizeof(Buffer) / sizeof((Buffer)[0])), sizeof((Buffer)[0])
+
+//--------------------------------------------------------------
+// Seqlock de un estado compartido con un solo escritor
+// (WRITE_SEQLOCK/READ_SEQLOCK, Seq impar = escritura en curso)
+//--------------------------------------------------------------
+typedef struct {
+  volatile uint32_t Seq;
+}SEQLOCK_t;
+
+//--------------------------------------------------------------
+// Timer por software (START_TIMER/STOP_TIMER, corre con TICK_TIMERS)
+// (se completan los 3 primeros campos, el resto es interno)
+//--------------------------------------------------------------
+typedef struct TIMER_s {
+  void (*TIMER_FUNC)(void*);  // Funcion al vencer
+  void* TIMER_ARG;            // Argumento de TIMER_FUNC
+  uint32_t TIMER_PERIOD;      // Periodo [ticks] (0 = one-shot)
+  uint32_t Expires;           // Tick del proximo vencimiento
+  struct TIMER_s* Next;       // Siguiente en la ranura
+  struct TIMER_s** Prev;      // Puntero que lo enlaza (NULL = detenido)
+}TIMER_t;
+
 //--------------------------------------------------------------
 // FUNCIONES GLOBALES
 //--------------------------------------------------------------
@@ -86,6 +279,19 @@ void 	INIT_DI(GPIO_TypeDef*, uint32_t);
 void 	INIT_DO(GPIO_TypeDef*, uint32_t);
 
 void 	DELAY(volatile uint32_t);
+void 	INIT_DWT(void);
+void 	DELAY_US(uint32_t);
+void 	DELAY_NS(uint32_t);
+void	BENCH_RESET(BENCH_t*);
+void	BENCH_START(BENCH_t*);
+uint32_t BENCH_STOP(BENCH_t*);
+uint32_t BENCH_MEAN(BENCH_t*);
+void	PROBE_RELEASE(PROBE_t*);
+void	PROBE_ENTER(PROBE_t*);
+uint32_t PROBE_EXIT(PROBE_t*);
+void	PROBE_TIMER(PROBE_t*, TIM_TypeDef*, uint32_t);
+uint8_t	INIT_PROBE_LOOP(GPIO_TypeDef*, uint16_t);
+uint8_t	PROBE_LOOP(PROBE_t*);
 
 int 	READ_DI(GPIO_TypeDef*, uint16_t);
 
@@ -93,13 +299,67 @@ void 	LED_ON(GPIO_TypeDef*, uint16_t, int);
 
 void 	INIT_ADC(GPIO_TypeDef*, uint16_t);
 int32_t READ_ADC(GPIO_TypeDef*, uint16_t);
+uint8_t	INIT_ADC_DMA(GPIO_TypeDef*, uint16_t, uint16_t*, uint16_t, uint32_t, void (*)(uint16_t*, uint16_t));
+int32_t READ_ADC_DMA(GPIO_TypeDef*, uint16_t);
+uint8_t	INIT_ADC_SCAN(ADC_SCAN_t*, uint8_t, uint16_t*, uint32_t, void (*)(uint16_t*, uint16_t));
+int32_t READ_ADC_SCAN(ADC_SCAN_t*);
+uint8_t	INIT_ADC_CAPTURE(GPIO_TypeDef*, uint16_t, uint8_t, uint16_t*, uint16_t, void (*)(uint16_t*, uint16_t));
+uint8_t	BUSY_ADC_CAPTURE(void);
+void	INIT_DECIM(DECIM_t*);
+uint8_t	DECIM_PUT(DECIM_t*, uint32_t);
 int 	DAC_FUNC(uint32_t, int);
 
+uint8_t	FORMAT_INT(char*, int32_t, uint8_t, char);
+uint8_t	FORMAT_FIXED(char*, int32_t, uint8_t, uint8_t, char);
+
+uint8_t	INIT_LCD(LCD_t*);
+void	CLEAR_LCD(LCD_t*);
+void	PRINT_LCD(LCD_t*, uint8_t, uint8_t, char*);
+void	REFRESH_LCD(LCD_t*);
+void	INIT_LCD_QUEUE(LCD_t*, void (*)(void));
+uint8_t	INIT_LCD_DMA(LCD_t*);
+uint8_t	PRINT_LCD_DMA(LCD_t*, uint8_t, uint8_t, char*);
 void	INIT_LCD_2x16(LCD_2X16_t*);
 void	CLEAR_LCD_2x16(LCD_2X16_t*);
 void	PRINT_LCD_2x16(LCD_2X16_t*, uint8_t, uint8_t, char*);
+void	CLEAR_FRAME_LCD_2x16(void);
+void	PRINT_FRAME_LCD_2x16(uint8_t, uint8_t, char*);
+void	PRINT_FRAME_INT_LCD_2x16(uint8_t, uint8_t, int32_t, uint8_t, char);
+void	PRINT_FRAME_FIXED_LCD_2x16(uint8_t, uint8_t, int32_t, uint8_t, uint8_t, char);
+uint8_t	GLYPH_FRAME_LCD_2x16(const uint8_t*);
+void	BAR_FRAME_LCD_2x16(uint8_t, uint8_t, uint8_t, uint32_t, uint32_t);
+uint8_t	BIG_FRAME_LCD_2x16(uint8_t, int32_t);
+void	REFRESH_LCD_2x16(LCD_2X16_t*);
+void	INIT_LCD_2x16_QUEUE(LCD_2X16_t*, void (*)(void));
+void	FLUSH_LCD_2x16(void);
+uint8_t	INIT_LCD_2x16_DMA(LCD_2X16_t*);
+uint8_t	PRINT_LCD_2x16_DMA(LCD_2X16_t*, uint8_t, uint8_t, char*);
+uint8_t	BUSY_LCD_2x16_DMA(void);
+uint32_t BUS_OPS_LCD_2x16(void);
 
 void 	INIT_SYSTICK(float);
+void	INIT_SCHED(SCHED_TASK_t*, uint8_t);
+void	TICK_SCHED(void);
+void	INIT_SCHED_TICKLESS(void);
+uint32_t NOW_SCHED(void);
+void	INIT_DEFER(void);
+uint8_t	DEFER(void (*)(void));
+void	RUN_DEFER(void);
+uint32_t RUN_SCHED(void);
+uint8_t	PENDING_SCHED(void);
+
+void	INIT_SPSC(SPSC_t*, void*, uint16_t, uint16_t);
+uint8_t	PUT_SPSC(SPSC_t*, const void*);
+uint8_t	GET_SPSC(SPSC_t*, void*);
+uint16_t COUNT_SPSC(SPSC_t*);
+void	WRITE_SEQLOCK(SEQLOCK_t*, void*, const void*, uint16_t);
+uint8_t	READ_SEQLOCK(SEQLOCK_t*, void*, const void*, uint16_t);
+
+void	INIT_TIMERS(void);
+void	START_TIMER(TIMER_t*, uint32_t);
+void	STOP_TIMER(TIMER_t*);
+uint8_t	ACTIVE_TIMER(TIMER_t*);
+void	TICK_TIMERS(void);
 
 void INIT_TIM4(GPIO_TypeDef*, uint16_t);
 void SET_TIM4(uint16_t, uint32_t T, uint32_t, uint32_t);
@@ -109,6 +369,7 @@ void INIT_TIM3(void);
 void SET_TIM3(uint32_t, uint32_t);
 
 void INIT_EXTINT(GPIO_TypeDef*, uint16_t);
+void INIT_IRQ_PRIO(const IRQ_PRIO_t*, uint8_t);
 
 void INIT_DAC_CONT(GPIO_TypeDef*, uint16_t);
 void DAC_CONT(GPIO_TypeDef*, uint16_t, int32_t);
@@ -29,6 +29,7 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "stm32f4xx_it.h"
+#include "mi_libreria.h"
 
 /** @addtogroup Template_Project
   * @{
@@ -124,6 +125,7 @@ void DebugMon_Handler(void)
 {
 }
 
+#if !Use_RTOS
 /**
   * @brief  This function handles PendSVC exception.
   * @param  None
@@ -131,8 +133,25 @@ void DebugMon_Handler(void)
   */
 void PendSV_Handler(void)
 {
+  /* Trabajo diferido de las interrupciones (DEFER) */
+  RUN_DEFER();
 }
 
+/**
+  * @brief  This function handles SysTick Handler.
+  * @param  None
+  * @retval None
+  */
+void SysTick_Handler(void)
+{
+  /* Tick del despachador cuando la base de tiempo es el SysTick (INIT_SYSTICK) */
+  TICK_SCHED();
+}
+#endif
+
+/* Con Use_RTOS, PendSV_Handler y SysTick_Handler estan en cmsis_os.c (trabajo
+   diferido, tick y cambio de contexto del kernel) */
+
 
 /******************************************************************************/
 /*                 STM32F4xx Peripherals Interrupt Handlers                   */